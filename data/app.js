@@ -127,6 +127,10 @@ function fillAlarmDialog(a) {
   setInputValue("aGpio", a.gpio_pin ?? 0);
   setInputValue("aLong", a.long_press_ms ?? 0);
   setInputValue("aVol", a.volume ?? 80);
+  setInputValue("aFade", a.fade_in_sec ?? 0);
+  setInputValue("aLoop", a.loop_audio ? "1" : "0");
+  setInputValue("aCresc", a.loop_crescendo ?? 0);
+  setInputValue("aMaxRing", a.max_ring_sec ?? 0);
   setInputValue("aInToken", a.inbound_webhook_token || "");
 
   const as = a.audio_source || {};
@@ -134,6 +138,8 @@ function fillAlarmDialog(a) {
   setInputValue("aLocalPath", as.local_path || "/audio/default.wav");
   setInputValue("aUrl", as.url || "");
   setInputValue("aFallback", as.fallback_local_path || "/audio/default.wav");
+  setInputValue("aSynthPattern", as.synth_pattern || "beep");
+  setInputValue("aSynthFreq", as.synth_freq_hz ?? 880);
 
   const wh = a.outbound_webhooks || {};
   setInputValue("wSet", wh.on_set_url || "");
@@ -161,12 +167,18 @@ function readAlarmDialog() {
       gpio_pin: parseInt(document.getElementById("aGpio").value || "0", 10),
       long_press_ms: parseInt(document.getElementById("aLong").value || "0", 10),
       volume: parseInt(document.getElementById("aVol").value || "80", 10),
+      fade_in_sec: parseInt(document.getElementById("aFade").value || "0", 10),
+      loop_audio: document.getElementById("aLoop").value === "1",
+      loop_crescendo: parseInt(document.getElementById("aCresc").value || "0", 10),
+      max_ring_sec: parseInt(document.getElementById("aMaxRing").value || "0", 10),
       inbound_webhook_token: document.getElementById("aInToken").value.trim(),
       audio_source: {
         type: document.getElementById("aAudioType").value,
         local_path: document.getElementById("aLocalPath").value.trim(),
         url: document.getElementById("aUrl").value.trim(),
-        fallback_local_path: document.getElementById("aFallback").value.trim()
+        fallback_local_path: document.getElementById("aFallback").value.trim(),
+        synth_pattern: document.getElementById("aSynthPattern").value,
+        synth_freq_hz: parseInt(document.getElementById("aSynthFreq").value || "880", 10)
       },
       outbound_webhooks: {
         on_set_url: document.getElementById("wSet").value.trim(),
@@ -269,9 +281,21 @@ async function fireAlarm(id) {
   await loadStatus();
 }
 
+// Playback starts in the background; poll the job until it plays or gives up.
+async function waitAudioJob(job) {
+  for (let i = 0; i < 40; i++) {
+    const st = await apiJson("GET", `/api/audio/jobs/${job}`);
+    if (["playing", "failed", "cancelled"].includes(st.state)) return st;
+    await new Promise(r => setTimeout(r, 500));
+  }
+  return null;
+}
+
 async function testAlarmAudio(id) {
   const res = await apiJson("POST", `/api/alarms/${id}/test_audio`);
-  setText("dlgMsg", `Test: ok=${res.ok} ${res.last_audio_error || ""}`);
+  setText("dlgMsg", `Test: job ${res.job} ...`);
+  const st = await waitAudioJob(res.job);
+  setText("dlgMsg", st ? `Test: ${st.state} ${st.source || ""} ${st.error || ""} (${st.elapsed_ms} ms)` : "Test: timeout");
   await loadStatus();
 }
 
@@ -297,7 +321,7 @@ async function loadFiles() {
       <div class="row">
         <div>
           <div>${escapeHtml(f.name || "")}</div>
-          <div class="small">${f.size} bytes • ${escapeHtml(f.path || "")}</div>
+          <div class="small">${f.size} bytes${fileFormatInfo(f)} • ${escapeHtml(f.path || "")}</div>
         </div>
         <div class="actions">
           <button class="btn danger" data-path="${escapeHtml(f.path || "")}">Radera</button>
@@ -307,6 +331,15 @@ async function loadFiles() {
   });
 }
 
+function fileFormatInfo(f) {
+  if (!f.format || f.format === "unknown") return "";
+  const sec = ((f.duration_ms || 0) / 1000).toFixed(1);
+  let info = ` • ${escapeHtml(f.format)} ${f.sample_rate} Hz • ${sec} s`;
+  if (f.loudness_lufs !== undefined) info += ` • ${f.loudness_lufs} LUFS`;
+  if (f.norm_gain_db !== undefined) info += ` (${f.norm_gain_db > 0 ? "+" : ""}${f.norm_gain_db} dB)`;
+  return info;
+}
+
 async function deleteFile(path) {
   await fetch(`/api/files?path=${encodeURIComponent(path)}`, {
     method: "DELETE",
@@ -324,15 +357,25 @@ async function uploadFile() {
   if (file.size > 2 * 1024 * 1024) { setText("fsInfo", "Max 2 MB"); return; }
   const fd = new FormData();
   fd.append("file", file);
+  // WAV is converted to .pcm unless another mode is picked; other types are stored as is.
+  const mode = document.getElementById("uploadMode").value;
+  const query = mode === "keep" ? "?transcode=0" : mode === "adpcm" ? "?format=adpcm" : "";
   setText("fsInfo", "Laddar upp...");
-  const res = await fetch("/api/files/upload", {
+  const res = await fetch("/api/files/upload" + query, {
     method: "POST",
     headers: adminToken ? { "X-Admin-Token": adminToken } : {},
     body: fd
   });
   const txt = await res.text();
   if (!res.ok) { setText("fsInfo", `Fel: ${txt}`); return; }
-  setText("fsInfo", "Klart");
+  let info = "Klart";
+  try {
+    const r = JSON.parse(txt);
+    if (r.path) info = `Klart: ${r.path} (${r.format}, ${r.size} B)`;
+    if (r.replaced) info += `, ersatte ${r.replaced}`;
+    if (r.alarms_updated) info += `, ${r.alarms_updated} larm pekar nu på ${r.path}`;
+  } catch (e) { }
+  setText("fsInfo", info);
   inp.value = "";
   await loadFiles();
   await loadStatus();
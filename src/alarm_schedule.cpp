@@ -0,0 +1,111 @@
+#include "alarm_schedule.h"
+
+namespace {
+struct ScheduleLock {
+  explicit ScheduleLock(SemaphoreHandle_t l) : m(l) { if (m) xSemaphoreTake(m, portMAX_DELAY); }
+  ~ScheduleLock() { if (m) xSemaphoreGive(m); }
+  SemaphoreHandle_t m;
+};
+}
+
+AlarmSchedule::AlarmSchedule() {
+  for (int i = 0; i < MAX_ALARMS; i++) pos[i] = -1;
+}
+
+void AlarmSchedule::begin() {
+  if (!lock) lock = xSemaphoreCreateMutex();
+  clear();
+}
+
+void AlarmSchedule::clear() {
+  ScheduleLock g(lock);
+  for (int i = 0; i < MAX_ALARMS; i++) {
+    due[i] = 0;
+    pos[i] = -1;
+  }
+  count = 0;
+}
+
+void AlarmSchedule::set(int idx, time_t deadline) {
+  if (idx < 0 || idx >= MAX_ALARMS) return;
+  ScheduleLock g(lock);
+  int p = pos[idx];
+
+  if (deadline == 0) {
+    if (p < 0) return;
+    due[idx] = 0;
+    pos[idx] = -1;
+    if (--count == p) return;
+    int16_t moved = heap[count];
+    heap[p] = moved;
+    pos[moved] = (int16_t)p;
+    siftUp(p);
+    siftDown(pos[moved]);
+    return;
+  }
+
+  if (p < 0) {
+    p = count++;
+    heap[p] = (int16_t)idx;
+    pos[idx] = (int16_t)p;
+    due[idx] = deadline;
+    siftUp(p);
+    return;
+  }
+
+  time_t old = due[idx];
+  due[idx] = deadline;
+  if (deadline < old) siftUp(p);
+  else if (deadline > old) siftDown(p);
+}
+
+int AlarmSchedule::top(time_t* deadline) const {
+  ScheduleLock g(lock);
+  if (count == 0) {
+    if (deadline) *deadline = 0;
+    return -1;
+  }
+  if (deadline) *deadline = due[heap[0]];
+  return heap[0];
+}
+
+time_t AlarmSchedule::deadline(int idx) const {
+  if (idx < 0 || idx >= MAX_ALARMS) return 0;
+  ScheduleLock g(lock);
+  return due[idx];
+}
+
+int AlarmSchedule::size() const {
+  ScheduleLock g(lock);
+  return count;
+}
+
+void AlarmSchedule::siftUp(int i) {
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (due[heap[parent]] <= due[heap[i]]) return;
+    swapAt(i, parent);
+    i = parent;
+  }
+}
+
+void AlarmSchedule::siftDown(int i) {
+  for (;;) {
+    int l = 2 * i + 1;
+    int r = l + 1;
+    int m = i;
+    if (l < count && due[heap[l]] < due[heap[m]]) m = l;
+    if (r < count && due[heap[r]] < due[heap[m]]) m = r;
+    if (m == i) return;
+    swapAt(i, m);
+    i = m;
+  }
+}
+
+void AlarmSchedule::swapAt(int i, int j) {
+  int16_t t = heap[i];
+  heap[i] = heap[j];
+  heap[j] = t;
+  pos[heap[i]] = (int16_t)i;
+  pos[heap[j]] = (int16_t)j;
+}
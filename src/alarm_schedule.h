@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "alarms.h"
+
+// Deadlines of all armed alarms (next fire or snooze end) in an indexed
+// min-heap, so the scheduler only looks at the earliest one. Entries are
+// moved in place when a deadline changes; web handlers and loop() both
+// update it, so every call takes the lock.
+class AlarmSchedule {
+public:
+  AlarmSchedule();
+  void begin();
+  void clear();
+
+  // Deadline 0 takes the alarm out of the schedule.
+  void set(int idx, time_t deadline);
+  void remove(int idx) { set(idx, 0); }
+
+  // Slot of the earliest deadline, -1 if nothing is armed.
+  int top(time_t* deadline = nullptr) const;
+  time_t deadline(int idx) const;
+  int size() const;
+
+private:
+  void siftUp(int i);
+  void siftDown(int i);
+  void swapAt(int i, int j);
+
+  time_t due[MAX_ALARMS] = {};
+  int16_t heap[MAX_ALARMS] = {};
+  int16_t pos[MAX_ALARMS];     // heap position per slot, -1 when absent
+  int count = 0;
+  SemaphoreHandle_t lock = nullptr;
+};
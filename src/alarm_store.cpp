@@ -0,0 +1,221 @@
+#include "alarm_store.h"
+
+static const char* TABLE_PATH = "/alarms.tbl";
+static const char* TABLE_NEW_PATH = "/alarms.tbl.new";   // rebuild in progress
+static const char* TABLE_BAD_PATH = "/alarms.tbl.bad";   // unreadable table, kept aside
+static const uint32_t TABLE_MAGIC = 0x314D4C41;   // "ALM1"
+static const uint32_t HEADER_BYTES = 8;           // magic, record size
+static const int NVS_LEGACY_SLOTS = 10;           // al0..al9 of older firmware
+
+namespace {
+struct StoreLock {
+  explicit StoreLock(SemaphoreHandle_t l) : m(l) { if (m) xSemaphoreTake(m, portMAX_DELAY); }
+  ~StoreLock() { if (m) xSemaphoreGive(m); }
+  SemaphoreHandle_t m;
+};
+}
+
+uint32_t AlarmStore::offsetOf(int slot) { return HEADER_BYTES + (uint32_t)slot * sizeof(AlarmConfig); }
+
+AlarmHot AlarmStore::makeHot(const AlarmConfig& a) {
+  AlarmHot h;
+  h.id = a.id;
+  h.last_fired_unix = a.last_fired_unix;
+  h.long_press_ms = a.long_press_ms;
+  h.max_ring_sec = a.max_ring_sec;
+  h.hour = a.hour;
+  h.minute = a.minute;
+  h.repeat.kind = a.repeat_kind;
+  h.repeat.interval = a.repeat_interval;
+  h.repeat.days_mask = a.days_mask;
+  h.repeat.month_weeks = a.month_weeks;
+  h.repeat.month_days = a.month_days;
+  h.repeat.start_day = a.repeat_start_day;
+  h.repeat.skip_holidays = a.skip_holidays;
+  h.gpio_pin = a.gpio_pin;
+  if (a.enabled) h.flags |= ALARM_HOT_ENABLED;
+  if (a.audio_type == AUDIO_URL && a.url[0]) h.flags |= ALARM_HOT_URL_AUDIO;
+  if (strlen(a.once_date) == 10) {
+    h.flags |= ALARM_HOT_ONCE;
+    h.once_day = dayFromIsoDate(a.once_date);
+  }
+  return h;
+}
+
+bool AlarmStore::begin(Preferences& prefs, uint32_t version) {
+  if (!lock) lock = xSemaphoreCreateMutex();
+  configVersion = version;
+  ready = false;
+  lastErr = "";
+  for (AlarmHot& h : hots) h = AlarmHot();
+
+  // A rebuild that was cut off after the old table was removed.
+  if (!LittleFS.exists(TABLE_PATH) && LittleFS.exists(TABLE_NEW_PATH)) LittleFS.rename(TABLE_NEW_PATH, TABLE_PATH);
+
+  File f = LittleFS.open(TABLE_PATH, "r");
+  uint32_t hdr[2] = {0, 0};
+  bool readable = f && f.read((uint8_t*)hdr, sizeof(hdr)) == sizeof(hdr) && hdr[0] == TABLE_MAGIC &&
+                  hdr[1] >= 8 && hdr[1] <= 4096;
+  bool valid = readable && hdr[1] == sizeof(AlarmConfig);
+
+  if (valid) {
+    AlarmConfig a;
+    for (int i = 0; i < MAX_ALARMS && f.read((uint8_t*)&a, sizeof(a)) == sizeof(a); i++) {
+      if (a.id != 0) hots[i] = makeHot(a);
+    }
+    if (f.available() >= (int)sizeof(AlarmConfig)) lastErr = "table has more slots than ALARM_CAPACITY";
+    f.close();
+  } else if (readable) {
+    bool ok = rebuildTable(f, hdr[1]);
+    f.close();
+    if (!ok) return false;
+  } else {
+    if (f) {
+      // Not a table this firmware can read: keep it for inspection rather
+      // than writing over it, and start a new one.
+      f.close();
+      LittleFS.remove(TABLE_BAD_PATH);
+      if (!LittleFS.rename(TABLE_PATH, TABLE_BAD_PATH)) { lastErr = "cannot move unreadable table aside"; return false; }
+      lastErr = String("unreadable table moved to ") + TABLE_BAD_PATH;
+    }
+    if (!createTable()) return false;
+  }
+
+  ready = true;
+  migrateNvs(prefs);
+  return true;
+}
+
+bool AlarmStore::createTable() {
+  File f = LittleFS.open(TABLE_PATH, "w");
+  uint32_t hdr[2] = {TABLE_MAGIC, sizeof(AlarmConfig)};
+  bool ok = f && f.write((const uint8_t*)hdr, sizeof(hdr)) == sizeof(hdr);
+  if (f) f.close();
+  if (!ok) lastErr = "cannot create table";
+  return ok;
+}
+
+// Copies every record of a table written with another AlarmConfig size into
+// a new table, then swaps it in. Fields are only ever added at the end of
+// AlarmConfig, so each record keeps its common prefix and the new fields
+// start at zero. The old table is removed only once the new one is complete.
+bool AlarmStore::rebuildTable(File& old, uint32_t oldRecordBytes) {
+  File f = LittleFS.open(TABLE_NEW_PATH, "w");
+  uint32_t hdr[2] = {TABLE_MAGIC, sizeof(AlarmConfig)};
+  bool ok = f && f.write((const uint8_t*)hdr, sizeof(hdr)) == sizeof(hdr);
+  int slots = 0;
+  uint8_t buf[64];
+  for (int i = 0; ok && i < MAX_ALARMS && old.available() >= (int)oldRecordBytes; i++) {
+    AlarmConfig a;
+    memset(&a, 0, sizeof(a));
+    for (uint32_t pos = 0; ok && pos < oldRecordBytes; pos += sizeof(buf)) {
+      size_t n = min((size_t)(oldRecordBytes - pos), sizeof(buf));
+      ok = old.read(buf, n) == n;
+      if (ok && pos < sizeof(a)) memcpy((uint8_t*)&a + pos, buf, min(n, (size_t)(sizeof(a) - pos)));
+    }
+    ok = ok && f.write((const uint8_t*)&a, sizeof(a)) == sizeof(a);
+    if (ok && a.id != 0) hots[i] = makeHot(a);
+    slots++;
+  }
+  if (f) f.close();
+  if (!ok) {
+    for (AlarmHot& h : hots) h = AlarmHot();
+    LittleFS.remove(TABLE_NEW_PATH);
+    lastErr = "cannot rebuild table";
+    return false;
+  }
+  old.close();
+  if (!LittleFS.remove(TABLE_PATH) || !LittleFS.rename(TABLE_NEW_PATH, TABLE_PATH)) {
+    lastErr = "cannot replace table";
+    return false;
+  }
+  lastErr = String("table rebuilt for the new record size (") + slots + " slots)";
+  return true;
+}
+
+void AlarmStore::migrateNvs(Preferences& prefs) {
+  for (int i = 0; i < NVS_LEGACY_SLOTS && i < MAX_ALARMS; i++) {
+    String key = "al" + String(i);
+    if (!prefs.isKey(key.c_str())) continue;
+
+    AlarmConfig a {};
+    bool fits = prefs.getBytesLength(key.c_str()) == sizeof(AlarmConfig);
+    if (fits) prefs.getBytes(key.c_str(), &a, sizeof(a));
+    if (fits && a.id != 0 && hots[i].id == 0 && !save(i, a)) continue;   // keep the blob for the next boot
+    prefs.remove(key.c_str());
+  }
+}
+
+int AlarmStore::find(uint32_t id) const {
+  if (id == 0) return -1;
+  for (int i = 0; i < MAX_ALARMS; i++) if (hots[i].id == id) return i;
+  return -1;
+}
+
+int AlarmStore::freeSlot() const {
+  for (int i = 0; i < MAX_ALARMS; i++) if (hots[i].id == 0) return i;
+  return -1;
+}
+
+int AlarmStore::count() const {
+  int n = 0;
+  for (const AlarmHot& h : hots) if (h.id != 0) n++;
+  return n;
+}
+
+bool AlarmStore::load(int slot, AlarmConfig& out) const {
+  memset(&out, 0, sizeof(out));
+  out.version = configVersion;
+  if (slot < 0 || slot >= MAX_ALARMS) return false;
+  if (hots[slot].id == 0) return true;
+
+  StoreLock g(lock);
+  File f = LittleFS.open(TABLE_PATH, "r");
+  bool ok = f && f.seek(offsetOf(slot)) && f.read((uint8_t*)&out, sizeof(out)) == sizeof(out);
+  if (f) f.close();
+  if (!ok) {
+    memset(&out, 0, sizeof(out));
+    out.version = configVersion;
+    return false;
+  }
+  if (out.version != configVersion) {
+    uint32_t keepId = out.id;
+    memset(&out, 0, sizeof(out));
+    out.version = configVersion;
+    out.id = keepId;
+  }
+  return true;
+}
+
+bool AlarmStore::save(int slot, const AlarmConfig& a) {
+  if (slot < 0 || slot >= MAX_ALARMS) return false;
+  StoreLock g(lock);
+  if (!writeRecord(slot, a)) return false;
+  hots[slot] = a.id ? makeHot(a) : AlarmHot();
+  return true;
+}
+
+bool AlarmStore::erase(int slot) {
+  AlarmConfig a {};
+  a.version = configVersion;
+  return save(slot, a);
+}
+
+// Slots past the end of the file are filled with empty records first.
+bool AlarmStore::writeRecord(int slot, const AlarmConfig& a) {
+  // Without a table in the current layout a write would land at the wrong offset.
+  if (!ready) { lastErr = "table not available"; return false; }
+  File f = LittleFS.open(TABLE_PATH, "r+");
+  if (!f) { lastErr = "cannot open table"; return false; }
+
+  bool ok = true;
+  if (f.size() < offsetOf(slot)) {
+    AlarmConfig empty {};
+    ok = f.seek(f.size());
+    while (ok && f.size() < offsetOf(slot)) ok = f.write((const uint8_t*)&empty, sizeof(empty)) == sizeof(empty);
+  }
+  ok = ok && f.seek(offsetOf(slot)) && f.write((const uint8_t*)&a, sizeof(a)) == sizeof(a);
+  f.close();
+  if (!ok) lastErr = "write failed";
+  return ok;
+}
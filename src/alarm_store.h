@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "alarms.h"
+
+// Alarm storage: the full AlarmConfig of every slot in one fixed-record
+// table on LittleFS, and an AlarmHot per slot in RAM for the scheduler.
+// Records are read only when asked for (load) and written one at a time
+// (save), so RAM and NVS use no longer grow with the number of alarms.
+// Alarms kept as NVS blobs by older firmware are moved into the table once.
+class AlarmStore {
+public:
+  // Opens or creates the table and builds the hot records. version is the
+  // config layout version; records of another version keep only their id.
+  // A table written with another record size is rebuilt in the current
+  // layout; one that cannot be read is moved aside, never overwritten.
+  // lastError() is set when either happened.
+  bool begin(Preferences& prefs, uint32_t version);
+
+  const AlarmHot& hot(int slot) const { return hots[slot]; }
+  int find(uint32_t id) const;   // slot, -1 if none
+  int freeSlot() const;          // -1 when full
+  int count() const;
+
+  // An empty slot loads as a zeroed record.
+  bool load(int slot, AlarmConfig& out) const;
+  bool save(int slot, const AlarmConfig& a);
+  bool erase(int slot);
+
+  String lastError() const { return lastErr; }
+
+private:
+  bool createTable();
+  bool rebuildTable(File& old, uint32_t oldRecordBytes);
+  bool writeRecord(int slot, const AlarmConfig& a);
+  void migrateNvs(Preferences& prefs);
+  static AlarmHot makeHot(const AlarmConfig& a);
+  static uint32_t offsetOf(int slot);
+
+  AlarmHot hots[MAX_ALARMS];
+  uint32_t configVersion = 0;
+  bool ready = false;   // the table on flash has the current layout
+  SemaphoreHandle_t lock = nullptr;
+  String lastErr;
+};
@@ -1,9 +1,14 @@
 #pragma once
 #include <Arduino.h>
+#include "recurrence.h"
 
-static const int MAX_ALARMS = 10;
+// Alarm slots; set -DALARM_CAPACITY=n in build_flags for another size.
+#ifndef ALARM_CAPACITY
+#define ALARM_CAPACITY 64
+#endif
+static const int MAX_ALARMS = ALARM_CAPACITY;
 
-enum AudioType : uint8_t { AUDIO_LOCAL = 0, AUDIO_URL = 1 };
+enum AudioType : uint8_t { AUDIO_LOCAL = 0, AUDIO_URL = 1, AUDIO_SYNTH = 2 };
 
 struct AlarmConfig {
   uint32_t version;
@@ -39,7 +44,45 @@ struct AlarmConfig {
 
   uint32_t last_fired_unix;
 
-  uint8_t reserved[24];
+  uint16_t fade_in_sec;   // gentle wake: ramp from silence, 0 = off
+
+  bool loop_audio;        // repeat the sound without a gap while ringing
+  uint8_t loop_crescendo; // volume points added per pass, 0 = off
+  uint16_t max_ring_sec;  // stop ringing after this long, 0 = no limit
+
+  uint16_t synth_freq_hz; // built-in tone base pitch, 0 = default
+  uint8_t synth_pattern;  // SynthPattern
+
+  // Recurrence beyond days_mask; all zero is the plain weekly schedule.
+  uint8_t repeat_kind;     // RepeatKind
+  uint8_t repeat_interval; // every n weeks/months, 0 = 1
+  uint8_t month_weeks;     // bit0 = 1st .. bit3 = 4th, bit4 = last weekday
+  uint32_t month_days;     // bit d-1 = day d, bit31 = last day of the month
+  uint16_t repeat_start_day; // days since 1970, anchors the interval
+  bool skip_holidays;
+
+  uint8_t reserved[5];
+};
+
+// What loop() reads about every alarm: one compact record per slot, in a
+// contiguous array built from AlarmConfig. The full record (label, URLs,
+// paths, token) stays on flash until a handler or a firing alarm needs it.
+enum AlarmHotFlag : uint8_t { ALARM_HOT_ENABLED = 1, ALARM_HOT_ONCE = 2, ALARM_HOT_URL_AUDIO = 4 };
+
+struct AlarmHot {
+  uint32_t id = 0;
+  uint32_t last_fired_unix = 0;
+  int32_t once_day = 0;       // days since 1970 of once_date, -1 if it is invalid
+  uint16_t long_press_ms = 0;
+  uint16_t max_ring_sec = 0;
+  Recurrence repeat;
+  uint8_t hour = 0;
+  uint8_t minute = 0;
+  uint8_t flags = 0;          // AlarmHotFlag
+  int8_t gpio_pin = 0;
+
+  bool enabled() const { return flags & ALARM_HOT_ENABLED; }
+  bool once() const { return flags & ALARM_HOT_ONCE; }
 };
 
 struct AlarmRuntime {
@@ -48,5 +91,6 @@ struct AlarmRuntime {
   bool snoozed = false;
   time_t snooze_until = 0;
   time_t current_fire_unix = 0;
+  time_t prefetched_for = 0;   // next_fire_unix the URL cache was last refreshed for
 };
 
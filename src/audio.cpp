@@ -1,444 +1,818 @@
 #include "audio.h"
 #include "alarms.h"
+#include "audio_cache.h"
+#include "audio_index.h"
+#include "tone_synth.h"
+
+static const int MIX_REPORT_BLOCK = 256;
+
+// Producer task: below the PDM writer (6) so output always wins, above the
+// Arduino loop and the web server so webhooks and requests cannot starve it.
+static const uint32_t AUDIO_TASK_STACK = 8192;   // TLS reads for URL sources
+static const UBaseType_t AUDIO_TASK_PRIO = 5;
+static const uint32_t AUDIO_NET_POLL_MS = 10;
+static const uint32_t AUDIO_FILL_POLL_MS = 100;
+
+// Start jobs run below the producer; DNS, TCP connect and the TLS handshake
+// happen on this task. A URL step gets URL_BUDGET_MS in total, split over
+// its phases, so a dead server delays the fallback by a known bound. Past
+// connect, the step waits in START_POLL_MS slices and gives up as soon as
+// its job is stopped or replaced.
+static const uint32_t AUDIO_START_STACK = 8192;
+static const UBaseType_t AUDIO_START_PRIO = 3;
+static const uint32_t URL_CONNECT_MS = 4000;
+static const uint32_t URL_HEADERS_MS = 3000;
+static const uint32_t URL_PREBUFFER_MS = 5000;
+static const uint32_t URL_BUDGET_MS = 10000;
+static const uint32_t START_POLL_MS = 50;
+static const uint32_t PRIME_SLACK_MS = 3500;   // MP3 priming, after the prebuffer for a URL
+
+static const char* VOICE_NAMES[AUDIO_VOICE_COUNT] = { "alarm", "chime", "preview" };
+static const char* JOB_STATE_NAMES[] = { "queued", "open", "connect", "headers", "prebuffer", "playing", "failed", "cancelled" };
+static const char* STEP_KIND_NAMES[] = { "local", "url", "synth" };
 
-static const int AUDIO_LEDC_CHANNEL = 0;
-static const int AUDIO_LEDC_RES_BITS = 8;
-static const uint32_t AUDIO_PWM_CARRIER_HZ = 100000;
-
-static const int SR_11025 = 11025;
-static const int SR_16000 = 16000;
-static const int SR_22050 = 22050;
-
-String lastAudioError;
 AudioPlayer audio;
+AudioStats audioStats;
 
-class AudioPlayer::StreamHolder {
-public:
-  StreamHolder(HTTPClient* h, WiFiClient* c) : http(h), client(c) {}
-  ~StreamHolder() { stop(); }
-  void stop() {
-    if (http) { http->end(); delete http; http = nullptr; }
-    if (client) { delete client; client = nullptr; }
-  }
-  HTTPClient* http = nullptr;
-  WiFiClient* client = nullptr;
-};
+const char* audioVoiceName(uint8_t voice) {
+  return voice < AUDIO_VOICE_COUNT ? VOICE_NAMES[voice] : "all";
+}
 
-static void ledcInitCarrier(int pin, int channel, uint32_t freqHz, int resBits) {
-#if defined(ARDUINO_ESP32_MAJOR) && (ARDUINO_ESP32_MAJOR >= 3)
-  ledcAttachChannel(pin, freqHz, resBits, channel);
-#else
-  ledcSetup(channel, freqHz, resBits);
-  ledcAttachPin(pin, channel);
-#endif
+int audioVoiceFromName(const String& name) {
+  for (int i = 0; i < AUDIO_VOICE_COUNT; i++) {
+    if (name == VOICE_NAMES[i] || name == String(i)) return i;
+  }
+  return -1;
 }
 
-static void ledcWriteDuty(int channel, uint32_t duty) {
-  ledcWrite(channel, duty);
+const char* audioJobStateName(uint8_t state) {
+  return state <= AUDIO_JOB_CANCELLED ? JOB_STATE_NAMES[state] : "unknown";
 }
 
-void AudioPlayer::begin(int pwmPin) {
-  audioPin = pwmPin;
-  ledcInitCarrier(audioPin, AUDIO_LEDC_CHANNEL, AUDIO_PWM_CARRIER_HZ, AUDIO_LEDC_RES_BITS);
-  writeDutyMid();
-  setSampleRate(SR_16000);
+const char* audioStepKindName(uint8_t kind) {
+  return kind <= AUDIO_STEP_SYNTH ? STEP_KIND_NAMES[kind] : "unknown";
 }
 
-void AudioPlayer::setSampleRate(int sr) {
-  if (sr != SR_11025 && sr != SR_16000 && sr != SR_22050) sr = SR_16000;
-  sampleRate = sr;
-  if (timer) {
-    esp_timer_stop(timer);
-    esp_timer_start_periodic(timer, 1000000ULL / (uint64_t)sampleRate);
-  }
+bool AudioChain::addLocal(const String& path, const AudioAssetInfo* asset) {
+  if (count >= AUDIO_CHAIN_MAX || path.length() == 0 || path.length() >= sizeof(paths[0])) return false;
+  kinds[count] = AUDIO_STEP_LOCAL;
+  strlcpy(paths[count], path.c_str(), sizeof(paths[0]));
+  assets[count] = asset ? *asset : AudioAssetInfo();
+  count++;
+  return true;
 }
 
-bool AudioPlayer::isPlaying() const { return playing; }
-String AudioPlayer::lastError() const { return lastErr; }
+// One URL per chain; a looping stream goes on to loop loopFallback.
+bool AudioChain::addUrl(const String& u, const String& loopFallback) {
+  if (count >= AUDIO_CHAIN_MAX || url[0] || u.length() == 0 || u.length() >= sizeof(url)) return false;
+  strlcpy(url, u.c_str(), sizeof(url));
+  if (loopFallback.length() < sizeof(loopFallbackPath)) strlcpy(loopFallbackPath, loopFallback.c_str(), sizeof(loopFallbackPath));
+  kinds[count++] = AUDIO_STEP_URL;
+  return true;
+}
 
-void AudioPlayer::stop() {
-  playing = false;
-  if (stream) {
-    stream->stop();
-    delete stream;
-    stream = nullptr;
-  }
-  if (file) file.close();
-  rbReset();
-  writeDutyMid();
+bool AudioChain::addSynth(uint8_t pattern, uint16_t hz) {
+  if (count >= AUDIO_CHAIN_MAX) return false;
+  synthPattern = pattern;
+  synthHz = hz;
+  kinds[count++] = AUDIO_STEP_SYNTH;
+  return true;
 }
 
-bool AudioPlayer::playLocal(const String& path, uint8_t vol) {
+void AudioPlayer::begin(int pwmPin, AudioSinkKind kind) {
   stop();
-  volume = vol;
-
-  String p = path;
-  if (!p.startsWith("/")) p = "/" + p;
-  File f = LittleFS.open(p, "r");
-  if (!f) { lastErr = "file_not_found"; return false; }
-  file = f;
-
-  String lp = p; lp.toLowerCase();
-  if (lp.endsWith(".wav")) {
-    if (!wavReadHeaderFromFile()) { file.close(); return false; }
-    startTimer();
-    playing = true;
-    sourceKind = "wav_file";
-    return true;
+  releaseSink();
+  audioPin = pwmPin;
+
+  if (kind == AUDIO_SINK_PDM) {
+    AudioSink* pdm = new PdmSink(audioPin);
+    if (pdm->begin(AUDIO_OUTPUT_RATE, &AudioPlayer::pullThunk, this)) sink = pdm;
+    else delete pdm;
   }
+  if (!sink) {
+    AudioSink* ledc = new LedcSink(audioPin);
+    if (ledc->begin(AUDIO_OUTPUT_RATE, &AudioPlayer::pullThunk, this)) sink = ledc;
+    else delete ledc;
+  }
+  ownsSink = (sink != nullptr);
+  startTask();
+  startStarterTask();
+}
 
-  if (lp.endsWith(".mp3")) {
-    // Stub decoder
-    mp3dec = {};
-    mp3InFilled = 0;
-    startTimer();
-    playing = true;
-    sourceKind = "mp3_file";
-    return true;
+void AudioPlayer::startTask() {
+  if (task) return;
+  cmdQueue = xQueueCreate(AUDIO_CMD_QUEUE_LEN, sizeof(AudioCmd));
+  cmdLock = xSemaphoreCreateMutex();
+  cmdDone = xSemaphoreCreateBinary();
+  if (!cmdQueue || !cmdLock || !cmdDone) return;
+  if (xTaskCreate(&AudioPlayer::taskThunk, "audio_fill", AUDIO_TASK_STACK, this, AUDIO_TASK_PRIO, &task) != pdPASS) {
+    task = nullptr;
   }
+}
 
-  file.close();
-  lastErr = "unsupported_ext";
-  return false;
+uint32_t AudioPlayer::taskStackFree() const {
+  return task ? (uint32_t)uxTaskGetStackHighWaterMark(task) : 0;
 }
 
-bool AudioPlayer::playUrl(const String& url, uint8_t vol) {
-  stop();
-  volume = vol;
-
-  HTTPClient* http = new HTTPClient();
-  WiFiClient* cli = nullptr;
-  WiFiClientSecure* scli = nullptr;
-
-  bool secure = url.startsWith("https://") || url.startsWith("HTTPS://");
-  if (secure) {
-    scli = new WiFiClientSecure();
-    scli->setInsecure();
-    if (!http->begin(*scli, url)) {
-      delete http; delete scli;
-      lastErr = "http_begin_failed";
-      return false;
-    }
-  } else {
-    cli = new WiFiClient();
-    if (!http->begin(*cli, url)) {
-      delete http; delete cli;
-      lastErr = "http_begin_failed";
-      return false;
+void AudioPlayer::taskThunk(void* arg) { static_cast<AudioPlayer*>(arg)->taskLoop(); }
+
+// Sleeps until the sink reports the ring below half, a command arrives, or
+// (while streaming or starting) it is time to drain the socket or take the
+// next priming step.
+void AudioPlayer::taskLoop() {
+  for (;;) {
+    bool streaming = false;
+    for (const AudioVoice& v : voices) streaming |= v.streaming() || v.starting();
+    TickType_t wait = (!playing && !streaming) ? portMAX_DELAY
+                                               : pdMS_TO_TICKS(streaming ? AUDIO_NET_POLL_MS : AUDIO_FILL_POLL_MS);
+    ulTaskNotifyTake(pdTRUE, wait);
+
+    AudioCmd cmd;
+    while (xQueueReceive(cmdQueue, &cmd, 0) == pdTRUE) {
+      cmdResult = execute(cmd);
+      xSemaphoreGive(cmdDone);
     }
+    produce();
   }
+}
 
-  int code = http->GET();
-  if (code <= 0) {
-    http->end();
-    delete http; if (scli) delete scli; if (cli) delete cli;
-    lastErr = "http_get_failed";
-    return false;
-  }
-  if (code != 200) {
-    http->end();
-    delete http; if (scli) delete scli; if (cli) delete cli;
-    lastErr = "http_status_" + String(code);
-    return false;
+bool AudioPlayer::execute(const AudioCmd& cmd) {
+  switch (cmd.type) {
+    case AUDIO_CMD_PLAY_LOCAL:
+    case AUDIO_CMD_PLAY_STREAM:
+    case AUDIO_CMD_PLAY_SYNTH:
+      // Checked here, in order with stop commands, so a job cancelled by
+      // dismiss can never start its next fallback afterwards.
+      if (cmd.jobId && !jobCurrent(cmd.voice, cmd.jobId)) {
+        delete cmd.stream;
+        lastErr = "cancelled";
+        return false;
+      }
+      return startVoice(cmd);
+    case AUDIO_CMD_STOP: stopVoices(cmd.voice); return true;
   }
+  return false;
+}
 
-  stream = new StreamHolder(http, secure ? (WiFiClient*)scli : cli);
-  if (!stream || !stream->client) {
-    stop();
-    lastErr = "http_no_stream";
-    return false;
-  }
+// Hands a command to the producer task and waits for its result, so all
+// player state is only ever touched from that task.
+bool AudioPlayer::submit(const AudioCmd& cmd) {
+  if (!task) return execute(cmd);
+  xSemaphoreTake(cmdLock, portMAX_DELAY);
+  xQueueSend(cmdQueue, &cmd, portMAX_DELAY);
+  xTaskNotifyGive(task);
+  xSemaphoreTake(cmdDone, portMAX_DELAY);
+  bool ok = cmdResult;
+  xSemaphoreGive(cmdLock);
+  return ok;
+}
 
-  String u = url; u.toLowerCase();
-  if (u.indexOf(".wav") > 0) {
-    if (!wavReadHeaderFromStream()) { stop(); return false; }
-    startTimer();
-    playing = true;
-    sourceKind = "wav_url";
-    return true;
-  }
-  if (u.indexOf(".mp3") > 0) {
-    mp3dec = {};
-    mp3InFilled = 0;
-    startTimer();
-    playing = true;
-    sourceKind = "mp3_url";
-    return true;
-  }
+static bool fillCmdTarget(AudioCmd& cmd, const String& target) {
+  if (target.length() >= sizeof(cmd.target)) return false;
+  strlcpy(cmd.target, target.c_str(), sizeof(cmd.target));
+  return true;
+}
 
-  if (wavReadHeaderFromStream()) {
-    startTimer();
-    playing = true;
-    sourceKind = "wav_url_guess";
-    return true;
+void AudioPlayer::stop(uint8_t voice) {
+  if (jobLock) xSemaphoreTake(jobLock, portMAX_DELAY);
+  for (uint8_t i = 0; i < AUDIO_VOICE_COUNT; i++) {
+    if (voice != AUDIO_VOICE_ALL && voice != i) continue;
+    if (queuedJob[i]) {
+      AudioJobStatus* j = jobSlot(queuedJob[i]);
+      if (j) j->state = AUDIO_JOB_CANCELLED;
+      queuedJob[i] = 0;
+    }
+    currentJob[i] = 0;
   }
+  if (jobLock) xSemaphoreGive(jobLock);
+  // A step waiting on its job notices at once instead of at its next poll.
+  if (starter) xTaskNotifyGive(starter);
+
+  AudioCmd cmd {};
+  cmd.type = AUDIO_CMD_STOP;
+  cmd.voice = voice;
+  submit(cmd);
+}
 
-  lastErr = "unknown_url_format";
-  stop();
-  return false;
+bool AudioPlayer::playLocal(const String& path, uint8_t vol, uint16_t fadeInSec, uint8_t voice,
+                            const AudioLoop& loop) {
+  if (voice >= AUDIO_VOICE_COUNT) { lastErr = "bad_voice"; return false; }
+  AudioCmd cmd {};
+  cmd.type = AUDIO_CMD_PLAY_LOCAL;
+  cmd.voice = voice;
+  cmd.volume = vol;
+  cmd.fadeInSec = fadeInSec;
+  cmd.submittedMs = millis();
+  cmd.loop = loop;
+  if (!fillCmdTarget(cmd, path)) { lastErr = "path_too_long"; return false; }
+  return submit(cmd);
 }
 
-void AudioPlayer::loop() {
-  if (!playing) return;
+bool AudioPlayer::playSynth(uint8_t pattern, uint16_t baseHz, uint8_t vol, uint16_t fadeInSec, uint8_t voice,
+                            const AudioLoop& loop) {
+  if (voice >= AUDIO_VOICE_COUNT) { lastErr = "bad_voice"; return false; }
+  AudioCmd cmd {};
+  cmd.type = AUDIO_CMD_PLAY_SYNTH;
+  cmd.voice = voice;
+  cmd.volume = vol;
+  cmd.fadeInSec = fadeInSec;
+  cmd.submittedMs = millis();
+  cmd.synthPattern = pattern;
+  cmd.synthHz = baseHz;
+  cmd.loop = loop;
+  return submit(cmd);
+}
 
-  while (rbCount < (RB_CAP / 2)) {
-    if (sourceKind.startsWith("wav")) {
-      if (!fillWav()) break;
-    } else if (sourceKind.startsWith("mp3")) {
-      if (!fillMp3()) break;
-    } else {
-      lastErr = "internal_source_unknown";
-      stop();
-      break;
-    }
-  }
+void AudioPlayer::setSink(AudioSink* s) {
+  stop();
+  releaseSink();
+  if (s && s->begin(AUDIO_OUTPUT_RATE, &AudioPlayer::pullThunk, this)) sink = s;
+  ownsSink = false;
+}
 
-  if (inputEnded && rbCount == 0) stop();
+void AudioPlayer::releaseSink() {
+  if (!sink) return;
+  sink->end();
+  if (ownsSink) delete sink;
+  sink = nullptr;
+  ownsSink = false;
 }
 
-void AudioPlayer::startTimer() {
-  inputEnded = false;
-  if (!timer) {
-    esp_timer_create_args_t args {};
-    args.callback = &AudioPlayer::timerThunk;
-    args.arg = this;
-    args.dispatch_method = ESP_TIMER_TASK;
-    args.name = "audio";
-    esp_timer_create(&args, &timer);
-  }
-  esp_timer_start_periodic(timer, 1000000ULL / (uint64_t)sampleRate);
+const char* AudioPlayer::sinkName() const { return sink ? sink->name() : "none"; }
+
+bool AudioPlayer::isPlaying() const { return playing; }
+bool AudioPlayer::isPlaying(uint8_t voice) const { return voice < AUDIO_VOICE_COUNT && voices[voice].active(); }
+String AudioPlayer::lastError() const { return lastErr; }
+
+uint32_t AudioPlayer::decodeCyclesPerSecond() const { return voices[AUDIO_VOICE_ALARM].decodeCyclesPerSecond(); }
+uint32_t AudioPlayer::resampleCyclesPerBlock() const { return voices[AUDIO_VOICE_ALARM].resampleCyclesPerBlock(); }
+
+// Summing cost per 256 output samples while two or more voices overlap.
+uint32_t AudioPlayer::mixCyclesPerBlock() const {
+  if (mixSamples == 0) return 0;
+  return (uint32_t)((mixCycles * MIX_REPORT_BLOCK) / mixSamples);
 }
 
-void AudioPlayer::writeDutyMid() {
-  int maxDuty = (1 << AUDIO_LEDC_RES_BITS) - 1;
-  ledcWriteDuty(AUDIO_LEDC_CHANNEL, maxDuty / 2);
+void AudioPlayer::setNormalize(bool on) {
+  normalize = on;
 }
 
-void AudioPlayer::timerThunk(void* arg) { static_cast<AudioPlayer*>(arg)->onTick(); }
+void AudioPlayer::setNetWatermarks(uint32_t startBytes, uint32_t lowBytes) {
+  netStartBytes = min(max(startBytes, (uint32_t)1024), AUDIO_NET_BUFFER_BYTES);
+  netLowBytes = min(lowBytes, netStartBytes / 2);
+}
 
-void AudioPlayer::onTick() {
-  if (!playing) { writeDutyMid(); return; }
+uint32_t AudioPlayer::netBuffered() const {
+  uint32_t total = 0;
+  for (const AudioVoice& v : voices) total += v.netBuffered();
+  return total;
+}
 
-  int16_t s = 0;
-  if (rbPop(s)) {
-    int32_t v = (int32_t)s;
-    v = (v * (int32_t)volume) / 100;
+uint32_t AudioPlayer::underrunCount() const { return underruns; }
+uint32_t AudioPlayer::underrunMs() const {
+  return (uint32_t)(((uint64_t)underrunSamples * 1000) / AUDIO_OUTPUT_RATE);
+}
 
-    int maxDuty = (1 << AUDIO_LEDC_RES_BITS) - 1;
-    int32_t u = v + 32768;
-    if (u < 0) u = 0;
-    if (u > 65535) u = 65535;
+AudioVoiceStatus AudioPlayer::voiceStatus(uint8_t voice) const {
+  AudioVoiceStatus st;
+  if (voice >= AUDIO_VOICE_COUNT) return st;
+  const AudioVoice& v = voices[voice];
+  st.active = v.active();
+  if (!st.active) return st;
+  st.looping = v.loopSettings().enabled;
+  st.loops = v.loopCount();
+  st.kind = v.kind();
+  st.target = v.target();
+  st.title = v.streamTitle();
+  st.volume = v.volume();
+  st.playedMs = v.playedMs();
+  return st;
+}
 
-    int duty = (int)(u >> (16 - AUDIO_LEDC_RES_BITS));
-    if (duty < 0) duty = 0;
-    if (duty > maxDuty) duty = maxDuty;
-    ledcWriteDuty(AUDIO_LEDC_CHANNEL, (uint32_t)duty);
+bool AudioPlayer::startVoice(const AudioCmd& cmd) {
+  AudioVoice& v = voices[cmd.voice];
+  String target(cmd.target);
+  if (v.starting()) reportStart(cmd.voice, false, "replaced");
+  bool ok = true;
+  if (cmd.type == AUDIO_CMD_PLAY_SYNTH) ok = v.startSynth(cmd.synthPattern, cmd.synthHz, cmd.volume, cmd.fadeInSec);
+  else if (cmd.type == AUDIO_CMD_PLAY_STREAM) {
+    v.startStream(cmd.stream, target, cmd.volume, cmd.fadeInSec, netStartBytes, netLowBytes, cmd.prebufferMs);
   } else {
-    writeDutyMid();
+    AudioAssetInfo asset = cmd.asset;
+    if (!normalize) asset.normGain = 0;
+    bool known = asset.format != AUDIO_ASSET_UNKNOWN;
+    ok = v.startLocal(target, cmd.volume, cmd.fadeInSec, known ? &asset : nullptr);
+  }
+  if (!ok) {
+    lastErr = v.lastError();
+    v.stop();
+    return false;
   }
+  v.setLoop(cmd.loop);
+  loopFallbacks[cmd.voice] = (cmd.type == AUDIO_CMD_PLAY_STREAM) ? String(cmd.loopFallbackPath) : String();
+  firstSamplePendingMs[cmd.voice] = cmd.submittedMs;
+  firstSamplePending[cmd.voice] = true;
+  startJob[cmd.voice] = cmd.jobId;
+  // A stream or MP3 joins the mix once pollStarts() sees it prebuffered
+  // and primed.
+  if (v.starting()) return true;
+  reportStart(cmd.voice, true, "");
+  audioStats.starts++;
+  if (!playing) startOutput();
+  return true;
 }
 
-void AudioPlayer::rbReset() { rbHead = rbTail = rbCount = 0; }
+void AudioPlayer::pollStarts() {
+  for (uint8_t i = 0; i < AUDIO_VOICE_COUNT; i++) {
+    AudioVoice& v = voices[i];
+    if (!v.starting()) continue;
+    int r = v.pollStart();
+    if (r == 0) continue;
+    if (r < 0) { lastErr = v.lastError(); reportStart(i, false, lastErr); continue; }
+    audioStats.starts++;
+    reportStart(i, true, "");
+    if (!playing) startOutput();
+  }
+}
 
-bool AudioPlayer::rbPush(int16_t s) {
-  if (rbCount >= RB_CAP) return false;
-  rb[rbHead] = s;
-  rbHead = (rbHead + 1) % RB_CAP;
-  rbCount++;
-  return true;
+// Hands a start's outcome to the start task if it is still waiting for it.
+void AudioPlayer::reportStart(uint8_t voice, bool ok, const String& err) {
+  uint32_t id = startJob[voice];
+  startJob[voice] = 0;
+  if (id == 0 || id != verdictJob) return;
+  strlcpy(verdictErr, err.c_str(), sizeof(verdictErr));
+  verdict = ok ? 1 : -1;
+  if (starter) xTaskNotifyGive(starter);
 }
 
-bool AudioPlayer::rbPop(int16_t& s) {
-  if (rbCount <= 0) return false;
-  s = rb[rbTail];
-  rbTail = (rbTail + 1) % RB_CAP;
-  rbCount--;
+// A stream cannot be rewound, and requesting the URL again would put the
+// network back on the critical path. Once the stream ends, a looping URL
+// voice therefore goes on with its fallback file (fallback_local_path or the
+// default sound), which then loops by seeking. That is a different sound
+// from the stream; URL alarms with a prefetched copy never get here, as the
+// copy is played instead of the URL.
+bool AudioPlayer::continueLoop(uint8_t voice) {
+  AudioVoice& v = voices[voice];
+  AudioLoop loop = v.loopSettings();
+  if (!v.streaming() || !loop.enabled || loopFallbacks[voice].length() == 0) return false;
+  if (loop.maxMs) {
+    uint32_t done = v.playedMs();
+    if (done >= loop.maxMs) return false;
+    loop.maxMs -= done;
+  }
+  uint8_t vol = (uint8_t)min(100, v.volume() + loop.crescendo);
+  String path = loopFallbacks[voice];
+  loopFallbacks[voice] = String();
+  AudioAssetInfo asset;
+  bool known = audioIndex.lookup(path, asset);
+  if (!normalize) asset.normGain = 0;
+  if (!v.startLocal(path, vol, 0, known ? &asset : nullptr)) return false;
+  v.setLoop(loop);
   return true;
 }
 
-bool AudioPlayer::readBytes(File& f, uint8_t* buf, size_t n) {
-  size_t r = f.read(buf, n);
-  return r == n;
+void AudioPlayer::stopVoices(uint8_t voice) {
+  bool any = false;
+  for (int i = 0; i < AUDIO_VOICE_COUNT; i++) {
+    if (voice != AUDIO_VOICE_ALL && voice != i) continue;
+    if (voices[i].starting()) reportStart((uint8_t)i, false, "cancelled");
+    voices[i].stop();
+  }
+  for (const AudioVoice& v : voices) any |= v.active();
+  if (!any) stopOutput();
 }
 
-bool AudioPlayer::readBytesStream(WiFiClient& s, uint8_t* buf, size_t n, uint32_t timeoutMs) {
-  uint32_t start = millis();
-  size_t got = 0;
-  while (got < n && (millis() - start) < timeoutMs) {
-    int av = s.available();
-    if (av > 0) {
-      int r = s.read(buf + got, (int)(n - got));
-      if (r > 0) got += (size_t)r;
-    } else {
-      if (!s.connected()) break;
-      delay(1);
-    }
+// Fills the ring before the sink starts, so playback does not begin with an underrun.
+void AudioPlayer::startOutput() {
+  rb.reset();
+  underruns = underrunSamples = 0;
+  starved = false;
+  sourcesEnded = false;
+  lastPullUs = 0;   // the sink is parked, so this is the only writer now
+  playing = true;
+  mix();
+  if (sink) sink->start();
+}
+
+void AudioPlayer::stopOutput() {
+  playing = false;
+  if (sink) sink->stop();
+  rb.reset();
+}
+
+// Without a producer task (creation failed) the caller's loop drives playback.
+void AudioPlayer::loop() {
+  if (!task) produce();
+}
+
+void AudioPlayer::produce() {
+  pollStarts();
+  if (!playing) return;
+  bool any = false;
+  for (AudioVoice& v : voices) if (v.active()) v.pump();
+  mix();
+  for (uint8_t i = 0; i < AUDIO_VOICE_COUNT; i++) {
+    AudioVoice& v = voices[i];
+    if (v.finished() && !continueLoop(i)) v.stop();
+    any |= v.active();
   }
-  return got == n;
+  sourcesEnded = !any;
+  if (!any && rb.empty()) stopOutput();
 }
 
-uint32_t AudioPlayer::readLE32(const uint8_t* b) {
-  return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+void AudioPlayer::noteFirstSample(uint8_t voice) {
+  if (!firstSamplePending[voice]) return;
+  firstSamplePending[voice] = false;
+  uint32_t ms = millis() - firstSamplePendingMs[voice];
+  audioStats.firstSampleLastMs = ms;
+  audioStats.firstSampleMs.add(ms);
 }
-uint16_t AudioPlayer::readLE16(const uint8_t* b) {
-  return (uint16_t)b[0] | ((uint16_t)b[1] << 8);
+
+static inline int16_t sat16(int32_t x) {
+  return (int16_t)(x > 32767 ? 32767 : (x < -32768 ? -32768 : x));
 }
 
-bool AudioPlayer::wavParseHeader(uint8_t header[44]) {
-  if (memcmp(header, "RIFF", 4) != 0) { lastErr = "wav_not_riff"; return false; }
-  if (memcmp(header + 8, "WAVE", 4) != 0) { lastErr = "wav_not_wave"; return false; }
-  if (memcmp(header + 12, "fmt ", 4) != 0) { lastErr = "wav_no_fmt"; return false; }
+// Sums the active voices into the ring a block at a time. A lone voice
+// decodes straight into the ring. A starved voice (URL rebuffering) only
+// contributes silence for the rest of the block, so it cannot stall others.
+void AudioPlayer::mix() {
+  while (rb.size() < (RB_CAP / 2)) {
+    int16_t* dst;
+    size_t n = min(rb.writeSpan(&dst), (size_t)MIX_BLOCK);
+    if (n == 0) break;
+
+    int only = -1;
+    int count = 0;
+    for (int i = 0; i < AUDIO_VOICE_COUNT; i++) {
+      if (voices[i].active()) { only = i; count++; }
+    }
+    if (count == 0) break;
 
-  uint16_t audioFmt = readLE16(header + 20);
-  wavChannels = readLE16(header + 22);
-  wavSampleRate = readLE32(header + 24);
-  wavBits = readLE16(header + 34);
+    size_t m = 0;
+    if (count == 1) {
+      m = voices[only].read(dst, n);
+      if (m) noteFirstSample((uint8_t)only);
+    } else {
+      int32_t acc[MIX_BLOCK];
+      int16_t tmp[MIX_BLOCK];
+      memset(acc, 0, n * sizeof(int32_t));
+      uint32_t cycles = 0;
+      for (uint8_t vi = 0; vi < AUDIO_VOICE_COUNT; vi++) {
+        AudioVoice& v = voices[vi];
+        if (!v.active()) continue;
+        size_t k = v.read(tmp, n);
+        if (k) noteFirstSample(vi);
+        uint32_t c0 = ESP.getCycleCount();
+        for (size_t i = 0; i < k; i++) acc[i] += tmp[i];
+        cycles += ESP.getCycleCount() - c0;
+        if (k > m) m = k;
+      }
+      uint32_t c0 = ESP.getCycleCount();
+      for (size_t i = 0; i < m; i++) dst[i] = sat16(acc[i]);
+      mixCycles += cycles + (ESP.getCycleCount() - c0);
+      mixSamples += m;
+    }
+    if (m == 0) break;
+    rb.commitWrite(m);
+  }
+}
 
-  if (audioFmt != 1) { lastErr = "wav_not_pcm"; return false; }
-  if (wavBits != 16) { lastErr = "wav_bits_not_16"; return false; }
-  if (wavChannels < 1 || wavChannels > 2) { lastErr = "wav_channels_bad"; return false; }
+size_t AudioPlayer::pullThunk(void* ctx, int16_t* dst, size_t n) {
+  return static_cast<AudioPlayer*>(ctx)->pullSamples(dst, n);
+}
 
-  if (memcmp(header + 36, "data", 4) != 0) { lastErr = "wav_no_data"; return false; }
-  uint32_t dataSize = readLE32(header + 40);
-  wavDataRemaining = dataSize;
+// Runs in the sink's context: samples are already gained, so this only copies.
+size_t AudioPlayer::pullSamples(int16_t* dst, size_t n) {
+  if (!playing) { memset(dst, 0, n * sizeof(int16_t)); return 0; }
 
-  if (wavSampleRate == (uint32_t)SR_11025 || wavSampleRate == (uint32_t)SR_16000 || wavSampleRate == (uint32_t)SR_22050) {
-    setSampleRate((int)wavSampleRate);
+  uint32_t now = micros();
+  if (lastPullUs) {
+    uint32_t expect = (uint32_t)(((uint64_t)n * 1000000) / AUDIO_OUTPUT_RATE);
+    uint32_t took = now - lastPullUs;
+    audioStats.pullJitterUs.add(took > expect ? took - expect : expect - took);
+  }
+  lastPullUs = now;
+  uint32_t fill = rb.size();
+  audioStats.pulls++;
+  audioStats.ringFillLast = fill;
+  audioStats.ringFill[(fill * 8) / RB_CAP]++;
+
+  size_t got = rb.read(dst, n);
+  if (got < n) {
+    memset(dst + got, 0, (n - got) * sizeof(int16_t));
+    if (!sourcesEnded) {
+      if (!starved) { underruns++; audioStats.underrunEvents++; }
+      starved = true;
+      underrunSamples += (uint32_t)(n - got);
+      audioStats.underrunSamples += (uint32_t)(n - got);
+    }
   } else {
-    setSampleRate(SR_16000);
+    starved = false;
   }
+  if (task && rb.size() < RB_CAP / 2) xTaskNotifyGive(task);
+  return got;
+}
 
-  wavOk = true;
-  return true;
+void AudioPlayer::startStarterTask() {
+  if (starter) return;
+  if (!jobLock) jobLock = xSemaphoreCreateMutex();
+  if (!jobLock) return;
+  if (xTaskCreate(&AudioPlayer::starterThunk, "audio_start", AUDIO_START_STACK, this, AUDIO_START_PRIO, &starter) != pdPASS) {
+    starter = nullptr;
+  }
 }
 
-bool AudioPlayer::wavReadHeaderFromFile() {
-  uint8_t h[44];
-  if (!readBytes(file, h, 44)) { lastErr = "wav_header_read_fail"; return false; }
-  return wavParseHeader(h);
+void AudioPlayer::starterThunk(void* arg) { static_cast<AudioPlayer*>(arg)->starterLoop(); }
+
+void AudioPlayer::starterLoop() {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    drainJobs();
+  }
 }
 
-bool AudioPlayer::wavReadHeaderFromStream() {
-  if (!stream || !stream->client) { lastErr = "wav_stream_null"; return false; }
-  uint8_t h[44];
-  if (!readBytesStream(*stream->client, h, 44)) { lastErr = "wav_header_read_fail"; return false; }
-  return wavParseHeader(h);
+uint32_t AudioPlayer::startChain(const AudioChain& chain) {
+  if (chain.count == 0 || chain.voice >= AUDIO_VOICE_COUNT || !jobLock) return 0;
+  uint8_t v = chain.voice;
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  uint32_t id = nextJobId++;
+  if (queuedJob[v]) {
+    AudioJobStatus* old = jobSlot(queuedJob[v]);
+    if (old) old->state = AUDIO_JOB_CANCELLED;
+  }
+  chains[v] = chain;
+  currentJob[v] = queuedJob[v] = id;
+  AudioJobStatus& j = jobs[id % AUDIO_JOB_HISTORY];
+  j = AudioJobStatus();
+  j.id = id;
+  j.voice = v;
+  j.submittedMs = millis();
+  xSemaphoreGive(jobLock);
+
+  // Without the start task the chain runs on the caller, blocking as before.
+  if (starter) xTaskNotifyGive(starter);
+  else drainJobs();
+  return id;
 }
 
-bool AudioPlayer::fillWav() {
-  if (!wavOk) { lastErr = "wav_not_ready"; stop(); return false; }
-  if (wavDataRemaining == 0) { inputEnded = true; return false; }
+AudioJobStatus* AudioPlayer::jobSlot(uint32_t id) {
+  AudioJobStatus& j = jobs[id % AUDIO_JOB_HISTORY];
+  return (id && j.id == id) ? &j : nullptr;
+}
 
-  const int chunkFrames = 256;
-  uint8_t raw[chunkFrames * 4];
+bool AudioPlayer::jobCurrent(uint8_t voice, uint32_t id) const {
+  return voice < AUDIO_VOICE_COUNT && currentJob[voice] == id;
+}
 
-  int bytesPerFrame = wavChannels * 2;
-  uint32_t wantBytes = (uint32_t)chunkFrames * (uint32_t)bytesPerFrame;
-  if (wantBytes > wavDataRemaining) wantBytes = wavDataRemaining;
+void AudioPlayer::setJobState(uint32_t id, uint8_t state) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  AudioJobStatus* j = jobSlot(id);
+  if (j) j->state = state;
+  xSemaphoreGive(jobLock);
+}
 
-  size_t got = 0;
-  if (file) {
-    got = file.read(raw, wantBytes);
-  } else if (stream && stream->client) {
-    WiFiClient& s = *stream->client;
-    int av = s.available();
-    if (av <= 0) {
-      if (!s.connected()) { inputEnded = true; return false; }
-      delay(1);
-      return true;
-    }
-    got = (size_t)s.read(raw, min((int)wantBytes, av));
-  }
+bool AudioPlayer::jobStatus(uint32_t id, AudioJobStatus& out) const {
+  if (!jobLock) return false;
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  const AudioJobStatus& j = jobs[id % AUDIO_JOB_HISTORY];
+  bool found = id && j.id == id;
+  if (found) out = j;
+  xSemaphoreGive(jobLock);
+  if (found && !out.settled()) out.elapsedMs = millis() - out.submittedMs;
+  return found;
+}
 
-  if (got == 0) {
-    if (stream && stream->client && !stream->client->connected()) inputEnded = true;
-    return false;
+size_t AudioPlayer::recentJobs(AudioJobStatus* out, size_t max) const {
+  size_t n = 0;
+  for (uint32_t id = nextJobId - 1; id > 0 && n < max && n < (size_t)AUDIO_JOB_HISTORY; id--) {
+    if (jobStatus(id, out[n])) n++;
   }
+  return n;
+}
 
-  wavDataRemaining -= (uint32_t)got;
+String AudioPlayer::lastStartError() const {
+  if (!jobLock) return String();
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  String e(startErr);
+  xSemaphoreGive(jobLock);
+  return e;
+}
 
-  int frames = (int)(got / bytesPerFrame);
-  for (int i = 0; i < frames; i++) {
-    int16_t l = (int16_t)(raw[i * bytesPerFrame + 0] | (raw[i * bytesPerFrame + 1] << 8));
-    int16_t s = l;
-    if (wavChannels == 2) {
-      int16_t r = (int16_t)(raw[i * bytesPerFrame + 2] | (raw[i * bytesPerFrame + 3] << 8));
-      s = (int16_t)(((int32_t)l + (int32_t)r) / 2);
+// Takes the newest queued chain of each voice in turn.
+void AudioPlayer::drainJobs() {
+  for (;;) {
+    uint32_t id = 0;
+    xSemaphoreTake(jobLock, portMAX_DELAY);
+    for (uint8_t v = 0; v < AUDIO_VOICE_COUNT && !id; v++) {
+      if (!queuedJob[v]) continue;
+      id = queuedJob[v];
+      queuedJob[v] = 0;
+      running = chains[v];
     }
-    if (!rbPush(s)) break;
+    xSemaphoreGive(jobLock);
+    if (!id) return;
+    runChain(id);
   }
-  return true;
 }
 
-bool AudioPlayer::fillMp3() {
-  // Stub decoder
-  if (mp3InFilled < 1024) {
-    int r = 0;
-    if (file) {
-      r = file.read(mp3In + mp3InFilled, sizeof(mp3In) - mp3InFilled);
-    } else if (stream && stream->client) {
-      WiFiClient& s = *stream->client;
-      int av = s.available();
-      if (av > 0) r = s.read(mp3In + mp3InFilled, min((int)sizeof(mp3In) - mp3InFilled, av));
-      else {
-        if (!s.connected()) inputEnded = true;
-        delay(1);
-        return true;
-      }
+void AudioPlayer::runChain(uint32_t id) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  startErr[0] = 0;
+  xSemaphoreGive(jobLock);
+
+  bool ok = false;
+  int i = 0;
+  for (; i < running.count && !ok; i++) {
+    if (!jobCurrent(running.voice, id)) break;
+    xSemaphoreTake(jobLock, portMAX_DELAY);
+    AudioJobStatus* j = jobSlot(id);
+    if (j) { j->steps = (uint8_t)(i + 1); j->log[i].kind = running.kinds[i]; }
+    xSemaphoreGive(jobLock);
+
+    uint32_t t0 = millis();
+    String err;
+    ok = runStep(id, i, err);
+
+    xSemaphoreTake(jobLock, portMAX_DELAY);
+    j = jobSlot(id);
+    if (j) {
+      j->log[i].ok = ok;
+      j->log[i].ms = millis() - t0;
+      strlcpy(j->log[i].error, err.c_str(), sizeof(j->log[i].error));
+      if (!ok) strlcpy(j->error, err.c_str(), sizeof(j->error));
     }
-    if (r > 0) mp3InFilled += r;
-    else inputEnded = true;
+    if (!ok) strlcpy(startErr, err.c_str(), sizeof(startErr));
+    xSemaphoreGive(jobLock);
   }
 
-  if (mp3InFilled == 0) { inputEnded = true; return false; }
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  AudioJobStatus* j = jobSlot(id);
+  if (j) {
+    if (ok) {
+      uint8_t k = running.kinds[i - 1];
+      const char* src = (k == AUDIO_STEP_URL) ? running.url
+                      : (k == AUDIO_STEP_SYNTH) ? synthPatternName(running.synthPattern) : running.paths[i - 1];
+      strlcpy(j->source, src, sizeof(j->source));
+    }
+    j->state = ok ? AUDIO_JOB_PLAYING : jobCurrent(running.voice, id) ? AUDIO_JOB_FAILED : AUDIO_JOB_CANCELLED;
+    j->elapsedMs = millis() - j->submittedMs;
+  }
+  xSemaphoreGive(jobLock);
+  if (jobHook) jobHook();
+}
+
+bool AudioPlayer::runStep(uint32_t id, int step, String& err) {
+  const AudioChain& c = running;
+  uint8_t kind = c.kinds[step];
+  if (kind == AUDIO_STEP_URL) return runUrlStep(id, millis() + URL_BUDGET_MS, err);
+
+  setJobState(id, AUDIO_JOB_OPEN);
+  AudioCmd cmd {};
+  cmd.type = (kind == AUDIO_STEP_SYNTH) ? AUDIO_CMD_PLAY_SYNTH : AUDIO_CMD_PLAY_LOCAL;
+  cmd.voice = c.voice;
+  cmd.volume = c.volume;
+  cmd.fadeInSec = c.fadeInSec;
+  cmd.submittedMs = millis();
+  cmd.jobId = id;
+  cmd.synthPattern = c.synthPattern;
+  cmd.synthHz = c.synthHz;
+  cmd.loop = c.loop;
+  if (kind == AUDIO_STEP_LOCAL) {
+    strlcpy(cmd.target, c.paths[step], sizeof(cmd.target));
+    cmd.asset = c.assets[step];
+  }
+  return awaitStart(id, cmd, PRIME_SLACK_MS, err);
+}
 
-  mp3dec_frame_info_t info {};
-  info.frame_bytes = 0;
-  info.channels = 0;
-  info.hz = 0;
-  info.layer = 0;
-  info.bitrate_kbps = 0;
+// connect -> headers on this task, then the producer prebuffers the stream
+// and reports back through reportStart().
+bool AudioPlayer::runUrlStep(uint32_t id, uint32_t deadlineMs, String& err) {
+  const AudioChain& c = running;
+  auto left = [&](uint32_t cap) -> uint32_t {
+    int32_t rest = (int32_t)(deadlineMs - millis());
+    return rest <= 0 ? 0 : min(cap, (uint32_t)rest);
+  };
 
-  if (inputEnded) return false;
-  delay(1);
-  return true;
+  // DNS, TCP and TLS are one call in the client library, so connect is the
+  // one phase that cannot be cut short; it is bounded by URL_CONNECT_MS.
+  setJobState(id, AUDIO_JOB_CONNECT);
+  AudioHttpStream* s = new AudioHttpStream();
+  if (!s->connect(String(c.url), left(URL_CONNECT_MS))) { delete s; err = "connect_failed"; return false; }
+
+  uint32_t t = left(URL_HEADERS_MS);
+  if (t == 0 || !jobCurrent(c.voice, id)) { delete s; err = t ? "cancelled" : "url_timeout"; return false; }
+  setJobState(id, AUDIO_JOB_HEADERS);
+  if (!s->sendRequest()) { delete s; err = "http_get_failed"; return false; }
+  uint32_t waitFrom = millis();
+  int code;
+  while ((code = s->pollResponse()) == 0) {
+    if (!jobCurrent(c.voice, id)) { delete s; err = "cancelled"; return false; }
+    if (millis() - waitFrom >= t) { delete s; err = "url_timeout"; return false; }
+    startWait();
+  }
+  if (code < 0) { delete s; err = "http_get_failed"; return false; }
+  if (code != 200) { delete s; err = "http_status_" + String(code); return false; }
+
+  t = left(URL_PREBUFFER_MS);
+  if (t == 0 || !jobCurrent(c.voice, id)) { delete s; err = t ? "cancelled" : "url_timeout"; return false; }
+  setJobState(id, AUDIO_JOB_PREBUFFER);
+  AudioCmd cmd {};
+  cmd.type = AUDIO_CMD_PLAY_STREAM;
+  cmd.voice = c.voice;
+  cmd.volume = c.volume;
+  cmd.fadeInSec = c.fadeInSec;
+  cmd.submittedMs = millis();
+  cmd.jobId = id;
+  cmd.prebufferMs = t;
+  cmd.loop = c.loop;
+  cmd.stream = s;
+  strlcpy(cmd.target, c.url, sizeof(cmd.target));
+  strlcpy(cmd.loopFallbackPath, c.loopFallbackPath, sizeof(cmd.loopFallbackPath));
+
+  return awaitStart(id, cmd, t + PRIME_SLACK_MS, err);
 }
 
-bool playAlarmAudioWithFallback(const AlarmConfig& a) {
-  lastAudioError = "";
+// Submits a play command and waits for the voice's verdict: reported at
+// once when it starts synchronously, or by pollStarts() after prebuffering
+// and MP3 priming.
+bool AudioPlayer::awaitStart(uint32_t id, const AudioCmd& cmd, uint32_t waitMs, String& err) {
+  verdict = 0;
+  verdictJob = id;
+  if (!submit(cmd)) { verdictJob = 0; err = lastErr; return false; }
+  uint32_t waitFrom = millis();
+  while (verdict == 0 && jobCurrent(cmd.voice, id) && (millis() - waitFrom) < waitMs) startWait();
+  int8_t v = verdict;
+  verdictJob = 0;
+  if (v > 0) return true;
+  if (v < 0) { err = verdictErr; return false; }
+
+  // No verdict in time, or superseded: make sure a late start cannot sound
+  // after the job has moved on (stop() has already halted a stopped voice).
+  bool superseded = !jobCurrent(cmd.voice, id);
+  AudioCmd halt {};
+  halt.type = AUDIO_CMD_STOP;
+  halt.voice = cmd.voice;
+  if (currentJob[cmd.voice] != 0) submit(halt);
+  err = superseded ? "cancelled" : (cmd.type == AUDIO_CMD_PLAY_STREAM) ? "prebuffer_timeout" : "start_timeout";
+  return false;
+}
 
-  auto tryLocal = [&](const String& p) -> bool {
-    if (p.length() == 0) return false;
-    String path = p;
-    if (!path.startsWith("/")) {
-      String candidate = "/audio/" + path;
-      if (LittleFS.exists(candidate)) path = candidate;
-      else path = "/" + path;
-    }
-    bool ok = audio.playLocal(path, a.volume);
-    if (!ok) lastAudioError = audio.lastError();
-    return ok;
-  };
-  auto tryUrl = [&](const String& u) -> bool {
-    if (u.length() == 0) return false;
-    bool ok = audio.playUrl(u, a.volume);
-    if (!ok) lastAudioError = audio.lastError();
-    return ok;
-  };
+// One slice of a start step's wait. Woken early by a verdict, stop() or a
+// newer job; without the producer task it drives playback itself.
+void AudioPlayer::startWait() {
+  if (task) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(START_POLL_MS));
+  else { produce(); delay(5); }
+}
 
-  bool ok = false;
-  if (a.audio_type == AUDIO_URL) {
-    ok = tryUrl(String(a.url));
-    if (!ok) {
-      if (strlen(a.fallback_local_path) > 0) ok = tryLocal(String(a.fallback_local_path));
-      if (!ok && LittleFS.exists("/audio/default.wav")) ok = tryLocal("/audio/default.wav");
-    }
-  } else {
-    ok = tryLocal(String(a.local_path));
-    if (!ok) {
-      if (strlen(a.fallback_local_path) > 0) ok = tryLocal(String(a.fallback_local_path));
-      if (!ok && LittleFS.exists("/audio/default.wav")) ok = tryLocal("/audio/default.wav");
+// Resolves a bare file name against /audio/ like the alarm editor does.
+static String resolveLocalPath(const String& p) {
+  if (p.startsWith("/")) return p;
+  String candidate = "/audio/" + p;
+  if (audioIndex.contains(candidate)) return candidate;
+  return "/" + p;
+}
+
+// Files outside /audio are not indexed; they still get a step and are
+// parsed at start.
+static void addIndexed(AudioChain& c, const String& path) {
+  AudioAssetInfo info;
+  if (audioIndex.lookup(path, info)) c.addLocal(path, &info);
+  else c.addLocal(path);
+}
+
+uint32_t startAlarmAudio(const AlarmConfig& a, uint8_t voice) {
+  AudioChain c;
+  c.voice = voice;
+  c.volume = a.volume;
+  c.fadeInSec = a.fade_in_sec;
+  // Previews play once; only the ringing alarm loops.
+  if (voice == AUDIO_VOICE_ALARM) {
+    c.loop.enabled = a.loop_audio;
+    c.loop.crescendo = a.loop_crescendo;
+    c.loop.maxMs = (uint32_t)a.max_ring_sec * 1000;
+  }
+
+  if (a.audio_type != AUDIO_SYNTH) {
+    String fallback;
+    if (strlen(a.fallback_local_path) > 0) fallback = resolveLocalPath(String(a.fallback_local_path));
+    AudioAssetInfo info;
+    bool haveDefault = audioIndex.lookup("/audio/default.wav", info);
+
+    if (a.audio_type == AUDIO_URL) {
+      // A prefetched copy starts from flash without touching the network.
+      String cached = audioCache.lookup(String(a.url));
+      if (cached.length()) c.addLocal(cached);
+      // Without a copy the stream plays once, then the fallback loops.
+      String loopFallback;
+      if (c.loop.enabled) loopFallback = fallback.length() ? fallback : haveDefault ? String("/audio/default.wav") : String();
+      c.addUrl(String(a.url), loopFallback);
+    } else if (strlen(a.local_path) > 0) {
+      addIndexed(c, resolveLocalPath(String(a.local_path)));
     }
+    if (fallback.length()) addIndexed(c, fallback);
+    if (haveDefault) c.addLocal("/audio/default.wav", &info);
   }
-  return ok;
+  // Last resort needs no file system or network, so an alarm is never silent.
+  c.addSynth(a.synth_pattern, a.synth_freq_hz);
+  return audio.startChain(c);
 }
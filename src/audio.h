@@ -1,77 +1,235 @@
 #pragma once
 #include <Arduino.h>
-#include <LittleFS.h>
-#include <HTTPClient.h>
-#include <WiFiClientSecure.h>
 #include "alarms.h"
+#include "audio_sink.h"
+#include "audio_voice.h"
+#include "spsc_ring.h"
 
-extern String lastAudioError;
+// Fixed voices, mixed together: an alarm, a short notification chime and a
+// UI preview can sound at once without cutting each other off.
+enum AudioVoiceId : uint8_t { AUDIO_VOICE_ALARM = 0, AUDIO_VOICE_CHIME = 1, AUDIO_VOICE_PREVIEW = 2, AUDIO_VOICE_COUNT = 3 };
+static const uint8_t AUDIO_VOICE_ALL = 0xFF;
 
+const char* audioVoiceName(uint8_t voice);
+int audioVoiceFromName(const String& name);   // -1 if unknown
+
+struct AudioVoiceStatus {
+  bool active = false;
+  bool looping = false;
+  uint32_t loops = 0;
+  const char* kind = "";
+  String target;
+  String title;   // ICY stream title
+  uint8_t volume = 0;
+  uint32_t playedMs = 0;
+};
+
+// Starting playback is a job: a fallback chain of sources tried in order on
+// the "audio_start" task, so neither the caller nor the mixer waits on the
+// network. A URL step goes connect -> headers -> prebuffer -> playing, each
+// phase with its own timeout; a failed step moves on to the next source.
+enum AudioStepKind : uint8_t { AUDIO_STEP_LOCAL, AUDIO_STEP_URL, AUDIO_STEP_SYNTH };
+static const int AUDIO_CHAIN_MAX = 5;
+
+struct AudioChain {
+  uint8_t voice = AUDIO_VOICE_ALARM;
+  uint8_t volume = 0;
+  uint16_t fadeInSec = 0;
+  uint8_t synthPattern = 0;
+  uint16_t synthHz = 0;
+  AudioLoop loop;
+  char url[256] = "";       // the one URL step, if any
+  char loopFallbackPath[96] = "";   // local file a looping URL falls back to once it ends
+  uint8_t count = 0;
+  uint8_t kinds[AUDIO_CHAIN_MAX] = {};
+  char paths[AUDIO_CHAIN_MAX][104] = {};
+  AudioAssetInfo assets[AUDIO_CHAIN_MAX];   // index entries of local steps, if known
+
+  bool addLocal(const String& path, const AudioAssetInfo* asset = nullptr);
+  bool addUrl(const String& u, const String& loopFallback = "");
+  bool addSynth(uint8_t pattern, uint16_t hz);
+};
+
+enum AudioJobState : uint8_t {
+  AUDIO_JOB_QUEUED, AUDIO_JOB_OPEN, AUDIO_JOB_CONNECT, AUDIO_JOB_HEADERS, AUDIO_JOB_PREBUFFER,
+  AUDIO_JOB_PLAYING, AUDIO_JOB_FAILED, AUDIO_JOB_CANCELLED
+};
+const char* audioJobStateName(uint8_t state);
+const char* audioStepKindName(uint8_t kind);
+
+struct AudioJobStep {
+  uint8_t kind = 0;
+  bool ok = false;
+  uint32_t ms = 0;
+  char error[24] = "";
+};
+
+// A job as reported to pollers; kept after it settles.
+struct AudioJobStatus {
+  uint32_t id = 0;
+  uint8_t voice = 0;
+  uint8_t state = AUDIO_JOB_QUEUED;
+  uint8_t steps = 0;       // tried so far, including the current one
+  uint32_t submittedMs = 0;
+  uint32_t elapsedMs = 0;  // until it played or failed, else so far
+  char source[64] = "";    // what ended up playing
+  char error[32] = "";     // last step error
+  AudioJobStep log[AUDIO_CHAIN_MAX];
+
+  bool settled() const { return state >= AUDIO_JOB_PLAYING; }
+};
+
+enum AudioCmdType : uint8_t { AUDIO_CMD_PLAY_LOCAL, AUDIO_CMD_PLAY_STREAM, AUDIO_CMD_PLAY_SYNTH, AUDIO_CMD_STOP };
+
+struct AudioCmd {
+  AudioCmdType type;
+  uint8_t voice;
+  uint8_t volume;
+  uint16_t fadeInSec;
+  uint32_t submittedMs;
+  uint32_t jobId;     // 0 for direct calls; a cancelled job's command is refused
+  uint32_t prebufferMs;
+  uint8_t synthPattern;
+  uint16_t synthHz;
+  AudioLoop loop;
+  AudioHttpStream* stream;   // opened by the start task, owned by the command
+  AudioAssetInfo asset;      // index entry of a local file (format unknown if none)
+  char target[256];   // path or URL
+  char loopFallbackPath[96];  // local file a looping URL falls back to once it ends
+};
+
+// Playback runs on its own producer task ("audio_fill"); the public play and
+// stop calls are queued to it and block until it has acted on them. Network
+// sources only start through a job (startChain), which never blocks.
 class AudioPlayer {
 public:
-  void begin(int pwmPin);
-  void setSampleRate(int sr);
+  void begin(int pwmPin, AudioSinkKind kind = AUDIO_SINK_PDM);
+  void setSink(AudioSink* s);
+  const char* sinkName() const;
   bool isPlaying() const;
+  bool isPlaying(uint8_t voice) const;
   String lastError() const;
-  void stop();
-  bool playLocal(const String& path, uint8_t vol);
-  bool playUrl(const String& url, uint8_t vol);
+  uint32_t decodeCyclesPerSecond() const;
+  uint32_t resampleCyclesPerBlock() const;
+  uint32_t mixCyclesPerBlock() const;
+  void setNetWatermarks(uint32_t startBytes, uint32_t lowBytes);
+  // Apply the index's loudness normalization gain to local files.
+  void setNormalize(bool on);
+  uint32_t netBuffered() const;
+  uint32_t underrunCount() const;
+  uint32_t underrunMs() const;
+  uint32_t taskStackFree() const;
+  uint32_t ringFill() const { return rb.size(); }
+  uint32_t ringCapacity() const { return RB_CAP; }
+  AudioVoiceStatus voiceStatus(uint8_t voice) const;
+  void stop(uint8_t voice = AUDIO_VOICE_ALL);
+  bool playLocal(const String& path, uint8_t vol, uint16_t fadeInSec = 0, uint8_t voice = AUDIO_VOICE_ALARM,
+                 const AudioLoop& loop = AudioLoop());
+  bool playSynth(uint8_t pattern, uint16_t baseHz, uint8_t vol, uint16_t fadeInSec = 0,
+                 uint8_t voice = AUDIO_VOICE_ALARM, const AudioLoop& loop = AudioLoop());
+  // Queues a chain and returns its job id at once; 0 if it was empty.
+  // A newer job on the same voice, or stop() on it, cancels an older one.
+  uint32_t startChain(const AudioChain& chain);
+  bool jobStatus(uint32_t id, AudioJobStatus& out) const;
+  size_t recentJobs(AudioJobStatus* out, size_t max) const;   // newest first
+  String lastStartError() const;
+  // Called from the start task whenever a job settles, to wake the main loop.
+  void setJobHook(void (*fn)()) { jobHook = fn; }
+  // Without the producer task, loop() has to be called often while playing.
+  bool needsLoop() const { return !task && playing; }
   void loop();
 private:
-  class StreamHolder;
-  void startTimer();
-  void writeDutyMid();
-  void onTick();
-  void rbReset();
-  bool rbPush(int16_t s);
-  bool rbPop(int16_t& s);
-  bool readBytes(File& f, uint8_t* buf, size_t n);
-  bool readBytesStream(WiFiClient& s, uint8_t* buf, size_t n, uint32_t timeoutMs = 3000);
-  bool wavParseHeader(uint8_t header[44]);
-  bool wavReadHeaderFromFile();
-  bool wavReadHeaderFromStream();
-  bool fillWav();
-  bool fillMp3();
-  static void timerThunk(void* arg);
-  static uint32_t readLE32(const uint8_t* b);
-  static uint16_t readLE16(const uint8_t* b);
+  static const int AUDIO_CMD_QUEUE_LEN = 4;
+  static const int MIX_BLOCK = 256;
+  static const int AUDIO_JOB_HISTORY = 8;
+
+  void startTask();
+  static void taskThunk(void* arg);
+  void taskLoop();
+  bool submit(const AudioCmd& cmd);
+  bool execute(const AudioCmd& cmd);
+  bool startVoice(const AudioCmd& cmd);
+  void pollStarts();
+  void reportStart(uint8_t voice, bool ok, const String& err);
+  bool continueLoop(uint8_t voice);
+  void stopVoices(uint8_t voice);
+  void startOutput();
+  void stopOutput();
+  void releaseSink();
+  void produce();
+  void mix();
+  size_t pullSamples(int16_t* dst, size_t n);
+  static size_t pullThunk(void* ctx, int16_t* dst, size_t n);
+
+  void startStarterTask();
+  static void starterThunk(void* arg);
+  void starterLoop();
+  void drainJobs();
+  void runChain(uint32_t id);
+  bool runStep(uint32_t id, int step, String& err);
+  bool runUrlStep(uint32_t id, uint32_t deadlineMs, String& err);
+  bool awaitStart(uint32_t id, const AudioCmd& cmd, uint32_t waitMs, String& err);
+  void startWait();
+  bool jobCurrent(uint8_t voice, uint32_t id) const;
+  AudioJobStatus* jobSlot(uint32_t id);
+  void setJobState(uint32_t id, uint8_t state);
+
+  TaskHandle_t task = nullptr;
+  QueueHandle_t cmdQueue = nullptr;
+  SemaphoreHandle_t cmdLock = nullptr;
+  SemaphoreHandle_t cmdDone = nullptr;
+  bool cmdResult = false;
 
   int audioPin = 5;
-  int sampleRate = 16000;
-  uint8_t volume = 80;
+  AudioSink* sink = nullptr;
+  bool ownsSink = false;
+
+  AudioVoice voices[AUDIO_VOICE_COUNT];
+  String loopFallbacks[AUDIO_VOICE_COUNT];
+  // Submit time of a voice's play command until its first sample is mixed.
+  uint32_t firstSamplePendingMs[AUDIO_VOICE_COUNT] = {};
+  bool firstSamplePending[AUDIO_VOICE_COUNT] = {};
+  void noteFirstSample(uint8_t voice);
+  uint32_t startJob[AUDIO_VOICE_COUNT] = {};
+
+  // Start jobs. chains[] holds the newest request per voice and currentJob[]
+  // its id (0 once stopped); the start task works on a copy in running.
+  TaskHandle_t starter = nullptr;
+  SemaphoreHandle_t jobLock = nullptr;
+  AudioChain chains[AUDIO_VOICE_COUNT];
+  volatile uint32_t currentJob[AUDIO_VOICE_COUNT] = {};
+  uint32_t queuedJob[AUDIO_VOICE_COUNT] = {};
+  AudioChain running;
+  AudioJobStatus jobs[AUDIO_JOB_HISTORY];
+  uint32_t nextJobId = 1;
+  char startErr[32] = "";
+  void (*jobHook)() = nullptr;
+  // Outcome of the stream the start task is waiting on (0 = pending).
+  volatile uint32_t verdictJob = 0;
+  volatile int8_t verdict = 0;
+  char verdictErr[24] = "";
+
+  uint32_t netStartBytes = AUDIO_NET_START_DEFAULT;
+  volatile bool normalize = true;
+  uint32_t netLowBytes = AUDIO_NET_LOW_DEFAULT;
 
   volatile bool playing = false;
+  volatile bool sourcesEnded = false;
   String lastErr;
-  String sourceKind;
-
-  File file;
-  StreamHolder* stream = nullptr;
-
-  bool wavOk = false;
-  uint16_t wavChannels = 1;
-  uint32_t wavSampleRate = 16000;
-  uint16_t wavBits = 16;
-  uint32_t wavDataRemaining = 0;
-
-  struct mp3dec_t { int dummy; } mp3dec;
-  struct mp3dec_frame_info_t {
-    int frame_bytes;
-    int channels;
-    int hz;
-    int layer;
-    int bitrate_kbps;
-  };
-  uint8_t mp3In[2048];
-  int mp3InFilled = 0;
-  bool inputEnded = false;
-
-  static const int RB_CAP = 8192;
-  volatile int rbHead = 0, rbTail = 0, rbCount = 0;
-  int16_t rb[RB_CAP];
-
-  esp_timer_handle_t timer = nullptr;
+
+  uint64_t mixCycles = 0;
+  uint64_t mixSamples = 0;
+
+  // Updated from the sink's context.
+  volatile uint32_t underruns = 0;
+  volatile uint32_t underrunSamples = 0;
+  bool starved = false;
+  uint32_t lastPullUs = 0;
+
+  static const uint32_t RB_CAP = 8192;
+  SpscRing<int16_t, RB_CAP> rb;
 };
 
 extern AudioPlayer audio;
-bool playAlarmAudioWithFallback(const AlarmConfig& a);
-
+// Queues the alarm's source with its fallbacks; returns the job id.
+uint32_t startAlarmAudio(const AlarmConfig& a, uint8_t voice = AUDIO_VOICE_ALARM);
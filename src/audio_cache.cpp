@@ -0,0 +1,348 @@
+#include "audio_cache.h"
+#include <time.h>
+
+static const char* CACHE_DIR = "/cache";
+static const char* CACHE_INDEX = "/cache/index.txt";
+static const uint32_t CACHE_FS_RESERVE = 64 * 1024;   // keep free for uploads/NVS-adjacent use
+static const uint16_t FETCH_TIMEOUT_MS = 8000;
+static const uint32_t FETCH_STALL_MS = 15000;
+static const int FETCH_BYTES_PER_LOOP = 8192;
+
+AudioCache audioCache;
+
+namespace {
+struct CacheLock {
+  explicit CacheLock(SemaphoreHandle_t l) : m(l) { if (m) xSemaphoreTake(m, portMAX_DELAY); }
+  ~CacheLock() { if (m) xSemaphoreGive(m); }
+  SemaphoreHandle_t m;
+};
+}
+
+uint32_t AudioCache::hashUrl(const String& url) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < url.length(); i++) {
+    h ^= (uint8_t)url[i];
+    h *= 16777619u;
+  }
+  return h ? h : 1;
+}
+
+String AudioCache::pathFor(uint32_t hash, const String& url) const {
+  char name[16];
+  snprintf(name, sizeof(name), "%08lx", (unsigned long)hash);
+  String u = url; u.toLowerCase();
+  const char* ext = (u.indexOf(".mp3") > 0) ? ".mp3" : ".wav";
+  return String(CACHE_DIR) + "/" + name + ext;
+}
+
+void AudioCache::begin() {
+  if (!lock) lock = xSemaphoreCreateMutex();
+  CacheLock g(lock);
+  if (!LittleFS.exists(CACHE_DIR)) LittleFS.mkdir(CACHE_DIR);
+
+  // Drop partial downloads left by a reset.
+  File root = LittleFS.open(CACHE_DIR, "r");
+  if (root && root.isDirectory()) {
+    File f = root.openNextFile();
+    while (f) {
+      String name = f.name();
+      f.close();
+      if (name.endsWith(".tmp")) {
+        int slash = name.lastIndexOf('/');
+        LittleFS.remove(String(CACHE_DIR) + "/" + name.substring(slash + 1));
+      }
+      f = root.openNextFile();
+    }
+  }
+  loadIndex();
+}
+
+void AudioCache::setMaxBytes(uint32_t bytes) {
+  CacheLock g(lock);
+  limitBytes = bytes;
+  if (!dlHttp) makeRoom(0, 0);
+}
+
+bool AudioCache::busy() const {
+  CacheLock g(lock);
+  return dlHttp != nullptr;
+}
+
+String AudioCache::lastError() const {
+  CacheLock g(lock);
+  return lastErr;
+}
+
+int AudioCache::find(const String& url) const {
+  for (int i = 0; i < MAX_ENTRIES; i++) {
+    if (entries[i].hash != 0 && entries[i].url == url) return i;
+  }
+  return -1;
+}
+
+bool AudioCache::contains(const String& url) const {
+  CacheLock g(lock);
+  return find(url) >= 0;
+}
+
+String AudioCache::lookup(const String& url) {
+  CacheLock g(lock);
+  int i = find(url);
+  if (i < 0) return "";
+  String path = pathFor(entries[i].hash, url);
+  if (!LittleFS.exists(path)) {
+    entries[i] = AudioCacheEntry();
+    saveIndex();
+    return "";
+  }
+  entries[i].lastUsed = (uint32_t)time(nullptr);
+  saveIndex();
+  return path;
+}
+
+int AudioCache::entryCount() const {
+  CacheLock g(lock);
+  int n = 0;
+  for (int i = 0; i < MAX_ENTRIES; i++) if (entries[i].hash != 0) n++;
+  return n;
+}
+
+uint32_t AudioCache::totalBytes() const {
+  CacheLock g(lock);
+  uint32_t total = 0;
+  for (int i = 0; i < MAX_ENTRIES; i++) if (entries[i].hash != 0) total += entries[i].size;
+  return total;
+}
+
+void AudioCache::evict(int idx) {
+  LittleFS.remove(pathFor(entries[idx].hash, entries[idx].url));
+  entries[idx] = AudioCacheEntry();
+}
+
+// Evicts least recently used entries (never keepHash) until need more bytes
+// fit both the cache limit and the filesystem reserve.
+bool AudioCache::makeRoom(uint32_t need, uint32_t keepHash) {
+  bool changed = false;
+  for (;;) {
+    uint32_t keepSize = 0, others = 0;
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+      if (entries[i].hash == 0) continue;
+      if (entries[i].hash == keepHash) keepSize = entries[i].size;
+      else others += entries[i].size;
+    }
+    // The copy being replaced is freed on commit.
+    uint32_t fsFree = (uint32_t)(LittleFS.totalBytes() - LittleFS.usedBytes()) + keepSize;
+    bool fits = (others + need <= limitBytes) && (need + CACHE_FS_RESERVE <= fsFree);
+    if (fits) break;
+
+    int lru = -1;
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+      if (entries[i].hash == 0 || entries[i].hash == keepHash) continue;
+      if (lru < 0 || entries[i].lastUsed < entries[lru].lastUsed) lru = i;
+    }
+    if (lru < 0) { if (changed) saveIndex(); return false; }
+    evict(lru);
+    changed = true;
+  }
+  if (changed) saveIndex();
+  return true;
+}
+
+bool AudioCache::fetch(const String& url) {
+  uint32_t hash = hashUrl(url);
+  {
+    CacheLock g(lock);
+    if (dlHttp) { lastErr = "busy"; return false; }
+    lastErr = "";
+    if (!startRequest(url, hash)) return false;
+    dlRequesting = true;
+    cancelPending = false;
+  }
+
+  // The request blocks for up to FETCH_TIMEOUT_MS, so it runs unlocked to
+  // keep lookup() from a web-triggered alarm waiting. cancel() meanwhile only
+  // marks the download; the client is released here, after GET() returns.
+  int code = dlHttp->GET();
+
+  CacheLock g(lock);
+  dlRequesting = false;
+  if (cancelPending) {
+    cancelPending = false;
+    failDownload("cancelled");
+    return false;
+  }
+  int idx = find(url);
+  if (code == 304 && idx >= 0) {
+    entries[idx].lastUsed = (uint32_t)time(nullptr);
+    saveIndex();
+    closeDownload();
+    return true;
+  }
+  if (code != 200) { failDownload(code <= 0 ? String("http_get_failed") : "http_status_" + String(code)); return false; }
+
+  dlExpected = dlHttp->getSize();
+  if (dlExpected > (int32_t)limitBytes) { failDownload("too_large"); return false; }
+  if (dlExpected > 0 && !makeRoom((uint32_t)dlExpected, hash)) { failDownload("no_space"); return false; }
+
+  dlFile = LittleFS.open(pathFor(hash, url) + ".tmp", "w");
+  if (!dlFile) { failDownload("open_failed"); return false; }
+
+  dlUrl = url;
+  dlEtag = dlHttp->header("ETag");
+  dlGot = 0;
+  dlLastProgressMs = millis();
+  return true;
+}
+
+// Sets up the client and request headers; called with the lock held.
+bool AudioCache::startRequest(const String& url, uint32_t hash) {
+  bool secure = url.startsWith("https://") || url.startsWith("HTTPS://");
+  if (secure) {
+    WiFiClientSecure* s = new WiFiClientSecure();
+    s->setInsecure();
+    dlClient = s;
+  } else {
+    dlClient = new WiFiClient();
+  }
+  dlHttp = new HTTPClient();
+  dlHttp->useHTTP10(true);   // plain body, no chunked framing to undo
+  dlHttp->setTimeout(FETCH_TIMEOUT_MS);
+  if (!dlHttp->begin(*dlClient, url)) { failDownload("http_begin_failed"); return false; }
+
+  static const char* wanted[] = { "ETag" };
+  dlHttp->collectHeaders(wanted, 1);
+
+  int idx = find(url);
+  if (idx >= 0 && entries[idx].etag.length() && LittleFS.exists(pathFor(hash, url))) {
+    dlHttp->addHeader("If-None-Match", entries[idx].etag);
+  }
+  return true;
+}
+
+void AudioCache::loop() {
+  CacheLock g(lock);
+  if (!dlHttp || !dlFile) return;
+
+  WiFiClient* s = dlHttp->getStreamPtr();
+  if (!s) { failDownload("http_no_stream"); return; }
+
+  uint8_t buf[1024];
+  int budget = FETCH_BYTES_PER_LOOP;
+  while (budget > 0) {
+    int av = s->available();
+    if (av <= 0) break;
+    int r = s->read(buf, min(av, (int)sizeof(buf)));
+    if (r <= 0) break;
+    if (dlFile.write(buf, (size_t)r) != (size_t)r) { failDownload("write_failed"); return; }
+    dlGot += (uint32_t)r;
+    budget -= r;
+    dlLastProgressMs = millis();
+    if (dlGot > limitBytes) { failDownload("too_large"); return; }
+  }
+
+  bool closed = !s->connected() && s->available() <= 0;
+  if (dlExpected >= 0 && dlGot >= (uint32_t)dlExpected) { finishDownload(); return; }
+  if (closed) {
+    if (dlExpected < 0) finishDownload();
+    else failDownload("truncated");
+    return;
+  }
+  if (millis() - dlLastProgressMs > FETCH_STALL_MS) failDownload("stalled");
+}
+
+void AudioCache::finishDownload() {
+  uint32_t hash = hashUrl(dlUrl);
+  String path = pathFor(hash, dlUrl);
+  dlFile.close();
+
+  if (dlExpected < 0 && !makeRoom(dlGot, hash)) { failDownload("no_space"); return; }
+
+  // One slot per URL; a hash collision or a full table evicts.
+  int idx = find(dlUrl);
+  for (int i = 0; i < MAX_ENTRIES; i++) {
+    if (i != idx && entries[i].hash == hash) evict(i);
+  }
+  if (idx < 0) {
+    for (int i = 0; i < MAX_ENTRIES && idx < 0; i++) if (entries[i].hash == 0) idx = i;
+  }
+  if (idx < 0) {
+    idx = 0;
+    for (int i = 1; i < MAX_ENTRIES; i++) if (entries[i].lastUsed < entries[idx].lastUsed) idx = i;
+    evict(idx);
+  }
+
+  LittleFS.remove(path);
+  if (!LittleFS.rename(path + ".tmp", path)) { failDownload("rename_failed"); return; }
+
+  AudioCacheEntry& e = entries[idx];
+  e.hash = hash;
+  e.size = dlGot;
+  e.lastUsed = (uint32_t)time(nullptr);
+  e.etag = dlEtag;
+  e.url = dlUrl;
+  saveIndex();
+  closeDownload();
+}
+
+void AudioCache::failDownload(const String& err) {
+  lastErr = err;
+  if (dlFile) dlFile.close();
+  if (dlUrl.length()) LittleFS.remove(pathFor(hashUrl(dlUrl), dlUrl) + ".tmp");
+  closeDownload();
+}
+
+void AudioCache::cancel() {
+  CacheLock g(lock);
+  if (dlRequesting) cancelPending = true;
+  else if (dlHttp) failDownload("cancelled");
+}
+
+void AudioCache::closeDownload() {
+  if (dlFile) dlFile.close();
+  if (dlHttp) { dlHttp->end(); delete dlHttp; dlHttp = nullptr; }
+  if (dlClient) { delete dlClient; dlClient = nullptr; }
+  dlUrl = "";
+  dlEtag = "";
+  dlExpected = -1;
+  dlGot = 0;
+}
+
+// One entry per line: hash, size, last_used, etag, url (tab separated).
+void AudioCache::loadIndex() {
+  for (int i = 0; i < MAX_ENTRIES; i++) entries[i] = AudioCacheEntry();
+  File f = LittleFS.open(CACHE_INDEX, "r");
+  if (!f) return;
+
+  int n = 0;
+  while (f.available() && n < MAX_ENTRIES) {
+    String line = f.readStringUntil('\n');
+    int t1 = line.indexOf('\t');
+    int t2 = line.indexOf('\t', t1 + 1);
+    int t3 = line.indexOf('\t', t2 + 1);
+    int t4 = line.indexOf('\t', t3 + 1);
+    if (t1 < 0 || t2 < 0 || t3 < 0 || t4 < 0) continue;
+
+    AudioCacheEntry e;
+    e.hash = (uint32_t)strtoul(line.substring(0, t1).c_str(), nullptr, 16);
+    e.size = (uint32_t)strtoul(line.substring(t1 + 1, t2).c_str(), nullptr, 10);
+    e.lastUsed = (uint32_t)strtoul(line.substring(t2 + 1, t3).c_str(), nullptr, 10);
+    e.etag = line.substring(t3 + 1, t4);
+    e.url = line.substring(t4 + 1);
+    if (e.hash == 0 || e.hash != hashUrl(e.url) || !LittleFS.exists(pathFor(e.hash, e.url))) continue;
+    entries[n++] = e;
+  }
+  f.close();
+}
+
+void AudioCache::saveIndex() {
+  File f = LittleFS.open(CACHE_INDEX, "w");
+  if (!f) return;
+  for (int i = 0; i < MAX_ENTRIES; i++) {
+    const AudioCacheEntry& e = entries[i];
+    if (e.hash == 0) continue;
+    char head[40];
+    snprintf(head, sizeof(head), "%08lx\t%lu\t%lu\t", (unsigned long)e.hash, (unsigned long)e.size, (unsigned long)e.lastUsed);
+    f.print(String(head) + e.etag + "\t" + e.url + "\n");
+  }
+  f.close();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include "alarms.h"
+
+static const uint32_t AUDIO_CACHE_MAX_DEFAULT = 512 * 1024;
+
+struct AudioCacheEntry {
+  uint32_t hash = 0;      // FNV-1a of url, also the file name
+  uint32_t size = 0;
+  uint32_t lastUsed = 0;  // unix time of last fetch or play, for LRU
+  String etag;
+  String url;
+};
+
+// Flash copy of URL alarm audio under /cache, keyed by URL and revalidated
+// with If-None-Match. Downloads are started with fetch() and advanced a
+// bounded amount per loop() call; only the request itself blocks. fetch()
+// and loop() run on the main loop, lookup() and cancel() may also come from
+// the web server task, so all state is behind a mutex.
+class AudioCache {
+public:
+  static const int MAX_ENTRIES = MAX_ALARMS < 16 ? MAX_ALARMS : 16;
+
+  void begin();
+  void setMaxBytes(uint32_t bytes);
+  uint32_t maxBytes() const { return limitBytes; }
+
+  // Local path of the cached copy of url, or "" if there is none.
+  String lookup(const String& url);
+  bool contains(const String& url) const;
+
+  bool fetch(const String& url);
+  void cancel();
+  void loop();
+  bool busy() const;
+
+  int entryCount() const;
+  uint32_t totalBytes() const;
+  String lastError() const;
+
+private:
+  int find(const String& url) const;
+  String pathFor(uint32_t hash, const String& url) const;
+  bool startRequest(const String& url, uint32_t hash);
+  bool makeRoom(uint32_t need, uint32_t keepHash);
+  void evict(int idx);
+  void finishDownload();
+  void failDownload(const String& err);
+  void closeDownload();
+  void loadIndex();
+  void saveIndex();
+  static uint32_t hashUrl(const String& url);
+
+  AudioCacheEntry entries[MAX_ENTRIES];
+  uint32_t limitBytes = AUDIO_CACHE_MAX_DEFAULT;
+  String lastErr;
+  SemaphoreHandle_t lock = nullptr;
+
+  HTTPClient* dlHttp = nullptr;
+  WiFiClient* dlClient = nullptr;
+  File dlFile;
+  String dlUrl;
+  String dlEtag;
+  int32_t dlExpected = -1;
+  uint32_t dlGot = 0;
+  uint32_t dlLastProgressMs = 0;
+  bool dlRequesting = false;   // GET in flight, outside the lock
+  bool cancelPending = false;  // cancel() arrived during the GET
+};
+
+extern AudioCache audioCache;
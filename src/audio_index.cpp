@@ -0,0 +1,409 @@
+#include "audio_index.h"
+#include <math.h>
+#include "native_pcm.h"
+#include "pcm_convert.h"
+
+static const char* AUDIO_DIR = "/audio";
+static const char* INDEX_PATH = "/audio_index.txt";
+static const char* INDEX_HEADER = "# audio index v2";
+static const int INDEX_FIELDS = 14;
+static const int WAV_MAX_CHUNKS = 16;
+static const uint32_t MP3_SYNC_SEARCH = 4096;
+
+static const char* FORMAT_NAMES[] = { "unknown", "wav", "wav_adpcm", "pcm", "mp3" };
+
+static const uint16_t MP3_KBPS[2][15] = {
+  { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },   // MPEG-1 Layer III
+  { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },       // MPEG-2/2.5 Layer III
+};
+static const uint32_t MP3_RATES[3] = { 44100, 48000, 32000 };
+
+AudioIndex audioIndex;
+
+const char* audioAssetFormatName(uint8_t format) {
+  return format <= AUDIO_ASSET_MP3 ? FORMAT_NAMES[format] : "unknown";
+}
+
+namespace {
+struct IndexLock {
+  explicit IndexLock(SemaphoreHandle_t l) : m(l) { if (m) xSemaphoreTake(m, portMAX_DELAY); }
+  ~IndexLock() { if (m) xSemaphoreGive(m); }
+  SemaphoreHandle_t m;
+};
+}
+
+static uint32_t le32(const uint8_t* b) {
+  return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint16_t le16(const uint8_t* b) { return (uint16_t)(b[0] | (b[1] << 8)); }
+
+// Whole blocks plus the units of a trailing partial one.
+static uint32_t adpcmSamples(uint32_t bytes, uint16_t channels, uint16_t blockAlign) {
+  uint32_t unit = 4u * channels;
+  uint32_t perBlock = (blockAlign / unit - 1) * 8 + 1;
+  uint32_t samples = (bytes / blockAlign) * perBlock;
+  uint32_t units = (bytes % blockAlign) / unit;
+  if (units) samples += 1 + (units - 1) * 8;
+  return samples;
+}
+
+static bool probeWav(File& f, AudioAssetInfo& a) {
+  uint8_t h[12];
+  if (f.read(h, 12) != 12 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) return false;
+  uint16_t tag = 0;
+  for (int i = 0; i < WAV_MAX_CHUNKS; i++) {
+    if (f.read(h, 8) != 8) return false;
+    uint32_t size = le32(h + 4);
+    uint32_t next = (uint32_t)f.position() + size + (size & 1);
+
+    if (memcmp(h, "fmt ", 4) == 0) {
+      uint8_t fmt[26] = {};
+      if (size < 16) return false;
+      size_t take = min(size, (uint32_t)sizeof(fmt));
+      if (f.read(fmt, take) != take) return false;
+      tag = le16(fmt);
+      if (tag == 0xFFFE && take >= 26) tag = le16(fmt + 24);
+      a.channels = (uint8_t)le16(fmt + 2);
+      a.sampleRate = le32(fmt + 4);
+      a.blockAlign = le16(fmt + 12);
+      a.bits = (uint8_t)le16(fmt + 14);
+    } else if (memcmp(h, "data", 4) == 0) {
+      if (tag == 0 || a.channels == 0 || a.sampleRate == 0) return false;
+      a.dataOffset = (uint32_t)f.position();
+      a.dataBytes = min(size, a.size - a.dataOffset);
+      if (tag == 1 && a.bits >= 8) {
+        a.format = AUDIO_ASSET_WAV;
+        uint32_t frames = a.dataBytes / (a.channels * (a.bits / 8));
+        a.durationMs = (uint32_t)((uint64_t)frames * 1000 / a.sampleRate);
+      } else if (tag == IMA_ADPCM_FORMAT_TAG && a.blockAlign >= 8u * a.channels) {
+        a.format = AUDIO_ASSET_WAV_ADPCM;
+        a.durationMs = (uint32_t)((uint64_t)adpcmSamples(a.dataBytes, a.channels, a.blockAlign) * 1000 / a.sampleRate);
+      }
+      return a.format != AUDIO_ASSET_UNKNOWN;
+    }
+    if (!f.seek(next)) return false;
+  }
+  return false;
+}
+
+static bool probePcm(File& f, AudioAssetInfo& a) {
+  uint8_t h[NATIVE_PCM_HEADER_BYTES];
+  NativePcmInfo info;
+  if (f.read(h, sizeof(h)) != sizeof(h) || !nativePcmParseHeader(h, info) || info.sampleRate == 0) return false;
+  a.format = AUDIO_ASSET_PCM;
+  a.channels = 1;
+  a.bits = info.bits;
+  a.sampleRate = info.sampleRate;
+  a.dataOffset = NATIVE_PCM_HEADER_BYTES;
+  a.dataBytes = min(info.samples * (info.bits / 8), a.size - a.dataOffset);
+  a.durationMs = (uint32_t)((uint64_t)(a.dataBytes / (info.bits / 8)) * 1000 / info.sampleRate);
+  return true;
+}
+
+// Finds the first Layer III frame after any ID3v2 tag and estimates the
+// duration from its bitrate (exact for CBR).
+static bool probeMp3(File& f, AudioAssetInfo& a) {
+  uint8_t b[512];
+  uint32_t start = 0;
+  if (f.read(b, 10) == 10 && memcmp(b, "ID3", 3) == 0) {
+    start = 10 + (((uint32_t)(b[6] & 0x7F) << 21) | ((uint32_t)(b[7] & 0x7F) << 14) |
+                  ((uint32_t)(b[8] & 0x7F) << 7) | (uint32_t)(b[9] & 0x7F));
+    if (b[5] & 0x10) start += 10;
+  }
+  uint32_t pos = start;
+  while (pos < start + MP3_SYNC_SEARCH && f.seek(pos)) {
+    size_t n = f.read(b, sizeof(b));
+    if (n < 4) return false;
+    for (size_t i = 0; i + 4 <= n; i++) {
+      if (b[i] != 0xFF || (b[i + 1] & 0xE0) != 0xE0) continue;
+      uint8_t ver = (b[i + 1] >> 3) & 3;     // 3 = MPEG-1, 2 = MPEG-2, 0 = MPEG-2.5
+      uint8_t layer = (b[i + 1] >> 1) & 3;   // 1 = Layer III
+      uint8_t br = b[i + 2] >> 4;
+      uint8_t sr = (b[i + 2] >> 2) & 3;
+      if (ver == 1 || layer != 1 || br == 0 || br == 15 || sr == 3) continue;
+      uint32_t kbps = MP3_KBPS[ver == 3 ? 0 : 1][br];
+      a.format = AUDIO_ASSET_MP3;
+      a.sampleRate = MP3_RATES[sr] >> (ver == 3 ? 0 : ver == 2 ? 1 : 2);
+      a.channels = ((b[i + 3] >> 6) == 3) ? 1 : 2;
+      a.bits = 16;
+      a.dataOffset = pos + (uint32_t)i;
+      a.dataBytes = a.size - a.dataOffset;
+      a.durationMs = (uint32_t)((uint64_t)a.dataBytes * 8 / kbps);
+      return true;
+    }
+    pos += (uint32_t)n - 3;
+  }
+  return false;
+}
+
+// False only if the file cannot be opened; an unknown format keeps its size.
+static bool probe(const String& path, AudioAssetInfo& a) {
+  a = AudioAssetInfo();
+  File f = LittleFS.open(path, "r");
+  if (!f) return false;
+  a.size = (uint32_t)f.size();
+  String lp = path; lp.toLowerCase();
+  bool ok = false;
+  if (lp.endsWith(".wav")) ok = probeWav(f, a);
+  else if (lp.endsWith(".pcm")) ok = probePcm(f, a);
+  else if (lp.endsWith(".mp3")) ok = probeMp3(f, a);
+  f.close();
+  if (!ok) {
+    uint32_t size = a.size;
+    a = AudioAssetInfo();
+    a.size = size;
+  }
+  return true;
+}
+
+void AudioIndex::begin() {
+  if (!lock) lock = xSemaphoreCreateMutex();
+  IndexLock g(lock);
+  load();
+
+  // One directory pass at boot: probe new or resized files, drop missing ones.
+  bool seen[MAX_ASSETS] = {};
+  File root = LittleFS.open(AUDIO_DIR, "r");
+  if (root && root.isDirectory()) {
+    File f = root.openNextFile();
+    while (f) {
+      if (!f.isDirectory()) {
+        String name = f.name();
+        String path = String(AUDIO_DIR) + "/" + name.substring(name.lastIndexOf('/') + 1);
+        uint32_t size = (uint32_t)f.size();
+        f.close();
+        int i = find(path);
+        if (i < 0 || assets[i].info.size != size) {
+          i = slotFor(path);
+          if (i >= 0) { probe(path, assets[i].info); dirty = true; }
+        }
+        if (i >= 0) seen[i] = true;
+      }
+      f = root.openNextFile();
+    }
+  }
+  for (int i = 0; i < MAX_ASSETS; i++) {
+    if (assets[i].path.length() && !seen[i]) { assets[i] = AudioAsset(); dirty = true; }
+  }
+  if (dirty) save();
+}
+
+int AudioIndex::find(const String& path) const {
+  for (int i = 0; i < MAX_ASSETS; i++) {
+    if (assets[i].path.length() && assets[i].path == path) return i;
+  }
+  return -1;
+}
+
+int AudioIndex::slotFor(const String& path) {
+  int i = find(path);
+  if (i >= 0) return i;
+  for (i = 0; i < MAX_ASSETS; i++) {
+    if (assets[i].path.length() == 0) {
+      assets[i].path = path;
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool AudioIndex::lookup(const String& path, AudioAssetInfo& out) const {
+  IndexLock g(lock);
+  int i = find(path);
+  if (i < 0) return false;
+  out = assets[i].info;
+  return true;
+}
+
+bool AudioIndex::contains(const String& path) const {
+  IndexLock g(lock);
+  return find(path) >= 0;
+}
+
+std::vector<AudioAsset> AudioIndex::snapshot() const {
+  IndexLock g(lock);
+  std::vector<AudioAsset> out;
+  for (const AudioAsset& a : assets) if (a.path.length()) out.push_back(a);
+  return out;
+}
+
+int AudioIndex::count() const {
+  IndexLock g(lock);
+  int n = 0;
+  for (const AudioAsset& a : assets) if (a.path.length()) n++;
+  return n;
+}
+
+bool AudioIndex::update(const String& path) {
+  AudioAssetInfo info;
+  if (!probe(path, info)) { remove(path); return false; }
+  IndexLock g(lock);
+  int i = slotFor(path);
+  if (i < 0) return false;
+  if (i == scanIdx) stopScan();
+  assets[i].info = info;
+  save();
+  return true;
+}
+
+void AudioIndex::remove(const String& path) {
+  IndexLock g(lock);
+  int i = find(path);
+  if (i < 0) return;
+  if (i == scanIdx) stopScan();
+  assets[i] = AudioAsset();
+  save();
+}
+
+void AudioIndex::stopScan() {
+  if (scanFile) scanFile.close();
+  scanIdx = -1;
+}
+
+void AudioIndex::loop() {
+  if (!lock) return;
+  IndexLock g(lock);
+  if (scanIdx < 0) {
+    for (int i = 0; i < MAX_ASSETS && scanIdx < 0; i++) {
+      const AudioAssetInfo& a = assets[i].info;
+      if (!needsScan(assets[i])) continue;
+
+      scanFile = LittleFS.open(assets[i].path, "r");
+      if (!scanFile || !scanFile.seek(a.dataOffset)) {
+        if (scanFile) scanFile.close();
+        assets[i] = AudioAsset();
+        dirty = true;
+        continue;
+      }
+      if (a.format == AUDIO_ASSET_WAV_ADPCM && !scanAdpcm.begin(a.channels, a.blockAlign)) {
+        scanFile.close();
+        assets[i].info.levels = true;
+        dirty = true;
+        continue;
+      }
+      scanIdx = i;
+      scanLoudness.begin(a.sampleRate);
+      scanLeft = a.dataBytes;
+      scanCount = 0;
+      scanSumSq = 0;
+      scanPeak = 0;
+    }
+    if (scanIdx < 0) {
+      if (dirty) save();
+      return;
+    }
+  }
+  scanStep();
+}
+
+bool AudioIndex::needsScan(const AudioAsset& a) {
+  const AudioAssetInfo& i = a.info;
+  bool pcm = i.format == AUDIO_ASSET_WAV || i.format == AUDIO_ASSET_WAV_ADPCM || i.format == AUDIO_ASSET_PCM;
+  return a.path.length() > 0 && pcm && !i.levels;
+}
+
+bool AudioIndex::busy() const {
+  if (!lock) return false;
+  IndexLock g(lock);
+  if (scanIdx >= 0 || dirty) return true;
+  for (const AudioAsset& a : assets) if (needsScan(a)) return true;
+  return false;
+}
+
+// Reads one chunk of the entry being scanned; false once it is done.
+bool AudioIndex::scanStep() {
+  AudioAssetInfo& a = assets[scanIdx].info;
+  bool adpcm = (a.format == AUDIO_ASSET_WAV_ADPCM);
+  size_t frame = adpcm ? scanAdpcm.unitBytes() : (size_t)a.channels * (a.bits / 8);
+  size_t want = min((uint32_t)(SCAN_CHUNK / frame * frame), scanLeft);
+  size_t got = want ? scanFile.read(scanIn, want) : 0;
+  got -= got % frame;
+
+  size_t n = 0;
+  if (adpcm) n = scanAdpcm.decode(scanIn, got / frame, scanOut);
+  else if (pcmToMono16(scanIn, scanOut, got / frame, a.channels, a.bits)) n = got / frame;
+  for (size_t i = 0; i < n; i++) {
+    int32_t s = scanOut[i];
+    uint32_t m = (uint32_t)(s < 0 ? -s : s);
+    if (m > scanPeak) scanPeak = (uint16_t)min(m, (uint32_t)32767);
+    scanSumSq += (uint64_t)(s * s);
+  }
+  scanLoudness.add(scanOut, n);
+  scanCount += (uint32_t)n;
+  scanLeft -= (uint32_t)got;
+  if (got > 0 && scanLeft > 0) return true;
+
+  a.levels = true;
+  a.peak = scanPeak;
+  a.rms = scanCount ? (uint16_t)sqrt((double)scanSumSq / scanCount) : 0;
+  a.loudness = scanLoudness.finish();
+  a.normGain = loudnessNormGain(a.loudness, a.peak);
+  stopScan();
+  dirty = true;
+  return false;
+}
+
+// Header line, then one entry per line, tab separated: path, size, format,
+// rate, channels, bits, block_align, data_offset, data_bytes, duration_ms,
+// levels, peak, rms, loudness, norm_gain. Another header means another
+// layout: begin() re-probes and the levels are measured again.
+void AudioIndex::load() {
+  for (AudioAsset& a : assets) a = AudioAsset();
+  File f = LittleFS.open(INDEX_PATH, "r");
+  if (!f) return;
+  if (f.readStringUntil('\n') != INDEX_HEADER) { f.close(); return; }
+
+  int n = 0;
+  while (f.available() && n < MAX_ASSETS) {
+    String line = f.readStringUntil('\n');
+    int tab = line.indexOf('\t');
+    if (tab <= 0) continue;
+    uint32_t v[INDEX_FIELDS];
+    int pos = tab + 1;
+    int k = 0;
+    for (; k < INDEX_FIELDS && pos <= (int)line.length(); k++) {
+      int next = line.indexOf('\t', pos);
+      if (next < 0) next = line.length();
+      v[k] = (uint32_t)strtoul(line.substring(pos, next).c_str(), nullptr, 10);
+      pos = next + 1;
+    }
+    if (k < INDEX_FIELDS) continue;
+
+    AudioAsset& a = assets[n++];
+    a.path = line.substring(0, tab);
+    a.info.size = v[0];
+    a.info.format = (uint8_t)v[1];
+    a.info.sampleRate = v[2];
+    a.info.channels = (uint8_t)v[3];
+    a.info.bits = (uint8_t)v[4];
+    a.info.blockAlign = (uint16_t)v[5];
+    a.info.dataOffset = v[6];
+    a.info.dataBytes = v[7];
+    a.info.durationMs = v[8];
+    a.info.levels = v[9] != 0;
+    a.info.peak = (uint16_t)v[10];
+    a.info.rms = (uint16_t)v[11];
+    a.info.loudness = (int16_t)(int32_t)v[12];
+    a.info.normGain = (uint16_t)v[13];
+  }
+  f.close();
+}
+
+void AudioIndex::save() {
+  File f = LittleFS.open(INDEX_PATH, "w");
+  if (!f) return;
+  f.print(String(INDEX_HEADER) + "\n");
+  for (const AudioAsset& a : assets) {
+    if (a.path.length() == 0) continue;
+    const AudioAssetInfo& i = a.info;
+    char line[128];
+    snprintf(line, sizeof(line), "\t%lu\t%u\t%lu\t%u\t%u\t%u\t%lu\t%lu\t%lu\t%u\t%u\t%u\t%d\t%u\n",
+             (unsigned long)i.size, i.format, (unsigned long)i.sampleRate, i.channels, i.bits, i.blockAlign,
+             (unsigned long)i.dataOffset, (unsigned long)i.dataBytes, (unsigned long)i.durationMs,
+             i.levels ? 1 : 0, i.peak, i.rms, i.loudness, i.normGain);
+    f.print(a.path + line);
+  }
+  f.close();
+  dirty = false;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <vector>
+#include "ima_adpcm.h"
+#include "loudness.h"
+
+enum AudioAssetFormat : uint8_t {
+  AUDIO_ASSET_UNKNOWN, AUDIO_ASSET_WAV, AUDIO_ASSET_WAV_ADPCM, AUDIO_ASSET_PCM, AUDIO_ASSET_MP3
+};
+const char* audioAssetFormatName(uint8_t format);
+
+// What the index knows about one file. For WAV/PCM the data offset and
+// layout are exact, so playback can seek straight to the samples. MP3
+// duration is estimated from the first frame's bitrate.
+struct AudioAssetInfo {
+  uint32_t size = 0;
+  uint8_t format = AUDIO_ASSET_UNKNOWN;
+  uint8_t channels = 0;
+  uint8_t bits = 0;
+  uint16_t blockAlign = 0;
+  uint32_t sampleRate = 0;
+  uint32_t dataOffset = 0;
+  uint32_t dataBytes = 0;
+  uint32_t durationMs = 0;
+  bool levels = false;   // peak/rms/loudness measured (not for MP3)
+  uint16_t peak = 0;     // of the mono mix, 0..32767
+  uint16_t rms = 0;
+  int16_t loudness = LoudnessMeter::NONE;   // integrated, 0.1 LUFS
+  uint16_t normGain = 0;                    // playback gain, Q12; 0 = none
+};
+
+struct AudioAsset {
+  String path;
+  AudioAssetInfo info;
+};
+
+// Index of /audio kept in flash, so listing files, resolving fallbacks and
+// starting playback need no directory scans or header parsing. Updated on
+// upload and delete; on boot it is checked once against the directory and
+// stale entries are probed again. Peak/RMS and loudness are measured
+// afterwards from loop(), a bounded number of bytes per call, and give the
+// normalization gain applied at playback.
+class AudioIndex {
+public:
+  static const int MAX_ASSETS = 64;
+
+  void begin();
+  bool lookup(const String& path, AudioAssetInfo& out) const;
+  bool contains(const String& path) const;
+  std::vector<AudioAsset> snapshot() const;
+  int count() const;
+
+  // Probes the file's header; levels are measured later by loop().
+  bool update(const String& path);
+  void remove(const String& path);
+  void loop();
+  // Work is left for loop(): a level scan or an unsaved change.
+  bool busy() const;
+
+private:
+  int find(const String& path) const;
+  int slotFor(const String& path);
+  static bool needsScan(const AudioAsset& a);
+  void stopScan();
+  bool scanStep();
+  void load();
+  void save();
+
+  AudioAsset assets[MAX_ASSETS];
+  SemaphoreHandle_t lock = nullptr;
+  bool dirty = false;
+
+  // Level scan of one entry at a time.
+  static const size_t SCAN_CHUNK = 1024;
+  int scanIdx = -1;
+  File scanFile;
+  uint32_t scanLeft = 0;
+  uint32_t scanCount = 0;
+  uint64_t scanSumSq = 0;
+  uint16_t scanPeak = 0;
+  LoudnessMeter scanLoudness;
+  ImaAdpcmDecoder scanAdpcm;
+  alignas(4) uint8_t scanIn[SCAN_CHUNK];
+  int16_t scanOut[SCAN_CHUNK * 2];
+};
+
+extern AudioIndex audioIndex;
@@ -0,0 +1,250 @@
+#include "audio_sink.h"
+
+#if defined(ARDUINO_ESP32_MAJOR) && (ARDUINO_ESP32_MAJOR >= 3)
+#include <driver/i2s_pdm.h>
+#else
+#include <driver/i2s.h>
+#endif
+
+static const int AUDIO_LEDC_CHANNEL = 0;
+static const int AUDIO_LEDC_RES_BITS = 8;
+static const uint32_t AUDIO_PWM_CARRIER_HZ = 100000;
+
+static const uint32_t PDM_TASK_STACK = 3072;
+static const UBaseType_t PDM_TASK_PRIO = 6;
+
+static void ledcInitCarrier(int pin, int channel, uint32_t freqHz, int resBits) {
+#if defined(ARDUINO_ESP32_MAJOR) && (ARDUINO_ESP32_MAJOR >= 3)
+  ledcAttachChannel(pin, freqHz, resBits, channel);
+#else
+  ledcSetup(channel, freqHz, resBits);
+  ledcAttachPin(pin, channel);
+#endif
+}
+
+static void ledcReleasePin(int pin) {
+#if defined(ARDUINO_ESP32_MAJOR) && (ARDUINO_ESP32_MAJOR >= 3)
+  ledcDetach(pin);
+#else
+  ledcDetachPin(pin);
+#endif
+}
+
+static void ledcWriteDuty(int pin, int channel, uint32_t duty) {
+#if defined(ARDUINO_ESP32_MAJOR) && (ARDUINO_ESP32_MAJOR >= 3)
+  ledcWrite(pin, duty);
+#else
+  ledcWrite(channel, duty);
+#endif
+}
+
+/* LEDC */
+bool LedcSink::begin(int sr, AudioPullFn fn, void* c) {
+  pull = fn;
+  ctx = c;
+  sampleRate = sr;
+  ledcInitCarrier(pin, AUDIO_LEDC_CHANNEL, AUDIO_PWM_CARRIER_HZ, AUDIO_LEDC_RES_BITS);
+  writeDutyMid();
+  if (!timer) {
+    esp_timer_create_args_t args {};
+    args.callback = &LedcSink::timerThunk;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "audio";
+    if (esp_timer_create(&args, &timer) != ESP_OK) { timer = nullptr; return false; }
+  }
+  return true;
+}
+
+void LedcSink::end() {
+  stop();
+  if (timer) { esp_timer_delete(timer); timer = nullptr; }
+  ledcReleasePin(pin);
+}
+
+void LedcSink::setSampleRate(int sr) {
+  sampleRate = sr;
+  if (timer && running) {
+    esp_timer_stop(timer);
+    esp_timer_start_periodic(timer, 1000000ULL / (uint64_t)sampleRate);
+  }
+}
+
+void LedcSink::start() {
+  if (!timer) return;
+  if (running) esp_timer_stop(timer);
+  dutyPos = BLOCK_SAMPLES;
+  running = true;
+  esp_timer_start_periodic(timer, 1000000ULL / (uint64_t)sampleRate);
+}
+
+void LedcSink::stop() {
+  running = false;
+  if (timer) esp_timer_stop(timer);
+  writeDutyMid();
+}
+
+void LedcSink::writeDutyMid() {
+  int maxDuty = (1 << AUDIO_LEDC_RES_BITS) - 1;
+  ledcWriteDuty(pin, AUDIO_LEDC_CHANNEL, maxDuty / 2);
+}
+
+void LedcSink::timerThunk(void* arg) { static_cast<LedcSink*>(arg)->onTick(); }
+
+void LedcSink::fillDutyBlock() {
+  pull(ctx, block, BLOCK_SAMPLES);
+  for (int i = 0; i < BLOCK_SAMPLES; i++) {
+    duty[i] = (uint16_t)(((uint16_t)block[i] ^ 0x8000) >> (16 - AUDIO_LEDC_RES_BITS));
+  }
+  dutyPos = 0;
+}
+
+void LedcSink::onTick() {
+  if (!running) { writeDutyMid(); return; }
+  if (dutyPos >= BLOCK_SAMPLES) fillDutyBlock();
+  ledcWriteDuty(pin, AUDIO_LEDC_CHANNEL, duty[dutyPos++]);
+}
+
+/* PDM */
+#if defined(ARDUINO_ESP32_MAJOR) && (ARDUINO_ESP32_MAJOR >= 3)
+
+bool PdmSink::begin(int sr, AudioPullFn fn, void* c) {
+  pull = fn;
+  ctx = c;
+  sampleRate = sr;
+
+  i2s_chan_config_t chanCfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+  chanCfg.dma_desc_num = DMA_BLOCKS;
+  chanCfg.dma_frame_num = BLOCK_SAMPLES;
+  chanCfg.auto_clear = true;
+  i2s_chan_handle_t tx = nullptr;
+  if (i2s_new_channel(&chanCfg, &tx, nullptr) != ESP_OK) return false;
+
+  i2s_pdm_tx_config_t cfg {};
+  cfg.clk_cfg = I2S_PDM_TX_CLK_DEFAULT_CONFIG((uint32_t)sampleRate);
+  cfg.slot_cfg = I2S_PDM_TX_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO);
+  cfg.gpio_cfg.clk = I2S_GPIO_UNUSED;
+  cfg.gpio_cfg.dout = (gpio_num_t)pin;
+  if (i2s_channel_init_pdm_tx_mode(tx, &cfg) != ESP_OK || i2s_channel_enable(tx) != ESP_OK) {
+    i2s_del_channel(tx);
+    return false;
+  }
+  chan = tx;
+
+  if (xTaskCreate(&PdmSink::taskThunk, "audio_out", PDM_TASK_STACK, this, PDM_TASK_PRIO, &task) != pdPASS) {
+    task = nullptr;
+    end();
+    return false;
+  }
+  return true;
+}
+
+void PdmSink::end() {
+  stop();
+  if (task) { vTaskDelete(task); task = nullptr; }
+  if (chan) {
+    i2s_chan_handle_t tx = (i2s_chan_handle_t)chan;
+    i2s_channel_disable(tx);
+    i2s_del_channel(tx);
+    chan = nullptr;
+  }
+}
+
+void PdmSink::setSampleRate(int sr) {
+  if (sr == sampleRate) return;
+  sampleRate = sr;
+  if (!chan) return;
+  i2s_chan_handle_t tx = (i2s_chan_handle_t)chan;
+  i2s_pdm_tx_clk_config_t clk = I2S_PDM_TX_CLK_DEFAULT_CONFIG((uint32_t)sampleRate);
+  i2s_channel_disable(tx);
+  i2s_channel_reconfig_pdm_tx_clock(tx, &clk);
+  i2s_channel_enable(tx);
+}
+
+bool PdmSink::writeBlock(const int16_t* buf, size_t n) {
+  size_t written = 0;
+  return i2s_channel_write((i2s_chan_handle_t)chan, buf, n * sizeof(int16_t), &written, portMAX_DELAY) == ESP_OK;
+}
+
+#else
+
+bool PdmSink::begin(int sr, AudioPullFn fn, void* c) {
+  pull = fn;
+  ctx = c;
+  sampleRate = sr;
+
+  i2s_config_t cfg {};
+  cfg.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_PDM);
+  cfg.sample_rate = sampleRate;
+  cfg.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  cfg.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  cfg.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  cfg.dma_buf_count = DMA_BLOCKS;
+  cfg.dma_buf_len = BLOCK_SAMPLES;
+  cfg.tx_desc_auto_clear = true;
+  if (i2s_driver_install(I2S_NUM_0, &cfg, 0, nullptr) != ESP_OK) return false;
+
+  i2s_pin_config_t pins {};
+  pins.mck_io_num = I2S_PIN_NO_CHANGE;
+  pins.bck_io_num = I2S_PIN_NO_CHANGE;
+  pins.ws_io_num = I2S_PIN_NO_CHANGE;
+  pins.data_out_num = pin;
+  pins.data_in_num = I2S_PIN_NO_CHANGE;
+  if (i2s_set_pin(I2S_NUM_0, &pins) != ESP_OK) { i2s_driver_uninstall(I2S_NUM_0); return false; }
+  chan = this;
+
+  if (xTaskCreate(&PdmSink::taskThunk, "audio_out", PDM_TASK_STACK, this, PDM_TASK_PRIO, &task) != pdPASS) {
+    task = nullptr;
+    end();
+    return false;
+  }
+  return true;
+}
+
+void PdmSink::end() {
+  stop();
+  if (task) { vTaskDelete(task); task = nullptr; }
+  if (chan) { i2s_driver_uninstall(I2S_NUM_0); chan = nullptr; }
+}
+
+void PdmSink::setSampleRate(int sr) {
+  if (sr == sampleRate) return;
+  sampleRate = sr;
+  if (chan) i2s_set_sample_rates(I2S_NUM_0, (uint32_t)sampleRate);
+}
+
+bool PdmSink::writeBlock(const int16_t* buf, size_t n) {
+  size_t written = 0;
+  return i2s_write(I2S_NUM_0, buf, n * sizeof(int16_t), &written, portMAX_DELAY) == ESP_OK;
+}
+
+#endif
+
+void PdmSink::start() {
+  if (!task) return;
+  idle = false;
+  running = true;
+  xTaskNotifyGive(task);
+}
+
+void PdmSink::stop() {
+  running = false;
+  // Wait for the writer to park so the caller can reset the source safely.
+  // auto_clear makes the DMA emit zeros (mid level) once it runs dry.
+  uint32_t start = millis();
+  while (task && !idle && (millis() - start) < 100) delay(1);
+}
+
+void PdmSink::taskThunk(void* arg) { static_cast<PdmSink*>(arg)->taskLoop(); }
+
+void PdmSink::taskLoop() {
+  for (;;) {
+    if (!running) {
+      idle = true;
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    pull(ctx, block, BLOCK_SAMPLES);
+    if (!writeBlock(block, BLOCK_SAMPLES)) vTaskDelay(1);
+  }
+}
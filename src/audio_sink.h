@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+
+// Fills dst with n samples ready for output (silence-padded on underrun) and
+// returns how many of them came from the source.
+typedef size_t (*AudioPullFn)(void* ctx, int16_t* dst, size_t n);
+
+enum AudioSinkKind : uint8_t { AUDIO_SINK_LEDC = 0, AUDIO_SINK_PDM = 1 };
+
+class AudioSink {
+public:
+  virtual ~AudioSink() {}
+  virtual const char* name() const = 0;
+  virtual bool begin(int sampleRate, AudioPullFn pull, void* ctx) = 0;
+  virtual void end() = 0;
+  virtual void setSampleRate(int sr) = 0;
+  virtual void start() = 0;
+  virtual void stop() = 0;
+};
+
+// Fallback: one LEDC duty update per sample from a periodic esp_timer.
+// Samples are pulled and converted to duty values a block at a time, so the
+// per-sample tick is a single table copy.
+class LedcSink : public AudioSink {
+public:
+  static const int BLOCK_SAMPLES = 32;
+
+  explicit LedcSink(int pin) : pin(pin) {}
+  const char* name() const override { return "ledc"; }
+  bool begin(int sampleRate, AudioPullFn pull, void* ctx) override;
+  void end() override;
+  void setSampleRate(int sr) override;
+  void start() override;
+  void stop() override;
+private:
+  static void timerThunk(void* arg);
+  void onTick();
+  void fillDutyBlock();
+  void writeDutyMid();
+
+  int pin;
+  int sampleRate = 16000;
+  AudioPullFn pull = nullptr;
+  void* ctx = nullptr;
+  volatile bool running = false;
+  esp_timer_handle_t timer = nullptr;
+  int16_t block[BLOCK_SAMPLES];
+  uint16_t duty[BLOCK_SAMPLES];
+  int dutyPos = BLOCK_SAMPLES;
+};
+
+// I2S in PDM TX mode: a writer task hands whole blocks to the DMA engine,
+// so the CPU wakes once per block instead of once per sample.
+class PdmSink : public AudioSink {
+public:
+  static const int BLOCK_SAMPLES = 256;
+  static const int DMA_BLOCKS = 4;
+
+  explicit PdmSink(int pin) : pin(pin) {}
+  const char* name() const override { return "pdm"; }
+  bool begin(int sampleRate, AudioPullFn pull, void* ctx) override;
+  void end() override;
+  void setSampleRate(int sr) override;
+  void start() override;
+  void stop() override;
+private:
+  static void taskThunk(void* arg);
+  void taskLoop();
+  bool writeBlock(const int16_t* buf, size_t n);
+
+  int pin;
+  int sampleRate = 16000;
+  AudioPullFn pull = nullptr;
+  void* ctx = nullptr;
+  volatile bool running = false;
+  volatile bool idle = true;
+  void* chan = nullptr;
+  TaskHandle_t task = nullptr;
+  int16_t block[BLOCK_SAMPLES];
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Audio pipeline telemetry, cheap enough to stay on in production.
+// Every field has exactly one writer (the producer task or the sink's
+// context) and is a 32-bit word, so no locks are needed: a reader on another
+// task may see a value one update old, but never a torn one.
+
+// Bucket i counts values in [2^i, 2^(i+1)); bucket 0 also takes 0 and the
+// last bucket takes everything above its lower bound.
+template <int N>
+struct Log2Histogram {
+  static const int BUCKETS = N;
+  volatile uint32_t count[N] = {};
+
+  void add(uint32_t v) {
+    int b = v ? 31 - __builtin_clz(v) : 0;
+    count[b < N ? b : N - 1]++;
+  }
+
+  uint32_t total() const {
+    uint32_t t = 0;
+    for (int i = 0; i < N; i++) t += count[i];
+    return t;
+  }
+
+  // Upper bound of the bucket holding the pct'th percentile, 0 if empty.
+  uint32_t percentile(uint32_t pct) const {
+    uint32_t t = total();
+    if (t == 0) return 0;
+    uint64_t want = ((uint64_t)t * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < N; i++) {
+      seen += count[i];
+      if (seen >= want) return (i >= 31) ? 0xFFFFFFFFu : ((uint32_t)2 << i) - 1;
+    }
+    return 0xFFFFFFFFu;
+  }
+};
+
+enum AudioSourceType : uint8_t {
+  AUDIO_SRC_WAV_FILE, AUDIO_SRC_PCM_FILE, AUDIO_SRC_MP3_FILE,
+  AUDIO_SRC_WAV_URL, AUDIO_SRC_MP3_URL, AUDIO_SRC_SYNTH, AUDIO_SRC_COUNT
+};
+
+inline const char* audioSourceTypeName(uint8_t t) {
+  static const char* names[AUDIO_SRC_COUNT] = { "wav_file", "pcm_file", "mp3_file", "wav_url", "mp3_url", "synth" };
+  return t < AUDIO_SRC_COUNT ? names[t] : "none";
+}
+
+struct AudioStats {
+  static const int HIST_BUCKETS = 16;
+  static const int FILL_BUCKETS = 9;   // ring fill in eighths, 0/8 .. 8/8
+
+  // Written from the sink's context, once per output block.
+  volatile uint32_t pulls = 0;
+  volatile uint32_t underrunEvents = 0;
+  volatile uint32_t underrunSamples = 0;
+  volatile uint32_t ringFillLast = 0;
+  volatile uint32_t ringFill[FILL_BUCKETS] = {};
+  Log2Histogram<HIST_BUCKETS> pullJitterUs;   // |interval - block duration|
+
+  // Written from the producer task.
+  volatile uint32_t decodeBlocks = 0;
+  Log2Histogram<HIST_BUCKETS> decodeUs;       // one WAV/PCM block or MP3 frame
+  volatile uint32_t sourceBytes[AUDIO_SRC_COUNT] = {};
+  volatile uint32_t starts = 0;
+  volatile uint32_t firstSampleLastMs = 0;
+  Log2Histogram<HIST_BUCKETS> firstSampleMs;  // play command to first sample in the ring
+};
+
+extern AudioStats audioStats;
@@ -0,0 +1,775 @@
+#include "audio_voice.h"
+#include "pcm_convert.h"
+#include "native_pcm.h"
+#include "libhelix-mp3/mp3dec.h"
+#include <base64.h>
+#include <strings.h>
+
+static const int SR_MIN = 8000;
+static const int SR_MAX = 48000;
+static const int RESAMPLE_REPORT_BLOCK = 256;
+
+static const uint32_t MP3_PRIME_TIMEOUT_MS = 3000;
+static const int MP3_PRIME_STEP_FILLS = 4;
+static const int WAV_MAX_CHUNKS = 16;
+static const size_t NET_BURST_BYTES = 8192;
+static const uint32_t HTTP_HEADER_MAX_BYTES = 8192;
+
+bool AudioHttpStream::connect(const String& u, uint32_t timeoutMs) {
+  stop();
+  String lower = u; lower.toLowerCase();
+  bool secure = lower.startsWith("https://");
+  if (!secure && !lower.startsWith("http://")) return false;
+
+  int hostStart = u.indexOf("://") + 3;
+  int pathStart = u.indexOf('/', hostStart);
+  String host = u.substring(hostStart, pathStart < 0 ? u.length() : pathStart);
+  path = pathStart < 0 ? String("/") : u.substring(pathStart);
+  int at = host.lastIndexOf('@');
+  userInfo = at >= 0 ? host.substring(0, at) : String();
+  if (at >= 0) host = host.substring(at + 1);
+  hostHeader = host;
+  uint16_t port = secure ? 443 : 80;
+  int colon = host.lastIndexOf(':');
+  if (colon >= 0) {
+    port = (uint16_t)host.substring(colon + 1).toInt();
+    host = host.substring(0, colon);
+  }
+  if (host.length() == 0 || port == 0) return false;
+
+  // The timeout overloads are not virtual, so call them on the real type.
+  if (secure) {
+    WiFiClientSecure* s = new WiFiClientSecure();
+    s->setInsecure();
+    client = s;
+    return s->connect(host.c_str(), port, (int32_t)timeoutMs) > 0;
+  }
+  client = new WiFiClient();
+  return client->connect(host.c_str(), port, (int32_t)timeoutMs) > 0;
+}
+
+// The same request HTTPClient would send, without keep-alive. Only the
+// headers are parsed here; the body, chunked or not, is read raw from the
+// socket.
+bool AudioHttpStream::sendRequest() {
+  if (!client) return false;
+  String req = "GET " + path + " HTTP/1.1\r\nHost: " + hostHeader + "\r\n"
+               "User-Agent: ESP32HTTPClient\r\nConnection: close\r\n"
+               "Accept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\nIcy-MetaData: 1\r\n";
+  if (userInfo.length()) req += "Authorization: Basic " + base64::encode(userInfo) + "\r\n";
+  req += "\r\n";
+  status = 0;
+  headerBytes = 0;
+  lineLen = 0;
+  chunked = false;
+  icyMetaInt = 0;
+  contentType = "";
+  return client->write((const uint8_t*)req.c_str(), req.length()) == req.length();
+}
+
+// Takes header bytes one at a time so the body stays in the socket.
+// SHOUTcast servers answer "ICY 200 OK" instead of "HTTP/1.x 200 OK".
+int AudioHttpStream::pollResponse() {
+  if (!client) return -1;
+  while (client->available() > 0) {
+    int c = client->read();
+    if (c < 0) break;
+    if (++headerBytes > HTTP_HEADER_MAX_BYTES) return -1;
+    if (c == '\r') continue;
+    if (c != '\n') {
+      if (lineLen < sizeof(line) - 1) line[lineLen++] = (char)c;
+      continue;
+    }
+    line[lineLen] = 0;
+    bool blank = lineLen == 0;
+    lineLen = 0;
+    if (status == 0) {
+      const char* sp = strchr(line, ' ');
+      if ((strncmp(line, "HTTP/", 5) != 0 && strncmp(line, "ICY ", 4) != 0) || !sp) return -1;
+      status = atoi(sp + 1);
+      if (status <= 0) return -1;
+    } else if (blank) {
+      return status;
+    } else {
+      parseHeader(line);
+    }
+  }
+  return client->connected() ? 0 : -1;
+}
+
+void AudioHttpStream::parseHeader(char* h) {
+  char* v = strchr(h, ':');
+  if (!v) return;
+  *v++ = 0;
+  while (*v == ' ' || *v == '\t') v++;
+  for (char* p = v; *p; p++) *p = (char)tolower((unsigned char)*p);
+  if (strcasecmp(h, "Transfer-Encoding") == 0) {
+    chunked = strstr(v, "chunked") != nullptr;
+  } else if (strcasecmp(h, "icy-metaint") == 0) {
+    long metaInt = atol(v);
+    icyMetaInt = metaInt > 0 ? (uint32_t)metaInt : 0;
+  } else if (strcasecmp(h, "Content-Type") == 0) {
+    contentType = v;
+  }
+}
+
+void AudioHttpStream::stop() {
+  if (client) { client->stop(); delete client; client = nullptr; }
+}
+
+// Sets the source rate; the mixer always runs at AUDIO_OUTPUT_RATE.
+bool AudioVoice::setSampleRate(int sr) {
+  if (sr < SR_MIN || sr > SR_MAX) return false;
+  sourceRate = sr;
+  resampler.configure((uint32_t)sourceRate, (uint32_t)AUDIO_OUTPUT_RATE);
+  resampleCycles = resampleSamples = 0;
+  return true;
+}
+
+uint32_t AudioVoice::decodeCyclesPerSecond() const {
+  if (decodeFrames == 0) return 0;
+  return (uint32_t)((decodeCycles * (uint64_t)sourceRate) / decodeFrames);
+}
+
+// Average resampler cost per 256 output samples (one PDM DMA block).
+uint32_t AudioVoice::resampleCyclesPerBlock() const {
+  if (resampleSamples == 0) return 0;
+  return (uint32_t)((resampleCycles * RESAMPLE_REPORT_BLOCK) / resampleSamples);
+}
+
+void AudioVoice::stop() {
+  playing = false;
+  if (stream) {
+    stream->stop();
+    delete stream;
+    stream = nullptr;
+  }
+  if (net) net->reset();
+  startPending = false;
+  mp3Priming = false;
+  netBuffering = false;
+  netEnded = false;
+  if (file) file.close();
+  pendPos = pendCount = 0;
+  mp3InFilled = 0;
+  resampler.reset();
+}
+
+void AudioVoice::prepare(const String& t, uint8_t v, uint16_t fadeInSec) {
+  stop();
+  gain.reset(v, (uint32_t)fadeInSec * AUDIO_OUTPUT_RATE);
+  inputEnded = false;
+  volumePct = v;
+  played = 0;
+  loopCfg = AudioLoop();
+  maxSamples = 0;
+  loops = 0;
+  dataOffset = dataBytes = 0;
+  rewindAtEof = false;
+  lastErr = "";
+  sourceKind = "";
+  sourceType = AUDIO_SRC_COUNT;
+  strlcpy(targetName, t.c_str(), sizeof(targetName));
+}
+
+void AudioVoice::setLoop(const AudioLoop& l) {
+  loopCfg = l;
+  maxSamples = (uint32_t)(((uint64_t)l.maxMs * AUDIO_OUTPUT_RATE) / 1000);
+  if (sourceType == AUDIO_SRC_SYNTH) synth.setCycleLimit(l.enabled ? 0 : SYNTH_ONESHOT_CYCLES);
+}
+
+bool AudioVoice::startLocal(const String& path, uint8_t vol, uint16_t fadeInSec, const AudioAssetInfo* asset) {
+  prepare(path, vol, fadeInSec);
+
+  String p = path;
+  if (!p.startsWith("/")) p = "/" + p;
+  File f = LittleFS.open(p, "r");
+  if (!f) { lastErr = "file_not_found"; return false; }
+  file = f;
+
+  // The loudness trim is trusted only while the entry matches the file.
+  String lp = p; lp.toLowerCase();
+  bool indexed = asset && (lp.endsWith(".wav") || lp.endsWith(".pcm")) && applyAsset(*asset);
+  if (indexed && asset->normGain) gain.reset(vol, (uint32_t)fadeInSec * AUDIO_OUTPUT_RATE, asset->normGain);
+
+  if (lp.endsWith(".wav")) {
+    if (!indexed && !wavReadHeader()) { file.close(); return false; }
+    sourceKind = "wav_file";
+    sourceType = AUDIO_SRC_WAV_FILE;
+    playing = true;
+    return true;
+  }
+
+  if (lp.endsWith(".pcm")) {
+    if (!indexed && !pcmReadHeader()) { file.close(); return false; }
+    sourceKind = "pcm_file";
+    sourceType = AUDIO_SRC_PCM_FILE;
+    playing = true;
+    return true;
+  }
+
+  if (lp.endsWith(".mp3")) {
+    sourceKind = "mp3_file";
+    sourceType = AUDIO_SRC_MP3_FILE;
+    rewindAtEof = true;
+    if (!mp3Begin()) { stop(); return false; }
+    // Primed from pollStart(), one bounded step per producer pass.
+    startPending = true;
+    mp3Priming = true;
+    startBeganMs = millis();
+    return true;
+  }
+
+  file.close();
+  lastErr = "unsupported_ext";
+  return false;
+}
+
+// Needs nothing but the sine table, so it starts instantly and cannot fail;
+// this is the alarm sound of last resort.
+bool AudioVoice::startSynth(uint8_t pattern, uint16_t baseHz, uint8_t vol, uint16_t fadeInSec) {
+  prepare(synthPatternName(pattern), vol, fadeInSec);
+  setSampleRate(AUDIO_OUTPUT_RATE);
+  synth.start(pattern, baseHz, AUDIO_OUTPUT_RATE, SYNTH_ONESHOT_CYCLES);
+  sourceKind = "synth";
+  sourceType = AUDIO_SRC_SYNTH;
+  playing = true;
+  return true;
+}
+
+void AudioVoice::startStream(AudioHttpStream* s, const String& url, uint8_t vol, uint16_t fadeInSec,
+                             uint32_t netStart, uint32_t netLow, uint32_t prebuffer) {
+  prepare(url, vol, fadeInSec);
+  stream = s;
+  netStartBytes = netStart;
+  netLowBytes = netLow;
+  String u = url; u.toLowerCase();
+  if (u.indexOf(".mp3") > 0) sourceType = AUDIO_SRC_MP3_URL;
+  else sourceType = AUDIO_SRC_WAV_URL;
+  urlGuess = u.indexOf(".wav") <= 0 && u.indexOf(".mp3") <= 0;
+  // Radio streams rarely name a format in the URL; the content type does.
+  if (urlGuess && s) {
+    if (s->contentType.indexOf("mpeg") >= 0 || s->contentType.indexOf("mp3") >= 0) {
+      sourceType = AUDIO_SRC_MP3_URL;
+      urlGuess = false;
+    } else if (s->contentType.indexOf("wav") >= 0) {
+      urlGuess = false;
+    }
+  }
+  if (s) body.begin(s->chunked, s->icyMetaInt);
+  if (!net) net = new SpscRing<uint8_t, AUDIO_NET_BUFFER_BYTES>();
+  netBuffering = true;
+  startPending = true;
+  startBeganMs = millis();
+  prebufferMs = prebuffer;
+}
+
+// Called from the producer loop until it settles. A stream first waits for
+// the start watermark; one that ends (or stalls) first still plays whatever
+// arrived, only an empty one fails. The header is then parsed from the
+// buffer. MP3, file or stream, is then primed one step per call and stays
+// silent until its first frame has decoded.
+int AudioVoice::pollStart() {
+  if (!startPending) return playing ? 1 : -1;
+  if (!mp3Priming) {
+    if (!net) { stop(); lastErr = "net_no_memory"; return -1; }
+    netPump();
+    if (netBuffering && (millis() - startBeganMs) < prebufferMs) return 0;
+    netBuffering = false;
+    if (net->size() == 0) { stop(); lastErr = "http_no_data"; return -1; }
+
+    if (sourceType == AUDIO_SRC_MP3_URL) {
+      sourceKind = "mp3_url";
+      if (!mp3Begin()) { stop(); return -1; }
+      mp3Priming = true;
+      startBeganMs = millis();
+    } else if (!wavReadHeader()) {
+      if (urlGuess) lastErr = "unknown_url_format";
+      stop();
+      return -1;
+    } else {
+      sourceKind = urlGuess ? "wav_url_guess" : "wav_url";
+    }
+  }
+  if (mp3Priming) {
+    int r = mp3PrimeStep();
+    if (r == 0) return 0;
+    if (r < 0) { stop(); return -1; }
+    mp3Priming = false;
+  }
+  startPending = false;
+  playing = true;
+  return 1;
+}
+
+// Resamples and gains n source-rate samples into the pending buffer, which
+// must be empty; n <= resampler.maxInput(PEND_CAP).
+void AudioVoice::emitPcm(const int16_t* pcm, size_t n) {
+  size_t m = n;
+  if (resampler.passthrough()) {
+    memcpy(pend, pcm, n * sizeof(int16_t));
+  } else {
+    uint32_t c0 = ESP.getCycleCount();
+    m = resampler.process(pcm, n, pend);
+    resampleCycles += ESP.getCycleCount() - c0;
+    resampleSamples += m;
+  }
+  gain.process(pend, m);
+  pendPos = 0;
+  pendCount = (int)m;
+}
+
+size_t AudioVoice::read(int16_t* dst, size_t n) {
+  if (!playing) return 0;
+  if (maxSamples) {
+    if (played >= maxSamples) {
+      inputEnded = true;
+      pendPos = pendCount = 0;
+      return 0;
+    }
+    n = min(n, (size_t)(maxSamples - played));
+  }
+  size_t got = 0;
+  while (got < n) {
+    if (pendPos < pendCount) {
+      size_t k = min(n - got, (size_t)(pendCount - pendPos));
+      memcpy(dst + got, pend + pendPos, k * sizeof(int16_t));
+      pendPos += (int)k;
+      got += k;
+      continue;
+    }
+    size_t direct = 0;
+    uint32_t t0 = micros();
+    bool ok = decodeNext(dst + got, n - got, direct);
+    if (!ok) break;
+    audioStats.decodeUs.add(micros() - t0);
+    audioStats.decodeBlocks++;
+    got += direct;
+  }
+  played += (uint32_t)got;
+  return got;
+}
+
+// Decodes the next chunk, either straight into dst (direct samples) or into
+// the pending buffer. False when nothing could be done right now.
+bool AudioVoice::decodeNext(int16_t* dst, size_t cap, size_t& direct) {
+  switch (sourceType) {
+    case AUDIO_SRC_SYNTH: return fillSynth(dst, cap, direct);
+    case AUDIO_SRC_MP3_FILE:
+    case AUDIO_SRC_MP3_URL: return fillMp3();
+    default: return fillWav(dst, cap, direct);
+  }
+}
+
+bool AudioVoice::readBytes(File& f, uint8_t* buf, size_t n) {
+  size_t r = f.read(buf, n);
+  return r == n;
+}
+
+// Reads what the jitter buffer holds after one pump; never waits. Headers
+// are only parsed once the start watermark is reached (or the stream ended),
+// so a short read means the bytes are not coming.
+size_t AudioVoice::readBytesNet(uint8_t* buf, size_t n) {
+  netPump();
+  return net->read(buf, n);
+}
+
+// Drains the socket into the jitter buffer in one burst (bounded per call so
+// the main loop keeps running) and ends rebuffering once enough is queued.
+// The body reader drops chunk framing and ICY metadata on the way.
+void AudioVoice::netPump() {
+  if (!net || !stream || !stream->client) return;
+  WiFiClient& s = *stream->client;
+  size_t moved = 0;
+  while (!netEnded && moved < NET_BURST_BYTES) {
+    uint8_t* dst;
+    size_t span = net->writeSpan(&dst);
+    if (span == 0) break;
+    size_t r = body.read(s, dst, span);
+    if (r == 0) {
+      if (body.ended() || (s.available() <= 0 && !s.connected())) netEnded = true;
+      break;
+    }
+    net->commitWrite(r);
+    moved += r;
+  }
+  if (netBuffering && (netEnded || net->size() >= netStartBytes)) netBuffering = false;
+}
+
+uint32_t AudioVoice::readLE32(const uint8_t* b) {
+  return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+uint16_t AudioVoice::readLE16(const uint8_t* b) {
+  return (uint16_t)b[0] | ((uint16_t)b[1] << 8);
+}
+
+bool AudioVoice::readExact(uint8_t* buf, size_t n) {
+  if (file) return readBytes(file, buf, n);
+  if (stream && stream->client) return readBytesNet(buf, n) == n;
+  return false;
+}
+
+bool AudioVoice::skipExact(uint32_t n) {
+  if (file) return file.seek(file.position() + n);
+  uint8_t tmp[64];
+  while (n > 0) {
+    size_t k = min(n, (uint32_t)sizeof(tmp));
+    if (!readExact(tmp, k)) return false;
+    n -= (uint32_t)k;
+  }
+  return true;
+}
+
+// Walks the RIFF chunks up to "data", skipping LIST/fact/etc. and accepting
+// WAVE_FORMAT_EXTENSIBLE when its subformat is PCM.
+bool AudioVoice::wavReadHeader() {
+  wavOk = false;
+  wavAdpcm = false;
+  wavInPos = wavInFilled = 0;
+  if (!file && !(stream && stream->client)) { lastErr = "wav_stream_null"; return false; }
+
+  uint8_t h[12];
+  if (!readExact(h, 12)) { lastErr = "wav_header_read_fail"; return false; }
+  if (memcmp(h, "RIFF", 4) != 0) { lastErr = "wav_not_riff"; return false; }
+  if (memcmp(h + 8, "WAVE", 4) != 0) { lastErr = "wav_not_wave"; return false; }
+
+  bool haveFmt = false;
+  for (int i = 0; i < WAV_MAX_CHUNKS; i++) {
+    if (!readExact(h, 8)) break;
+    uint32_t size = readLE32(h + 4);
+    uint32_t pad = size & 1;
+
+    if (memcmp(h, "fmt ", 4) == 0) {
+      uint8_t fmt[40];
+      if (size < 16) { lastErr = "wav_no_fmt"; return false; }
+      uint32_t take = min(size, (uint32_t)sizeof(fmt));
+      if (!readExact(fmt, take) || !skipExact(size - take + pad)) { lastErr = "wav_header_read_fail"; return false; }
+      if (!wavParseFmt(fmt, take)) return false;
+      haveFmt = true;
+    } else if (memcmp(h, "data", 4) == 0) {
+      if (!haveFmt) { lastErr = "wav_no_fmt"; return false; }
+      wavDataRemaining = size;
+      if (file) { dataOffset = (uint32_t)file.position(); dataBytes = size; }
+      wavOk = true;
+      return true;
+    } else if (!skipExact(size + pad)) {
+      break;
+    }
+  }
+  lastErr = haveFmt ? "wav_no_data" : "wav_no_fmt";
+  return false;
+}
+
+bool AudioVoice::wavParseFmt(const uint8_t* fmt, uint32_t len) {
+  uint16_t audioFmt = readLE16(fmt);
+  if (audioFmt == 0xFFFE && len >= 26) audioFmt = readLE16(fmt + 24);
+  return wavSetFormat(audioFmt, readLE16(fmt + 2), readLE32(fmt + 4), readLE16(fmt + 14), readLE16(fmt + 12));
+}
+
+bool AudioVoice::wavSetFormat(uint16_t audioFmt, uint16_t channels, uint32_t rate, uint16_t bits, uint16_t blockAlign) {
+  wavAdpcm = false;
+  wavChannels = channels;
+  wavSampleRate = rate;
+  wavBits = bits;
+
+  if (audioFmt == IMA_ADPCM_FORMAT_TAG) {
+    if (wavBits != 4 || blockAlign > WAV_READ_BYTES || !adpcm.begin(wavChannels, blockAlign)) {
+      lastErr = "wav_adpcm_unsupported";
+      return false;
+    }
+    if (!setSampleRate((int)wavSampleRate)) { lastErr = "wav_rate_unsupported"; return false; }
+    wavAdpcm = true;
+    return true;
+  }
+  if (audioFmt != 1) { lastErr = "wav_not_pcm"; return false; }
+  if (wavBits != 8 && wavBits != 16 && wavBits != 24) { lastErr = "wav_bits_unsupported"; return false; }
+  if (wavChannels < 1 || wavChannels > 2) { lastErr = "wav_channels_bad"; return false; }
+  if (!setSampleRate((int)wavSampleRate)) { lastErr = "wav_rate_unsupported"; return false; }
+  return true;
+}
+
+// The index entry is trusted only while the file has the size it had when
+// it was probed; anything else falls back to reading the header.
+bool AudioVoice::applyAsset(const AudioAssetInfo& a) {
+  if (a.format != AUDIO_ASSET_WAV && a.format != AUDIO_ASSET_WAV_ADPCM && a.format != AUDIO_ASSET_PCM) return false;
+  if ((uint32_t)file.size() != a.size) return false;
+  wavOk = false;
+  wavInPos = wavInFilled = 0;
+  uint16_t tag = (a.format == AUDIO_ASSET_WAV_ADPCM) ? IMA_ADPCM_FORMAT_TAG : 1;
+  if (!wavSetFormat(tag, a.channels, a.sampleRate, a.bits, a.blockAlign) || !file.seek(a.dataOffset)) {
+    file.seek(0);
+    return false;
+  }
+  wavDataRemaining = dataBytes = a.dataBytes;
+  dataOffset = a.dataOffset;
+  wavOk = true;
+  return true;
+}
+
+// Native files go through the WAV block reader as mono 8/16-bit data that is
+// already at the output rate, so fillWav() reduces to a copy into the ring.
+bool AudioVoice::pcmReadHeader() {
+  wavOk = false;
+  wavAdpcm = false;
+  wavInPos = wavInFilled = 0;
+  uint8_t h[NATIVE_PCM_HEADER_BYTES];
+  NativePcmInfo info;
+  if (!readExact(h, sizeof(h))) { lastErr = "pcm_header_read_fail"; return false; }
+  if (!nativePcmParseHeader(h, info)) { lastErr = "pcm_bad_header"; return false; }
+  if (!setSampleRate((int)info.sampleRate)) { lastErr = "pcm_rate_unsupported"; return false; }
+  wavChannels = 1;
+  wavBits = info.bits;
+  wavSampleRate = info.sampleRate;
+  wavDataRemaining = info.samples * (info.bits / 8);
+  dataOffset = (uint32_t)file.position();
+  dataBytes = wavDataRemaining;
+  wavOk = true;
+  return true;
+}
+
+// Moves the partial frame left in wavIn to the front and tops the buffer up.
+// File reads are sized so that after the header every read starts on a
+// LittleFS block boundary and covers one whole block.
+void AudioVoice::wavRefill() {
+  int keep = wavInFilled - wavInPos;
+  if (keep > 0) memmove(wavIn, wavIn + wavInPos, keep);
+  wavInPos = 0;
+  wavInFilled = keep;
+
+  uint32_t want = WAV_READ_BYTES;
+  if (file) want -= file.position() % WAV_READ_BYTES;
+  if (want > wavDataRemaining) want = wavDataRemaining;
+  size_t got = readSource(wavIn + keep, want);
+  wavInFilled += (int)got;
+  wavDataRemaining -= (uint32_t)got;
+}
+
+bool AudioVoice::fillWav(int16_t* out, size_t cap, size_t& direct) {
+  if (!wavOk) { lastErr = "wav_not_ready"; inputEnded = true; return false; }
+
+  size_t bytesPerFrame = wavAdpcm ? adpcm.unitBytes() : (size_t)wavChannels * (wavBits / 8);
+  if ((size_t)(wavInFilled - wavInPos) < bytesPerFrame) {
+    if (wavDataRemaining == 0) {
+      // A partial frame left at the end of the data is dropped on rewind.
+      if (rewind()) wavInPos = wavInFilled = 0;
+      else inputEnded = true;
+    }
+    if (inputEnded) return false;
+    wavRefill();
+    if ((size_t)(wavInFilled - wavInPos) < bytesPerFrame) return false;
+  }
+
+  const uint8_t* src = wavIn + wavInPos;
+  size_t frames = (size_t)(wavInFilled - wavInPos) / bytesPerFrame;
+
+  // ADPCM units expand to up to 8 samples each, so they always go through
+  // the stage and the pending buffer.
+  if (wavAdpcm) {
+    int16_t stage[WAV_STAGE_FRAMES];
+    size_t room = min(resampler.maxInput(PEND_CAP), (size_t)WAV_STAGE_FRAMES) / 8;
+    if (room == 0) return false;
+    size_t units = min(frames, room);
+    emitPcm(stage, adpcm.decode(src, units, stage));
+    wavInPos += (int)(units * bytesPerFrame);
+    return true;
+  }
+  bool native = (wavChannels == 1 && wavBits == 16);
+
+  // At the output rate, convert straight into the caller's buffer.
+  // Otherwise mono 16-bit goes to the resampler from the read buffer as is,
+  // and other layouts are converted a block at a time on the stack.
+  int16_t stage[WAV_STAGE_FRAMES];
+  size_t room;
+  if (resampler.passthrough()) room = cap;
+  else if (native) room = resampler.maxInput(PEND_CAP);
+  else room = min(resampler.maxInput(PEND_CAP), (size_t)WAV_STAGE_FRAMES);
+  if (room == 0) return false;
+
+  size_t n = min(frames, room);
+  // Whole groups of four frames keep wavInPos word-aligned for the kernels.
+  if (n < frames && n >= 4) n &= ~(size_t)3;
+
+  if (resampler.passthrough()) {
+    pcmToMono16(src, out, n, wavChannels, wavBits);
+    gain.process(out, n);
+    direct = n;
+  } else if (native) {
+    emitPcm((const int16_t*)src, n);
+  } else {
+    pcmToMono16(src, stage, n, wavChannels, wavBits);
+    emitPcm(stage, n);
+  }
+  wavInPos += (int)(n * bytesPerFrame);
+  return true;
+}
+
+size_t AudioVoice::readSource(uint8_t* buf, size_t n) {
+  if (file) {
+    size_t r = file.read(buf, n);
+    // MP3 frames are self-delimiting, so the next pass just follows on.
+    if (r == 0 && rewindAtEof && rewind()) r = file.read(buf, n);
+    if (r == 0) inputEnded = true;
+    if (sourceType < AUDIO_SRC_COUNT) audioStats.sourceBytes[sourceType] += (uint32_t)r;
+    return r;
+  }
+  if (stream && stream->client) {
+    if (netBuffering) return 0;
+    size_t r = net->read(buf, n);
+    if (sourceType < AUDIO_SRC_COUNT) audioStats.sourceBytes[sourceType] += (uint32_t)r;
+    if (netEnded) {
+      if (r == 0) inputEnded = true;
+    } else if (net->size() < netLowBytes) {
+      netBuffering = true;
+    }
+    return r;
+  }
+  inputEnded = true;
+  return 0;
+}
+
+// Seeks back to the start of the audio data for the next loop pass. Only
+// local files can loop this way; URL voices are restarted by the player.
+bool AudioVoice::rewind() {
+  if (!loopCfg.enabled || !file) return false;
+  if (dataBytes == 0 && !rewindAtEof) return false;
+  if (maxSamples && played >= maxSamples) return false;
+  if (!file.seek(dataOffset)) return false;
+  wavDataRemaining = dataBytes;
+  adpcm.reset();
+  nextPass();
+  return true;
+}
+
+void AudioVoice::nextPass() {
+  loops++;
+  if (loopCfg.crescendo && volumePct < 100) {
+    volumePct = (uint8_t)min(100, volumePct + loopCfg.crescendo);
+    gain.setVolume(volumePct);
+  }
+}
+
+// Synthesized straight at the output rate into the caller's buffer.
+bool AudioVoice::fillSynth(int16_t* out, size_t cap, size_t& direct) {
+  if (synth.done()) { inputEnded = true; return false; }
+  uint32_t before = synth.cyclesDone();
+  size_t n = synth.render(out, cap);
+  gain.process(out, n);
+  direct = n;
+  if (loopCfg.enabled && synth.cyclesDone() != before) nextPass();
+  return n > 0;
+}
+
+bool AudioVoice::mp3Begin() {
+  if (!mp3dec) mp3dec = MP3InitDecoder();
+  if (!mp3Pcm) mp3Pcm = new int16_t[MP3_MAX_PCM];
+  if (!mp3dec || !mp3Pcm) { lastErr = "mp3_no_memory"; return false; }
+  mp3InFilled = 0;
+  mp3Hz = 0;
+  mp3SkipBytes = 0;
+  mp3TagChecked = false;
+  mp3Resyncs = 0;
+  decodeCycles = decodeFrames = 0;
+  return true;
+}
+
+// Decodes towards the first frame so the output starts at the right rate:
+// a few reads per call (an ID3 tag is skipped 2 KB at a time), never a wait.
+// 1 once primed, 0 to be called again, -1 if no frame turned up in time.
+int AudioVoice::mp3PrimeStep() {
+  netPump();
+  bool stalled = false;
+  for (int i = 0; i < MP3_PRIME_STEP_FILLS && mp3Hz == 0 && !stalled; i++) stalled = !fillMp3();
+  if (mp3Hz) return 1;
+  if ((stalled && inputEnded) || (millis() - startBeganMs) >= MP3_PRIME_TIMEOUT_MS) {
+    lastErr = "mp3_no_frame";
+    return -1;
+  }
+  return 0;
+}
+
+bool AudioVoice::fillMp3() {
+  if (pendPos < pendCount) return false;
+
+  if (!inputEnded && mp3InFilled < MP3_MAX_FRAME_BYTES) {
+    mp3InFilled += (int)readSource(mp3In + mp3InFilled, sizeof(mp3In) - mp3InFilled);
+  }
+
+  // Skip an ID3v2 tag; its payload (e.g. cover art) is full of false syncs.
+  if (!mp3TagChecked && mp3InFilled >= 10) {
+    mp3TagChecked = true;
+    if (memcmp(mp3In, "ID3", 3) == 0) {
+      mp3SkipBytes = 10 + (((uint32_t)(mp3In[6] & 0x7F) << 21) | ((uint32_t)(mp3In[7] & 0x7F) << 14) |
+                           ((uint32_t)(mp3In[8] & 0x7F) << 7) | (uint32_t)(mp3In[9] & 0x7F));
+      if (mp3In[5] & 0x10) mp3SkipBytes += 10;
+    }
+    // The tag is only skipped once; later passes start after it.
+    if (file) dataOffset = mp3SkipBytes;
+  }
+  if (mp3SkipBytes > 0) {
+    int n = (int)min((uint32_t)mp3InFilled, mp3SkipBytes);
+    memmove(mp3In, mp3In + n, mp3InFilled - n);
+    mp3InFilled -= n;
+    mp3SkipBytes -= (uint32_t)n;
+    return n > 0;
+  }
+  if (!mp3TagChecked && !inputEnded) return false;
+  if (mp3InFilled == 0) return false;
+
+  int off = MP3FindSyncWord(mp3In, mp3InFilled);
+  if (off < 0) {
+    // Keep a possible partial sync word at the tail.
+    int keep = inputEnded ? 0 : min(mp3InFilled, 1);
+    bool progressed = mp3InFilled > keep;
+    memmove(mp3In, mp3In + mp3InFilled - keep, keep);
+    mp3InFilled = keep;
+    mp3Resyncs++;
+    return progressed && !inputEnded;
+  }
+  if (off > 0) {
+    memmove(mp3In, mp3In + off, mp3InFilled - off);
+    mp3InFilled -= off;
+    mp3Resyncs++;
+  }
+
+  unsigned char* p = mp3In;
+  int left = mp3InFilled;
+  uint32_t c0 = ESP.getCycleCount();
+  int err = MP3Decode((HMP3Decoder)mp3dec, &p, &left, mp3Pcm, 0);
+  uint32_t cycles = ESP.getCycleCount() - c0;
+
+  if (err == ERR_MP3_INDATA_UNDERFLOW) {
+    if (inputEnded) { mp3InFilled = 0; return false; }
+    if (mp3InFilled < (int)sizeof(mp3In)) return false;
+    left = mp3InFilled - 1;
+  } else if (err == ERR_MP3_MAINDATA_UNDERFLOW) {
+    // Frame parsed, bit reservoir not filled yet (stream start or after a resync).
+  } else if (err != ERR_MP3_NONE) {
+    // Corrupt frame: step past this sync word and hunt for the next one.
+    left = mp3InFilled - 1;
+    mp3Resyncs++;
+  } else {
+    MP3FrameInfo info;
+    MP3GetLastFrameInfo((HMP3Decoder)mp3dec, &info);
+    int samples = info.outputSamps;
+    if (info.nChans == 2) {
+      samples /= 2;
+      for (int i = 0; i < samples; i++) {
+        mp3Pcm[i] = (int16_t)(((int32_t)mp3Pcm[2 * i] + (int32_t)mp3Pcm[2 * i + 1]) >> 1);
+      }
+    }
+    if (mp3Hz == 0) {
+      // All MPEG-1/2/2.5 rates fall inside the resampler's 8-48 kHz range.
+      mp3Hz = info.samprate;
+      setSampleRate(mp3Hz);
+    }
+    decodeCycles += cycles;
+    decodeFrames += (uint64_t)samples;
+    emitPcm(mp3Pcm, (size_t)samples);
+  }
+
+  int consumed = mp3InFilled - left;
+  memmove(mp3In, mp3In + consumed, left);
+  mp3InFilled = left;
+  return true;
+}
@@ -0,0 +1,218 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <WiFiClientSecure.h>
+#include "spsc_ring.h"
+#include "resampler.h"
+#include "gain.h"
+#include "audio_stats.h"
+#include "tone_synth.h"
+#include "ima_adpcm.h"
+#include "audio_index.h"
+#include "http_body.h"
+
+// Every source is resampled to this rate before it reaches the mixer/sink.
+static const int AUDIO_OUTPUT_RATE = 22050;
+
+// URL streams are buffered in a byte ring of this size before decoding.
+static const uint32_t AUDIO_NET_BUFFER_BYTES = 32768;
+static const uint32_t AUDIO_NET_START_DEFAULT = 16384;
+static const uint32_t AUDIO_NET_LOW_DEFAULT = 4096;
+
+// Loop mode: at the end of the data the source is rewound to its data
+// offset and decoding carries on, so there is no gap and nothing is
+// reopened. Each pass can raise the volume (crescendo). maxMs caps the total
+// play time, looping or not.
+struct AudioLoop {
+  bool enabled = false;
+  uint8_t crescendo = 0;   // volume points added per pass
+  uint32_t maxMs = 0;      // 0 = no limit
+};
+
+// An HTTP GET opened in phases, connect (TCP and TLS) and then request plus
+// response headers, so each can be timed and reported. The headers are
+// polled rather than waited for, so the caller can give up between polls.
+// Runs on the caller's task; the voice that adopts it only reads the body.
+class AudioHttpStream {
+public:
+  ~AudioHttpStream() { stop(); }
+  bool connect(const String& url, uint32_t timeoutMs);
+  bool sendRequest();
+  // Reads the header bytes that have arrived: the HTTP status once they are
+  // complete, 0 while more are due, -1 on a closed or malformed response.
+  int pollResponse();
+  void stop();
+  WiFiClient* client = nullptr;
+  // From the response headers, for the body reader and format detection.
+  bool chunked = false;
+  uint32_t icyMetaInt = 0;
+  String contentType;
+private:
+  void parseHeader(char* line);
+  String path;
+  String hostHeader;
+  String userInfo;
+  int status = 0;
+  uint32_t headerBytes = 0;
+  uint16_t lineLen = 0;
+  char line[256];
+};
+
+// One playback source: file or URL reader, WAV/PCM/MP3 decoder or the tone
+// synthesizer, resampler and gain. read() hands out gained samples at AUDIO_OUTPUT_RATE, decoding
+// on demand. Everything here runs on the audio producer task.
+class AudioVoice {
+public:
+  // With an index entry that still matches the file, WAV/PCM playback seeks
+  // straight to the data instead of parsing the header, and the entry's
+  // loudness normalization gain is applied.
+  bool startLocal(const String& path, uint8_t vol, uint16_t fadeInSec, const AudioAssetInfo* asset = nullptr);
+  // Takes over an opened stream. The voice then prebuffers without blocking:
+  // pollStart() is +1 once it plays, -1 if it failed, 0 while buffering.
+  // An MP3 file likewise starts pending (starting()) until its first frame.
+  void startStream(AudioHttpStream* s, const String& url, uint8_t vol, uint16_t fadeInSec,
+                   uint32_t netStart, uint32_t netLow, uint32_t prebufferMs);
+  int pollStart();
+  bool starting() const { return startPending; }
+  bool startSynth(uint8_t pattern, uint16_t baseHz, uint8_t vol, uint16_t fadeInSec);
+  void stop();
+  void setLoop(const AudioLoop& l);
+
+  // Up to n output samples into dst; fewer when starved or at the end.
+  size_t read(int16_t* dst, size_t n);
+  void pump() { netPump(); }
+
+  bool active() const { return playing; }
+  bool streaming() const { return stream != nullptr; }
+  // Input exhausted and everything decoded has been read. The source ends
+  // while the MP3 input buffer may still hold frames, so those count too.
+  bool finished() const { return playing && inputEnded && pendPos >= pendCount && mp3InFilled == 0; }
+
+  bool setSampleRate(int sr);
+  const String& lastError() const { return lastErr; }
+  const char* kind() const { return sourceKind; }
+  const char* target() const { return targetName; }
+  uint8_t volume() const { return volumePct; }
+  const AudioLoop& loopSettings() const { return loopCfg; }
+  uint32_t loopCount() const { return loops; }
+  uint32_t playedMs() const { return (uint32_t)(((uint64_t)played * 1000) / AUDIO_OUTPUT_RATE); }
+  uint32_t netBuffered() const { return net ? net->size() : 0; }
+  // ICY StreamTitle of a radio stream, "" if none.
+  const char* streamTitle() const { return stream ? body.title() : ""; }
+  uint32_t decodeCyclesPerSecond() const;
+  uint32_t resampleCyclesPerBlock() const;
+
+private:
+  bool decodeNext(int16_t* dst, size_t cap, size_t& direct);
+  void emitPcm(const int16_t* pcm, size_t n);
+  bool readBytes(File& f, uint8_t* buf, size_t n);
+  size_t readBytesNet(uint8_t* buf, size_t n);
+  void netPump();
+  bool readExact(uint8_t* buf, size_t n);
+  bool skipExact(uint32_t n);
+  bool wavReadHeader();
+  bool wavParseFmt(const uint8_t* fmt, uint32_t len);
+  bool wavSetFormat(uint16_t tag, uint16_t channels, uint32_t rate, uint16_t bits, uint16_t blockAlign);
+  bool applyAsset(const AudioAssetInfo& a);
+  void wavRefill();
+  bool pcmReadHeader();
+  bool fillWav(int16_t* dst, size_t cap, size_t& direct);
+  bool mp3Begin();
+  int mp3PrimeStep();
+  bool fillMp3();
+  size_t readSource(uint8_t* buf, size_t n);
+  bool rewind();
+  void nextPass();
+  bool fillSynth(int16_t* dst, size_t cap, size_t& direct);
+  void prepare(const String& t, uint8_t vol, uint16_t fadeInSec);
+  static uint32_t readLE32(const uint8_t* b);
+  static uint16_t readLE16(const uint8_t* b);
+
+  bool playing = false;
+  String lastErr;
+  const char* sourceKind = "";
+  uint8_t sourceType = AUDIO_SRC_COUNT;
+  char targetName[64] = "";
+  uint8_t volumePct = 0;
+  uint32_t played = 0;
+
+  AudioLoop loopCfg;
+  uint32_t maxSamples = 0;
+  uint32_t loops = 0;
+  // Start and length of the audio data in the file, for rewind(). MP3 is
+  // rewound when the file runs out, WAV/PCM when the data chunk does.
+  uint32_t dataOffset = 0;
+  uint32_t dataBytes = 0;
+  bool rewindAtEof = false;
+
+  // Without loop mode a synth pattern plays this many times.
+  static const uint32_t SYNTH_ONESHOT_CYCLES = 4;
+  ToneSynth synth;
+
+  int sourceRate = 16000;
+  Resampler resampler;
+  GainStage gain;
+
+  File file;
+  AudioHttpStream* stream = nullptr;
+  bool startPending = false;
+  bool mp3Priming = false;   // waiting for the first MP3 frame
+  bool urlGuess = false;      // no .wav/.mp3 in the URL: try it as WAV
+  uint32_t startBeganMs = 0;
+  uint32_t prebufferMs = 0;
+
+  // Jitter buffer between the socket and the decoders. Decoding pauses
+  // (netBuffering) from the start and whenever the fill drops below
+  // netLowBytes, until netStartBytes are buffered or the stream has ended.
+  SpscRing<uint8_t, AUDIO_NET_BUFFER_BYTES>* net = nullptr;
+  HttpBodyReader body;
+  uint32_t netStartBytes = AUDIO_NET_START_DEFAULT;
+  uint32_t netLowBytes = AUDIO_NET_LOW_DEFAULT;
+  bool netBuffering = false;
+  bool netEnded = false;
+
+  bool wavOk = false;
+  uint16_t wavChannels = 1;
+  uint32_t wavSampleRate = 16000;
+  uint16_t wavBits = 16;
+  bool wavAdpcm = false;       // IMA-ADPCM: "frames" are 4*channels-byte units
+  ImaAdpcmDecoder adpcm;
+  uint32_t wavDataRemaining = 0;
+  int wavInPos = 0;
+  int wavInFilled = 0;
+
+  // Helix fixed-point decoder and its PCM frame: allocated on first MP3 use
+  // by this voice and kept, so the working set is bounded (~29 KB).
+  static const int MP3_IN_BYTES = 2048;
+  static const int MP3_MAX_FRAME_BYTES = 1441;
+  static const int MP3_MAX_PCM = 1152 * 2;
+  void* mp3dec = nullptr;
+  int16_t* mp3Pcm = nullptr;
+
+  // WAV reads one LittleFS block at a time, plus room for a carried-over
+  // partial frame. Only one decoder runs at a time, so they share input.
+  static const int WAV_READ_BYTES = 4096;
+  static const int WAV_STAGE_FRAMES = 512;
+  union alignas(4) {
+    uint8_t mp3In[MP3_IN_BYTES];
+    uint8_t wavIn[WAV_READ_BYTES + 8];
+  };
+  int mp3InFilled = 0;
+  int mp3Hz = 0;
+  uint32_t mp3SkipBytes = 0;
+  bool mp3TagChecked = false;
+  uint32_t mp3Resyncs = 0;
+  bool inputEnded = false;
+
+  uint64_t decodeCycles = 0;
+  uint64_t decodeFrames = 0;
+  uint64_t resampleCycles = 0;
+  uint64_t resampleSamples = 0;
+
+  // Decoded output waiting to be read. Sized for one resampled MP3 frame
+  // (576 samples at 8 kHz -> ~1600).
+  static const int PEND_CAP = 2048;
+  int16_t pend[PEND_CAP];
+  int pendPos = 0;
+  int pendCount = 0;
+};
@@ -0,0 +1,71 @@
+#include "gain.h"
+
+static const int32_t MAX_STEP = GainStage::UNITY / 16;
+
+// round(v * 32768 / 100) for v = 0..100
+static const uint16_t GAIN_Q15[101] = {
+  0, 328, 655, 983, 1311, 1638, 1966, 2294, 2621, 2949,
+  3277, 3604, 3932, 4260, 4588, 4915, 5243, 5571, 5898, 6226,
+  6554, 6881, 7209, 7537, 7864, 8192, 8520, 8847, 9175, 9503,
+  9830, 10158, 10486, 10813, 11141, 11469, 11796, 12124, 12452, 12780,
+  13107, 13435, 13763, 14090, 14418, 14746, 15073, 15401, 15729, 16056,
+  16384, 16712, 17039, 17367, 17695, 18022, 18350, 18678, 19005, 19333,
+  19661, 19988, 20316, 20644, 20972, 21299, 21627, 21955, 22282, 22610,
+  22938, 23265, 23593, 23921, 24248, 24576, 24904, 25231, 25559, 25887,
+  26214, 26542, 26870, 27197, 27525, 27853, 28180, 28508, 28836, 29164,
+  29491, 29819, 30147, 30474, 30802, 31130, 31457, 31785, 32113, 32440,
+  32768,
+};
+
+void GainStage::reset(uint8_t volume, uint32_t fadeSamples, uint16_t trimQ12) {
+  trim = trimQ12 ? trimQ12 : TRIM_UNITY;
+  setVolume(volume);
+  fadeTotal = fadeSamples;
+  fadeDone = 0;
+  current = desired();
+}
+
+void GainStage::setVolume(uint8_t volume) {
+  if (volume > 100) volume = 100;
+  int32_t g = ((int32_t)GAIN_Q15[volume] * trim) >> 12;
+  target = g < MAX_GAIN ? g : MAX_GAIN;
+}
+
+int32_t GainStage::desired() const {
+  if (fadeDone >= fadeTotal) return target;
+  return (int32_t)(((int64_t)target * fadeDone) / fadeTotal);
+}
+
+void GainStage::process(int16_t* buf, size_t n) {
+  while (n > 0) {
+    size_t len = n < (size_t)BLOCK ? n : (size_t)BLOCK;
+    if (fadeDone < fadeTotal) fadeDone += (uint32_t)len;
+
+    int32_t next = desired();
+    if (next > current + MAX_STEP) next = current + MAX_STEP;
+    if (next < current - MAX_STEP) next = current - MAX_STEP;
+
+    if (next > UNITY || current > UNITY) {
+      // Boosted: g/4 keeps the product in 32 bits, then saturate.
+      int32_t delta = next - current;
+      for (size_t i = 0; i < len; i++) {
+        int32_t g = current + ((delta * (int32_t)i) >> BLOCK_SHIFT);
+        int32_t v = ((int32_t)buf[i] * (g >> 2)) >> 13;
+        buf[i] = (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+      }
+    } else if (next == current) {
+      int32_t g = current;
+      for (size_t i = 0; i < len; i++) buf[i] = (int16_t)(((int32_t)buf[i] * g) >> 15);
+    } else {
+      // Gain changes linearly across the block; delta is in Q15/BLOCK steps.
+      int32_t delta = next - current;
+      for (size_t i = 0; i < len; i++) {
+        int32_t g = current + ((delta * (int32_t)i) >> BLOCK_SHIFT);
+        buf[i] = (int16_t)(((int32_t)buf[i] * g) >> 15);
+      }
+    }
+    current = next;
+    buf += len;
+    n -= len;
+  }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Block gain stage run on the producer side, so the output path only copies.
+// Volume 0-100 maps through a Q15 table (no per-sample divide). The gain
+// moves toward its target at most MAX_STEP per BLOCK samples and is
+// interpolated linearly inside each block to avoid zipper noise. An optional
+// fade-in ramps the target from silence over a number of output samples.
+// A per-file trim (Q12, loudness normalization) scales the volume; above
+// unity the output saturates instead of wrapping.
+class GainStage {
+public:
+  static const int BLOCK_SHIFT = 6;
+  static const int BLOCK = 1 << BLOCK_SHIFT;
+  static const int32_t UNITY = 32768;
+  static const int32_t MAX_GAIN = 4 * UNITY;
+  static const uint16_t TRIM_UNITY = 4096;
+
+  void reset(uint8_t volume, uint32_t fadeSamples, uint16_t trimQ12 = TRIM_UNITY);
+  void setVolume(uint8_t volume);
+  void process(int16_t* buf, size_t n);
+
+private:
+  int32_t desired() const;
+
+  int32_t current = 0;
+  int32_t target = 0;
+  uint32_t fadeTotal = 0;
+  uint32_t fadeDone = 0;
+  uint16_t trim = TRIM_UNITY;
+};
@@ -0,0 +1,145 @@
+#include "http_body.h"
+
+static const uint8_t CHUNK_SIZE_MAX_DIGITS = 7;   // < 256 MB per chunk
+
+static size_t readClient(WiFiClient& c, uint8_t* dst, size_t n) {
+  int av = c.available();
+  if (av <= 0 || n == 0) return 0;
+  int r = c.read(dst, min(n, (size_t)av));
+  return r > 0 ? (size_t)r : 0;
+}
+
+static int hexValue(int ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+void HttpBodyReader::begin(bool chunked, uint32_t icyMetaInt) {
+  chunkState = chunked ? CH_SIZE : CH_NONE;
+  chunkLeft = 0;
+  sizeDigits = 0;
+  lineLen = 0;
+  metaInt = icyMetaInt;
+  metaLeft = icyMetaInt;
+  inMeta = false;
+  metaBodyLeft = 0;
+  metaFill = 0;
+  streamTitle[0] = 0;
+}
+
+size_t HttpBodyReader::read(WiFiClient& c, uint8_t* dst, size_t n) {
+  while (!ended()) {
+    if (metaInt == 0) return rawRead(c, dst, n);
+    if (metaLeft > 0) {
+      size_t r = rawRead(c, dst, min(n, (size_t)metaLeft));
+      metaLeft -= (uint32_t)r;
+      return r;
+    }
+    if (!metaBlock(c)) return 0;
+  }
+  return 0;
+}
+
+// Payload after the chunk framing, at most to the end of the current chunk.
+size_t HttpBodyReader::rawRead(WiFiClient& c, uint8_t* dst, size_t n) {
+  if (chunkState == CH_NONE) return readClient(c, dst, n);
+  if (chunkState != CH_DATA && !chunkFrame(c)) return 0;
+  size_t r = readClient(c, dst, min(n, (size_t)chunkLeft));
+  chunkLeft -= (uint32_t)r;
+  if (chunkLeft == 0) chunkState = CH_DATA_END;
+  return r;
+}
+
+// Consumes framing a byte at a time until chunk data starts (true), the
+// socket runs dry, or the body ends.
+bool HttpBodyReader::chunkFrame(WiFiClient& c) {
+  while (c.available() > 0) {
+    int ch = c.read();
+    if (ch < 0) return false;
+    switch (chunkState) {
+      case CH_SIZE: {
+        int v = hexValue(ch);
+        if (v >= 0 && sizeDigits < CHUNK_SIZE_MAX_DIGITS) {
+          chunkLeft = (chunkLeft << 4) | (uint32_t)v;
+          sizeDigits++;
+        } else if (ch == ';' && sizeDigits) {
+          chunkState = CH_EXT;
+        } else if (ch == '\n' && sizeDigits) {
+          sizeDigits = 0;
+          if (chunkLeft == 0) { chunkState = CH_TRAILER; lineLen = 0; break; }
+          chunkState = CH_DATA;
+          return true;
+        } else if (ch != '\r' && ch != ' ' && ch != '\t') {
+          chunkState = CH_ERROR;
+          return false;
+        }
+        break;
+      }
+      case CH_EXT:
+        if (ch != '\n') break;
+        sizeDigits = 0;
+        if (chunkLeft == 0) { chunkState = CH_TRAILER; lineLen = 0; break; }
+        chunkState = CH_DATA;
+        return true;
+      case CH_DATA_END:
+        if (ch == '\n') { chunkState = CH_SIZE; chunkLeft = 0; }
+        else if (ch != '\r') { chunkState = CH_ERROR; return false; }
+        break;
+      case CH_TRAILER:
+        if (ch == '\n') {
+          if (lineLen == 0) { chunkState = CH_END; return false; }
+          lineLen = 0;
+        } else if (ch != '\r') {
+          lineLen++;
+        }
+        break;
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+// One ICY metadata block: a length byte (x16), then that much text, which
+// may itself be split over chunks. Only the first bytes are kept.
+bool HttpBodyReader::metaBlock(WiFiClient& c) {
+  if (!inMeta) {
+    uint8_t len;
+    if (rawRead(c, &len, 1) == 0) return false;
+    inMeta = true;
+    metaBodyLeft = (uint16_t)len * 16;
+    metaFill = 0;
+  }
+  while (metaBodyLeft > 0) {
+    uint8_t skip[32];
+    size_t room = sizeof(metaBuf) - 1 - metaFill;
+    uint8_t* dst = room ? (uint8_t*)metaBuf + metaFill : skip;
+    size_t cap = room ? room : sizeof(skip);
+    size_t r = rawRead(c, dst, min(cap, (size_t)metaBodyLeft));
+    if (r == 0) return false;
+    if (room) metaFill += (uint16_t)r;
+    metaBodyLeft -= (uint16_t)r;
+  }
+  if (metaFill) {
+    metaBuf[metaFill] = 0;
+    parseTitle();
+  }
+  inMeta = false;
+  metaLeft = metaInt;
+  return true;
+}
+
+// StreamTitle='Artist - Song';StreamUrl='...';
+void HttpBodyReader::parseTitle() {
+  const char* key = "StreamTitle='";
+  const char* p = strstr(metaBuf, key);
+  if (!p) return;
+  p += strlen(key);
+  const char* e = strstr(p, "';");
+  if (!e) e = p + strlen(p);
+  size_t n = min((size_t)(e - p), sizeof(streamTitle) - 1);
+  memcpy(streamTitle, p, n);
+  streamTitle[n] = 0;
+}
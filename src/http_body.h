@@ -0,0 +1,43 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+
+// Turns an HTTP response body into plain payload: strips the framing of
+// Transfer-Encoding: chunked and the ICY (SHOUTcast/Icecast) metadata blocks
+// sent every icy-metaint payload bytes. Payload goes from the socket straight
+// into the caller's buffer, in runs that never cross a chunk or metadata
+// boundary; only framing bytes are read through this object.
+class HttpBodyReader {
+public:
+  void begin(bool chunked, uint32_t icyMetaInt);
+
+  // Up to n payload bytes into dst. 0 when the socket has nothing more for
+  // now, or once the body has ended.
+  size_t read(WiFiClient& c, uint8_t* dst, size_t n);
+
+  // The terminal chunk was seen, or the framing was malformed.
+  bool ended() const { return chunkState == CH_END || chunkState == CH_ERROR; }
+  bool failed() const { return chunkState == CH_ERROR; }
+  const char* title() const { return streamTitle; }
+
+private:
+  enum ChunkState : uint8_t { CH_NONE, CH_SIZE, CH_EXT, CH_DATA, CH_DATA_END, CH_TRAILER, CH_END, CH_ERROR };
+
+  size_t rawRead(WiFiClient& c, uint8_t* dst, size_t n);
+  bool chunkFrame(WiFiClient& c);
+  bool metaBlock(WiFiClient& c);
+  void parseTitle();
+
+  ChunkState chunkState = CH_NONE;
+  uint32_t chunkLeft = 0;
+  uint8_t sizeDigits = 0;
+  uint16_t lineLen = 0;
+
+  uint32_t metaInt = 0;
+  uint32_t metaLeft = 0;     // payload bytes before the next metadata block
+  bool inMeta = false;
+  uint16_t metaBodyLeft = 0;
+  uint16_t metaFill = 0;
+  char metaBuf[256];
+  char streamTitle[64] = "";
+};
@@ -0,0 +1,124 @@
+#include "ima_adpcm.h"
+#include <string.h>
+
+static const int16_t STEP_TABLE[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767,
+};
+
+static const int8_t INDEX_TABLE[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static inline int32_t clampIndex(int32_t i) { return i < 0 ? 0 : (i > 88 ? 88 : i); }
+static inline int32_t clamp16(int32_t v) { return v < -32768 ? -32768 : (v > 32767 ? 32767 : v); }
+
+// Applies one nibble to the predictor state; shared by decoder and encoder
+// so both stay bit-exact.
+static inline int32_t imaStep(int32_t& pred, int32_t& index, uint8_t nib) {
+  int32_t step = STEP_TABLE[index];
+  int32_t diff = step >> 3;
+  if (nib & 1) diff += step >> 2;
+  if (nib & 2) diff += step >> 1;
+  if (nib & 4) diff += step;
+  pred = clamp16((nib & 8) ? pred - diff : pred + diff);
+  index = clampIndex(index + INDEX_TABLE[nib]);
+  return pred;
+}
+
+bool ImaAdpcmDecoder::begin(uint16_t chans, uint16_t blockAlign) {
+  if (chans < 1 || chans > 2) return false;
+  uint32_t ub = (uint32_t)chans * 4;
+  if (blockAlign < ub * 2 || blockAlign % ub != 0) return false;
+  channels = chans;
+  unitsPerBlock = blockAlign / ub;
+  unit = 0;
+  return true;
+}
+
+size_t ImaAdpcmDecoder::decode(const uint8_t* in, size_t units, int16_t* out) {
+  size_t n = 0;
+  for (size_t u = 0; u < units; u++, in += unitBytes()) {
+    if (unit == 0) {
+      int32_t sum = 0;
+      for (uint16_t c = 0; c < channels; c++) {
+        const uint8_t* h = in + c * 4;
+        ch[c].pred = (int16_t)(h[0] | (h[1] << 8));
+        ch[c].index = clampIndex(h[2]);
+        sum += ch[c].pred;
+      }
+      out[n++] = (int16_t)(channels == 2 ? (sum >> 1) : sum);
+    } else if (channels == 1) {
+      for (int i = 0; i < 4; i++) {
+        out[n++] = (int16_t)imaStep(ch[0].pred, ch[0].index, in[i] & 0x0F);
+        out[n++] = (int16_t)imaStep(ch[0].pred, ch[0].index, in[i] >> 4);
+      }
+    } else {
+      for (int i = 0; i < 4; i++) {
+        int32_t l0 = imaStep(ch[0].pred, ch[0].index, in[i] & 0x0F);
+        int32_t r0 = imaStep(ch[1].pred, ch[1].index, in[4 + i] & 0x0F);
+        int32_t l1 = imaStep(ch[0].pred, ch[0].index, in[i] >> 4);
+        int32_t r1 = imaStep(ch[1].pred, ch[1].index, in[4 + i] >> 4);
+        out[n++] = (int16_t)((l0 + r0) >> 1);
+        out[n++] = (int16_t)((l1 + r1) >> 1);
+      }
+    }
+    if (++unit == unitsPerBlock) unit = 0;
+  }
+  return n;
+}
+
+void ImaAdpcmEncoder::encodeBlock(const int16_t* in, uint8_t* out) {
+  pred = in[0];
+  out[0] = (uint8_t)(pred & 0xFF);
+  out[1] = (uint8_t)((pred >> 8) & 0xFF);
+  out[2] = (uint8_t)index;
+  out[3] = 0;
+
+  for (int i = 1; i < SAMPLES_PER_BLOCK; i += 2) {
+    uint8_t nib[2];
+    for (int k = 0; k < 2; k++) {
+      int32_t diff = (int32_t)in[i + k] - pred;
+      uint8_t code = 0;
+      if (diff < 0) { code = 8; diff = -diff; }
+      int32_t step = STEP_TABLE[index];
+      if (diff >= step) { code |= 4; diff -= step; }
+      step >>= 1;
+      if (diff >= step) { code |= 2; diff -= step; }
+      step >>= 1;
+      if (diff >= step) code |= 1;
+      imaStep(pred, index, code);
+      nib[k] = code;
+    }
+    out[4 + (i - 1) / 2] = (uint8_t)(nib[0] | (nib[1] << 4));
+  }
+}
+
+static void put16(uint8_t* b, uint16_t v) { b[0] = (uint8_t)v; b[1] = (uint8_t)(v >> 8); }
+static void put32(uint8_t* b, uint32_t v) { put16(b, (uint16_t)v); put16(b + 2, (uint16_t)(v >> 16)); }
+
+void imaAdpcmWriteWavHeader(uint8_t* h, uint32_t sampleRate, uint32_t samples, uint32_t dataBytes) {
+  const uint16_t blockAlign = ImaAdpcmEncoder::BLOCK_BYTES;
+  const uint16_t spb = ImaAdpcmEncoder::SAMPLES_PER_BLOCK;
+  memcpy(h, "RIFF", 4);
+  put32(h + 4, (uint32_t)(IMA_ADPCM_WAV_HEADER_BYTES - 8 + dataBytes));
+  memcpy(h + 8, "WAVE", 4);
+  memcpy(h + 12, "fmt ", 4);
+  put32(h + 16, 20);
+  put16(h + 20, IMA_ADPCM_FORMAT_TAG);
+  put16(h + 22, 1);
+  put32(h + 24, sampleRate);
+  put32(h + 28, (uint32_t)(((uint64_t)sampleRate * blockAlign) / spb));
+  put16(h + 32, blockAlign);
+  put16(h + 34, 4);
+  put16(h + 36, 2);
+  put16(h + 38, spb);
+  memcpy(h + 40, "fact", 4);
+  put32(h + 44, 4);
+  put32(h + 48, samples);
+  memcpy(h + 52, "data", 4);
+  put32(h + 56, dataBytes);
+}
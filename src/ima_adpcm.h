@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// IMA-ADPCM as stored in WAV files (format tag 0x11), 4 bits per sample.
+// A block starts with a 4-byte header per channel (predictor, step index)
+// followed by groups of 4 bytes per channel, each holding 8 samples, low
+// nibble first. Both directions work on these 4*channels-byte units, so the
+// WAV reader can stream them like PCM frames without buffering whole blocks.
+static const uint16_t IMA_ADPCM_FORMAT_TAG = 0x11;
+
+class ImaAdpcmDecoder {
+public:
+  // False if the block layout is not a whole number of units.
+  bool begin(uint16_t channels, uint16_t blockAlign);
+  // Restart at a block boundary (e.g. after seeking back to the data start).
+  void reset() { unit = 0; }
+  size_t unitBytes() const { return (size_t)channels * 4; }
+  uint16_t samplesPerBlock() const { return (uint16_t)((unitsPerBlock - 1) * 8 + 1); }
+
+  // Decodes whole units to mono (stereo is averaged). A header unit yields
+  // one sample and a data unit eight, so out must hold units * 8 samples.
+  size_t decode(const uint8_t* in, size_t units, int16_t* out);
+
+private:
+  struct Chan {
+    int32_t pred = 0;
+    int32_t index = 0;
+  };
+  Chan ch[2];
+  uint16_t channels = 1;
+  uint32_t unitsPerBlock = 1;
+  uint32_t unit = 0;
+};
+
+// Mono encoder producing blocks of BLOCK_BYTES (SAMPLES_PER_BLOCK samples).
+// The step index carries over between blocks so each block starts adapted.
+class ImaAdpcmEncoder {
+public:
+  static const uint16_t BLOCK_BYTES = 256;
+  static const uint16_t SAMPLES_PER_BLOCK = (BLOCK_BYTES - 4) * 2 + 1;   // 505
+
+  void reset() { pred = 0; index = 0; }
+  // Encodes exactly SAMPLES_PER_BLOCK samples into BLOCK_BYTES bytes.
+  void encodeBlock(const int16_t* in, uint8_t* out);
+
+private:
+  int32_t pred = 0;
+  int32_t index = 0;
+};
+
+// Bytes of the canonical IMA-ADPCM mono WAV header written by
+// imaAdpcmWriteWavHeader: RIFF + fmt (20) + fact + data chunk headers.
+static const size_t IMA_ADPCM_WAV_HEADER_BYTES = 60;
+void imaAdpcmWriteWavHeader(uint8_t* h, uint32_t sampleRate, uint32_t samples, uint32_t dataBytes);
@@ -0,0 +1,35 @@
+#include "loop_wake.h"
+
+void LoopWake::begin() {
+  task = xTaskGetCurrentTaskHandle();
+  minuteStartMs = millis();
+}
+
+void LoopWake::wake() {
+  if (task && xTaskGetCurrentTaskHandle() != task) xTaskNotifyGive(task);
+}
+
+void IRAM_ATTR LoopWake::wakeFromIsr() {
+  if (!task) return;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(task, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+bool LoopWake::wait(uint32_t ms) {
+  bool woken = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms)) > 0;
+
+  uint32_t now = millis();
+  if (now - minuteStartMs >= 60000) {
+    // A minute with no wakeup at all rolls over on the next one.
+    bool skipped = now - minuteStartMs >= 120000;
+    lastMinute = skipped ? 0 : count;
+    lastMinuteEarly = skipped ? 0 : early;
+    count = 0;
+    early = 0;
+    minuteStartMs = now - (now - minuteStartMs) % 60000;
+  }
+  count++;
+  if (woken) early++;
+  return woken;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Lets loop() block until its next deadline instead of polling. Web
+// handlers, the audio start task and button interrupts call wake() to end
+// the wait early. Every return from wait() counts as a wakeup; the count of
+// the last whole minute is kept for /api/status.
+class LoopWake {
+public:
+  // From the loop task (setup() runs on it).
+  void begin();
+  // No-op from the loop task itself: it is awake already.
+  void wake();
+  void IRAM_ATTR wakeFromIsr();
+
+  // Blocks up to ms; true if wake() ended it early.
+  bool wait(uint32_t ms);
+
+  uint32_t wakeupsPerMinute() const { return lastMinute; }
+  uint32_t earlyWakeupsPerMinute() const { return lastMinuteEarly; }
+
+private:
+  TaskHandle_t task = nullptr;
+  uint32_t minuteStartMs = 0;
+  uint32_t count = 0;
+  uint32_t early = 0;
+  uint32_t lastMinute = 0;
+  uint32_t lastMinuteEarly = 0;
+};
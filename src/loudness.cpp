@@ -0,0 +1,109 @@
+#include "loudness.h"
+#include <math.h>
+#include <string.h>
+
+// Sample scale inside the filters: int16 << 8 keeps the high-pass precise.
+static const int SAMPLE_SHIFT = 8;
+static const double Q28 = 268435456.0;
+
+void LoudnessMeter::Biquad::set(double nb0, double nb1, double nb2, double na1, double na2) {
+  b0 = (int32_t)lround(nb0 * Q28);
+  b1 = (int32_t)lround(nb1 * Q28);
+  b2 = (int32_t)lround(nb2 * Q28);
+  a1 = (int32_t)lround(na1 * Q28);
+  a2 = (int32_t)lround(na2 * Q28);
+  x1 = x2 = y1 = y2 = 0;
+}
+
+int32_t LoudnessMeter::Biquad::run(int32_t x) {
+  int64_t acc = (int64_t)b0 * x + (int64_t)b1 * x1 + (int64_t)b2 * x2 - (int64_t)a1 * y1 - (int64_t)a2 * y2;
+  int32_t y = (int32_t)(acc >> 28);
+  x2 = x1; x1 = x;
+  y2 = y1; y1 = y;
+  return y;
+}
+
+// K-weighting coefficients for any rate (as in libebur128).
+void LoudnessMeter::begin(uint32_t sampleRate) {
+  double fs = sampleRate ? (double)sampleRate : 48000.0;
+
+  double k = tan(M_PI * 1681.974450955533 / fs);
+  double q = 0.7071752369554196;
+  double vh = pow(10.0, 3.999843853973347 / 20.0);
+  double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+  shelf.set((vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+            2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0);
+
+  k = tan(M_PI * 38.13547087602444 / fs);
+  q = 0.5003270373238773;
+  a0 = 1.0 + k / q + k * k;
+  highpass.set(1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0);
+
+  blockLen = (uint32_t)(fs * 0.4);
+  blockFill = 0;
+  blockSum = 0;
+  blocks = 0;
+  memset(hist, 0, sizeof(hist));
+}
+
+void LoudnessMeter::add(const int16_t* s, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    int32_t y = highpass.run(shelf.run((int32_t)s[i] << SAMPLE_SHIFT)) >> SAMPLE_SHIFT;
+    blockSum += (uint64_t)((int64_t)y * y);
+    if (++blockFill == blockLen) {
+      addBlock(blockSum, blockLen);
+      blockSum = 0;
+      blockFill = 0;
+    }
+  }
+}
+
+static double blockLoudness(double meanSquare) {
+  return -0.691 + 10.0 * log10(meanSquare / (32768.0 * 32768.0));
+}
+
+static double binLoudness(int bin) { return -70.0 + bin * 0.5 + 0.25; }
+
+void LoudnessMeter::addBlock(uint64_t sum, uint32_t len) {
+  if (sum == 0 || len == 0) return;
+  double l = blockLoudness((double)sum / len);
+  if (l < -70.0) return;
+  int bin = (int)((l + 70.0) * 2.0);
+  if (bin >= BINS) bin = BINS - 1;
+  if (hist[bin] < 0xFFFF) hist[bin]++;
+  blocks++;
+}
+
+int16_t LoudnessMeter::finish() {
+  // A clip shorter than one block is measured as a whole.
+  if (blocks == 0 && blockFill > 0) addBlock(blockSum, blockFill);
+  if (blocks == 0) return NONE;
+
+  double sum = 0;
+  uint32_t count = 0;
+  for (int i = 0; i < BINS; i++) {
+    if (!hist[i]) continue;
+    sum += hist[i] * pow(10.0, (binLoudness(i) + 0.691) / 10.0);
+    count += hist[i];
+  }
+  double gate = -0.691 + 10.0 * log10(sum / count) - 10.0;
+
+  sum = 0;
+  count = 0;
+  for (int i = 0; i < BINS; i++) {
+    if (!hist[i] || binLoudness(i) < gate) continue;
+    sum += hist[i] * pow(10.0, (binLoudness(i) + 0.691) / 10.0);
+    count += hist[i];
+  }
+  double l = -0.691 + 10.0 * log10(sum / count);
+  return (int16_t)lround(l * 10.0);
+}
+
+uint16_t loudnessNormGain(int16_t loudness, uint16_t peak) {
+  if (loudness == LoudnessMeter::NONE || peak == 0) return LOUDNESS_GAIN_UNITY;
+  double g = pow(10.0, (LOUDNESS_TARGET - loudness) / 200.0);
+  g = fmin(g, 32767.0 / peak);
+  g = fmin(fmax(g, 1.0 / 16.0), 4.0);
+  return (uint16_t)lround(g * LOUDNESS_GAIN_UNITY);
+}
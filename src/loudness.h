@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Integrated loudness after ITU-R BS.1770 for one channel (the mono mix that
+// is played): K-weighting (high shelf + high-pass) in fixed point, 400 ms
+// blocks, an absolute gate at -70 LUFS and a relative gate 10 LU below the
+// mean. Blocks do not overlap and the relative gate works on a 0.5 LU
+// histogram, which is close enough to choose a playback gain.
+class LoudnessMeter {
+public:
+  static const int16_t NONE = -32768;
+
+  void begin(uint32_t sampleRate);
+  void add(const int16_t* s, size_t n);
+  // Integrated loudness in 0.1 LUFS, NONE for silence.
+  int16_t finish();
+
+private:
+  struct Biquad {
+    int32_t b0, b1, b2, a1, a2;   // Q28
+    int32_t x1, x2, y1, y2;
+    void set(double b0, double b1, double b2, double a1, double a2);
+    int32_t run(int32_t x);
+  };
+  void addBlock(uint64_t sum, uint32_t len);
+
+  static const int BINS = 150;   // -70 .. +5 LUFS
+  Biquad shelf;
+  Biquad highpass;
+  uint32_t blockLen = 0;
+  uint32_t blockFill = 0;
+  uint64_t blockSum = 0;
+  uint32_t blocks = 0;
+  uint16_t hist[BINS];
+};
+
+// Playback gains are Q12, 4096 = unity.
+static const uint16_t LOUDNESS_GAIN_UNITY = 4096;
+static const int16_t LOUDNESS_TARGET = -140;   // 0.1 LUFS
+
+// Gain that brings a file to LOUDNESS_TARGET, limited so its peak stays
+// below full scale and to 1/16 .. 4 (-24 .. +12 dB).
+uint16_t loudnessNormGain(int16_t loudness, uint16_t peak);
@@ -10,31 +10,61 @@
 #include <AsyncTCP.h>
 #include <ArduinoJson.h>
 #include "alarms.h"
+#include "alarm_schedule.h"
+#include "alarm_store.h"
+#include "time_zone.h"
+#include "recurrence.h"
+#include "loop_wake.h"
 #include "audio.h"
+#include "audio_cache.h"
+#include "audio_index.h"
+#include "native_pcm.h"
+#include "tone_synth.h"
 
 #include <time.h>
 #include <sys/time.h>
+#include <esp_pm.h>
+#include <esp_sntp.h>
 
 #include <map>
 #include <vector>
 #include <functional>
+#include <memory>
 
 static const uint32_t FW_CONFIG_VERSION = 1;
 
 static const uint32_t BUTTON_DEBOUNCE_MS = 50;
 static const uint32_t DEFAULT_LONG_PRESS_MS = 1200;
 static const int DEFAULT_AUDIO_PWM_PIN = 5;
+static const char* DEFAULT_AUDIO_SINK = "pdm";
+
+static const int MAX_FADE_IN_SEC = 600;
+static const int MAX_LOOP_CRESCENDO = 50;
+static const int MAX_RING_SEC = 7200;
+static const int MAX_REPEAT_INTERVAL = 52;
+static const time_t PREFETCH_LEAD_SEC = 10 * 60;
 
 static const size_t MAX_UPLOAD_BYTES = 2 * 1024 * 1024;
 static const time_t MIN_VALID_EPOCH = 1700000000;
 
+// loop() sleeps until its earliest deadline; these are the periodic ones.
+static const uint32_t LOOP_POLL_MS = 5;   // while audio, a download or a level scan needs loop()
+static const uint32_t LOOP_MAX_SLEEP_MS = 60000;
+static const uint32_t LAST_GOOD_SAVE_MS = 60000;
+static const uint32_t PREFETCH_CHECK_MS = 1000;
+
 static AsyncWebServer server(80);
 static Preferences prefs;
 
 static bool wifiConnected = false;
 static bool ntpSynced = false;
+// Set by the SNTP callback (lwIP task); loop() takes it from there.
+static volatile bool ntpSyncPending = false;
 static time_t lastGoodUnix = 0;
 
+static uint32_t lastTimeSaveMs = 0;
+static uint32_t lastPrefetchCheckMs = 0;
+
 static String deviceId;
 static String adminToken;
 static const size_t MAX_LOG_LINES = 120;
@@ -47,8 +77,24 @@ struct WebhookLastResult {
 };
 static WebhookLastResult lastWebhookGlobal;
 
-static AlarmConfig alarms[MAX_ALARMS];
+static AlarmStore alarmStore;
 static AlarmRuntime alarmRt[MAX_ALARMS];
+static AlarmSchedule schedule;
+static LoopWake loopWake;
+
+// Set by loop() for /api/status.
+enum PowerMode : uint8_t { POWER_UNSET, POWER_ACTIVE, POWER_MODEM_SLEEP, POWER_LIGHT_SLEEP };
+static PowerMode powerMode = POWER_UNSET;
+static uint32_t loopLastSleepMs = 0;
+
+static const char* powerModeName(PowerMode m) {
+  switch (m) {
+    case POWER_ACTIVE: return "active";
+    case POWER_MODEM_SLEEP: return "modem_sleep";
+    case POWER_LIGHT_SLEEP: return "light_sleep";
+    default: return "unset";
+  }
+}
 
 static int activeAlarmIndex = -1;
 
@@ -121,7 +167,7 @@ static String sanitizeFileName(const String& input) {
 
 static bool hasAllowedExt(const String& name) {
   String n = name; n.toLowerCase();
-  return n.endsWith(".wav") || n.endsWith(".mp3");
+  return n.endsWith(".wav") || n.endsWith(".mp3") || n.endsWith(".pcm");
 }
 
 static bool fileExists(const char* path) {
@@ -132,14 +178,34 @@ static bool fileExists(const char* path) {
 }
 
 static bool isFileUsedByAnyAlarm(const String& path) {
+  AlarmConfig a;
   for (int i = 0; i < MAX_ALARMS; i++) {
-    if (alarms[i].id == 0) continue;
-    if (String(alarms[i].local_path) == path) return true;
-    if (String(alarms[i].fallback_local_path) == path) return true;
+    if (alarmStore.hot(i).id == 0 || !alarmStore.load(i, a)) continue;
+    if (path == a.local_path || path == a.fallback_local_path) return true;
   }
   return false;
 }
 
+// Points alarms that play `from` (as main or fallback sound) at `to`.
+// Returns how many were changed, -1 if any could not be read or saved.
+static int redirectAlarmAudio(const String& from, const String& to) {
+  int changed = 0;
+  bool failed = false;
+  AlarmConfig a;
+  for (int i = 0; i < MAX_ALARMS; i++) {
+    if (alarmStore.hot(i).id == 0) continue;
+    if (!alarmStore.load(i, a)) { failed = true; continue; }
+    bool primary = from == a.local_path, fallback = from == a.fallback_local_path;
+    if (!primary && !fallback) continue;
+    if (primary) strlcpy(a.local_path, to.c_str(), sizeof(a.local_path));
+    if (fallback) strlcpy(a.fallback_local_path, to.c_str(), sizeof(a.fallback_local_path));
+    if (alarmStore.save(i, a)) changed++;
+    else failed = true;
+  }
+  if (failed) addLogLine(String("[upload] some alarms still point at ") + from);
+  return failed ? -1 : changed;
+}
+
 static bool requireAdmin(AsyncWebServerRequest* request) {
   if (adminToken.length() == 0) return true;
 
@@ -154,15 +220,21 @@ static bool requireAdmin(AsyncWebServerRequest* request) {
 }
 
 static int findAlarmIndexById(uint32_t id) {
-  for (int i = 0; i < MAX_ALARMS; i++) if (alarms[i].id == id) return i;
-  return -1;
+  return alarmStore.find(id);
 }
 
 static const char* TZ_STOCKHOLM = "CET-1CEST,M3.5.0/2,M10.5.0/3";
 
+// Alarm times are computed with this; libc's TZ is kept for log/ISO output.
+static TimeZone tz;
+
+// Dates that alarms with skip_holidays do not ring on, kept in NVS.
+static HolidaySet holidays;
+
 static void setupTimezone() {
   setenv("TZ", TZ_STOCKHOLM, 1);
   tzset();
+  if (!tz.begin(TZ_STOCKHOLM)) addLogLine(String("[boot] TZ ") + TZ_STOCKHOLM + ": " + tz.error());
 }
 
 static void saveLastGoodTimeIfValid() {
@@ -183,88 +255,89 @@ static void restoreLastGoodTime() {
   }
 }
 
+// Every SNTP update, the first one and the periodic ones after it. The
+// scheduler reacts to the new clock on the loop() pass this wakes.
+static void onNtpSync(struct timeval*) {
+  ntpSyncPending = true;
+  loopWake.wake();
+}
+
 static void startNtp() {
+  sntp_set_time_sync_notification_cb(onNtpSync);
   // RÄTT: starta SNTP med TZ + DST
   configTzTime(TZ_STOCKHOLM, "pool.ntp.org", "time.google.com", "time.cloudflare.com");
 }
 
-static void updateNtpStatus() {
-  struct tm t;
-  if (getLocalTime(&t, 10)) ntpSynced = isValidEpoch(time(nullptr));
-  else ntpSynced = false;
-}
-
-
-static bool parseOnceDate(const char* s, int& y, int& m, int& d) {
-  if (!s || strlen(s) != 10) return false;
-  if (s[4] != '-' || s[7] != '-') return false;
-  y = String(s).substring(0, 4).toInt();
-  m = String(s).substring(5, 7).toInt();
-  d = String(s).substring(8, 10).toInt();
-  if (y < 2000 || m < 1 || m > 12 || d < 1 || d > 31) return false;
-  return true;
-}
-
-static time_t makeLocalEpoch(int y, int mo, int d, int hh, int mm, int ss) {
-  struct tm t {};
-  t.tm_year = y - 1900;
-  t.tm_mon = mo - 1;
-  t.tm_mday = d;
-  t.tm_hour = hh;
-  t.tm_min = mm;
-  t.tm_sec = ss;
-  t.tm_isdst = -1;
-  return mktime(&t);
-}
-
-static uint8_t weekdayBitMon0(const struct tm& t) {
-  int w = t.tm_wday;          // 0=Sun..6=Sat
-  int mon0 = (w == 0) ? 6 : (w - 1); // Mon=0..Sun=6
-  return (uint8_t)mon0;
-}
 
-static time_t computeNextFire(const AlarmConfig& a, time_t now) {
-  if (!a.enabled || a.id == 0) return 0;
+// Wall times follow TimeZone::toUtc: an alarm in the spring-forward gap
+// rings when the clock has jumped past it (02:30 -> 03:30), one in the fall
+// overlap rings on the first pass only.
+static time_t computeNextFire(const AlarmHot& a, time_t now) {
+  if (!a.enabled() || a.id == 0) return 0;
+  int64_t timeOfDay = (int64_t)a.hour * 3600 + a.minute * 60;
 
-  if (strlen(a.once_date) == 10) {
-    int y, mo, d;
-    if (!parseOnceDate(a.once_date, y, mo, d)) return 0;
-    time_t t = makeLocalEpoch(y, mo, d, a.hour, a.minute, 0);
+  if (a.once()) {
+    if (a.once_day < 0) return 0;
+    time_t t = tz.toUtc((int64_t)a.once_day * 86400 + timeOfDay);
     if (t <= now) return 0;
     if (a.last_fired_unix == (uint32_t)t) return 0;
     return t;
   }
 
-  if (a.days_mask == 0) return 0;
-
-  struct tm nowTm {};
-  localtime_r(&now, &nowTm);
+  // Today's time may have passed (or just fired); later days are ahead.
+  // next() is bounded (MAX_SKIPS holidays, MAX_MONTHS months) and gives -1
+  // when the rule has no further day, so this ends either way.
+  for (int32_t day = a.repeat.next((int32_t)TimeZone::dayOf(tz.toLocal(now)), &holidays); day >= 0;
+       day = a.repeat.next(day + 1, &holidays)) {
+    time_t t = tz.toUtc((int64_t)day * 86400 + timeOfDay);
+    if (t > now && a.last_fired_unix != (uint32_t)t) return t;
+  }
+  return 0;
+}
 
-  for (int dayOffset = 0; dayOffset < 8; dayOffset++) {
-    struct tm cand = nowTm;
-    cand.tm_mday += dayOffset;
-    cand.tm_hour = a.hour;
-    cand.tm_min = a.minute;
-    cand.tm_sec = 0;
-    cand.tm_isdst = -1;
+// Every change of next_fire_unix goes through here so the schedule follows.
+// Only enabled alarms are armed, as the scheduler never fired others.
+static void setNextFire(int idx, time_t t) {
+  alarmRt[idx].next_fire_unix = t;
+  const AlarmHot& h = alarmStore.hot(idx);
+  schedule.set(idx, (h.id && h.enabled()) ? t : 0);
+  loopWake.wake();
+}
 
-    time_t candEpoch = mktime(&cand);
-    if (candEpoch <= now) continue;
+// An interval alarm saved before the clock was set has no start day yet;
+// it counts from the first day the clock is known.
+static void anchorRepeatStart(int idx, time_t now) {
+  const AlarmHot& h = alarmStore.hot(idx);
+  if (h.id == 0 || h.once() || h.repeat.interval <= 1 || h.repeat.start_day != 0 || !isValidEpoch(now)) return;
+  AlarmConfig a;
+  if (!alarmStore.load(idx, a)) {
+    addLogLine(String("[alarm] ") + h.id + " cannot read slot " + idx + " to set its start day");
+    return;
+  }
+  a.repeat_start_day = (uint16_t)TimeZone::dayOf(tz.toLocal(now));
+  if (!alarmStore.save(idx, a)) addLogLine(String("[alarm] ") + h.id + " start day not saved: " + alarmStore.lastError());
+}
 
-    struct tm candTm {};
-    localtime_r(&candEpoch, &candTm);
-    uint8_t wd = weekdayBitMon0(candTm);
-    if ((a.days_mask & (1 << wd)) == 0) continue;
-    if (a.last_fired_unix == (uint32_t)candEpoch) continue;
-    return candEpoch;
+// Deadlines against a new clock; a running snooze keeps its end time.
+static void rebuildSchedule(time_t now) {
+  for (int i = 0; i < MAX_ALARMS; i++) {
+    anchorRepeatStart(i, now);
+    const AlarmRuntime& r = alarmRt[i];
+    setNextFire(i, r.snoozed ? r.snooze_until : computeNextFire(alarmStore.hot(i), now));
   }
-  return 0;
+}
+
+// Seconds until the next alarm or snooze is due, -1 if none is armed.
+static int32_t secondsToNextDeadline(time_t now) {
+  time_t due;
+  if (schedule.top(&due) < 0) return -1;
+  return due > now ? (int32_t)(due - now) : 0;
 }
 
 static void recomputeAllNextFires() {
   time_t now = time(nullptr);
   for (int i = 0; i < MAX_ALARMS; i++) {
-    alarmRt[i].next_fire_unix = computeNextFire(alarms[i], now);
+    setNextFire(i, computeNextFire(alarmStore.hot(i), now));
     alarmRt[i].ringing = false;
     alarmRt[i].snoozed = false;
     alarmRt[i].snooze_until = 0;
@@ -285,6 +358,7 @@ static void enqueueWebhook(const String& url, const String& body, uint32_t alarm
   j.nextAttemptMs = millis();
   j.alarmId = alarmId;
   j.event = event;
+  loopWake.wake();
 }
 
 static void processWebhookQueue() {
@@ -395,53 +469,56 @@ static void fireOutboundEvent(const AlarmConfig& a, const String& event, const S
 }
 
 /* NVS */
-static String alarmKey(int i) { return "al" + String(i); }
-
-static void saveAlarmToNvs(int i) {
-  String key = alarmKey(i);
-  prefs.putBytes(key.c_str(), &alarms[i], sizeof(AlarmConfig));
+static void saveHolidays() {
+  prefs.putBytes("holidays", holidays.years, sizeof(holidays.years));
 }
 
-static void loadAlarmFromNvs(int i) {
-  String key = alarmKey(i);
-  if (!prefs.isKey(key.c_str())) {
-    memset(&alarms[i], 0, sizeof(AlarmConfig));
-    alarms[i].version = FW_CONFIG_VERSION;
-    return;
-  }
-
-  size_t len = prefs.getBytesLength(key.c_str());
-  if (len == sizeof(AlarmConfig)) {
-    prefs.getBytes(key.c_str(), &alarms[i], sizeof(AlarmConfig));
-  } else {
-    memset(&alarms[i], 0, sizeof(AlarmConfig));
-    alarms[i].version = FW_CONFIG_VERSION;
-  }
+static void loadHolidays() {
+  holidays.clear();
+  if (prefs.getBytesLength("holidays") == sizeof(holidays.years)) prefs.getBytes("holidays", holidays.years, sizeof(holidays.years));
+}
 
-  if (alarms[i].version != FW_CONFIG_VERSION) {
-    uint32_t keepId = alarms[i].id;
-    memset(&alarms[i], 0, sizeof(AlarmConfig));
-    alarms[i].version = FW_CONFIG_VERSION;
-    if (keepId != 0) alarms[i].id = keepId;
-  }
+static AudioSinkKind audioSinkFromName(const String& name) {
+  String n = name; n.toLowerCase();
+  return (n == "ledc") ? AUDIO_SINK_LEDC : AUDIO_SINK_PDM;
 }
 
 static void loadAllFromNvs() {
   adminToken = prefs.getString("admin", "");
   int audioPin = prefs.getInt("audpin", DEFAULT_AUDIO_PWM_PIN);
 
-  for (int i = 0; i < MAX_ALARMS; i++) loadAlarmFromNvs(i);
+  loadHolidays();
+  if (!alarmStore.begin(prefs, FW_CONFIG_VERSION) || alarmStore.lastError().length())
+    addLogLine(String("[boot] alarm table: ") + alarmStore.lastError());
 
-  audio.begin(audioPin);
+  audio.begin(audioPin, audioSinkFromName(prefs.getString("audsink", DEFAULT_AUDIO_SINK)));
+  audio.setNetWatermarks(prefs.getULong("netstart", AUDIO_NET_START_DEFAULT),
+                         prefs.getULong("netlow", AUDIO_NET_LOW_DEFAULT));
+  audioCache.setMaxBytes(prefs.getULong("cachemax", AUDIO_CACHE_MAX_DEFAULT));
+  audio.setNormalize(prefs.getBool("audnorm", true));
   restoreLastGoodTime();
   recomputeAllNextFires();
 }
 
+// Button edges only wake loop(); buttonTick() reads and debounces the level.
+static void IRAM_ATTR onButtonEdge() { loopWake.wakeFromIsr(); }
+static uint32_t buttonIrqPins = 0;   // pins with onButtonEdge attached
+
 static void ensurePinsConfigured() {
+  for (int p = 0; p < 32; p++) {
+    if (buttonIrqPins & (1u << p)) detachInterrupt(digitalPinToInterrupt(p));
+  }
+  buttonIrqPins = 0;
+
   for (int i = 0; i < MAX_ALARMS; i++) {
-    if (alarms[i].id == 0) continue;
-    if (alarms[i].gpio_pin <= 0) continue;
-    pinMode(alarms[i].gpio_pin, INPUT_PULLUP);
+    const AlarmHot& h = alarmStore.hot(i);
+    if (h.id == 0) continue;
+    int pin = h.gpio_pin;
+    if (pin <= 0 || pin >= 32) continue;
+    pinMode(pin, INPUT_PULLUP);
+    if (buttonIrqPins & (1u << pin)) continue;
+    attachInterrupt(digitalPinToInterrupt(pin), onButtonEdge, CHANGE);
+    buttonIrqPins |= 1u << pin;
   }
 }
 
@@ -453,32 +530,44 @@ static uint32_t genAlarmId() {
 }
 
 /* Alarm actions */
+// An action on an alarm whose record cannot be read is abandoned: writing
+// back the zeroed record load() leaves behind would erase the alarm.
+static bool loadAlarmForAction(int idx, AlarmConfig& a, const char* action) {
+  if (alarmStore.load(idx, a)) return true;
+  addLogLine(String("[alarm] ") + alarmStore.hot(idx).id + " " + action + " aborted: cannot read slot " + idx);
+  return false;
+}
+
 static void stopActiveAlarm(const String& source, bool sendDismiss) {
   if (activeAlarmIndex < 0) return;
 
-  AlarmConfig& a = alarms[activeAlarmIndex];
-  AlarmRuntime& r = alarmRt[activeAlarmIndex];
+  int idx = activeAlarmIndex;
+  AlarmRuntime& r = alarmRt[idx];
 
-  audio.stop();
+  audio.stop(AUDIO_VOICE_ALARM);
   r.ringing = false;
   r.snoozed = false;
   r.snooze_until = 0;
   activeAlarmIndex = -1;
 
-  if (sendDismiss && strlen(a.on_dismiss_url) > 0) {
+  // The ring itself always stops; only the dismiss event needs the record.
+  AlarmConfig a;
+  if (sendDismiss && loadAlarmForAction(idx, a, "dismiss event") && strlen(a.on_dismiss_url) > 0) {
     fireOutboundEvent(a, "dismissed", source, String(a.on_dismiss_url));
   }
 
   time_t now = time(nullptr);
-  r.next_fire_unix = computeNextFire(a, now);
+  setNextFire(idx, computeNextFire(alarmStore.hot(idx), now));
 }
 
-static void snoozeActiveAlarm(const String& source) {
-  if (activeAlarmIndex < 0) return;
-  AlarmConfig& a = alarms[activeAlarmIndex];
+// false (and still ringing) when the alarm's record cannot be read.
+static bool snoozeActiveAlarm(const String& source) {
+  if (activeAlarmIndex < 0) return false;
+  AlarmConfig a;
+  if (!loadAlarmForAction(activeAlarmIndex, a, "snooze")) return false;
   AlarmRuntime& r = alarmRt[activeAlarmIndex];
 
-  audio.stop();
+  audio.stop(AUDIO_VOICE_ALARM);
   r.ringing = false;
   r.snoozed = true;
 
@@ -486,19 +575,69 @@ static void snoozeActiveAlarm(const String& source) {
   if (sm <= 0) sm = 5;
   time_t now = time(nullptr);
   r.snooze_until = now + (time_t)sm * 60;
-  r.next_fire_unix = r.snooze_until;
+  setNextFire(activeAlarmIndex, r.snooze_until);
 
   if (strlen(a.on_snooze_url) > 0) {
     fireOutboundEvent(a, "snoozed", source, String(a.on_snooze_url));
   }
+  return true;
 }
 
-static void fireAlarmNow(int idx, const String& source, bool isScheduled) {
-  if (idx < 0 || idx >= MAX_ALARMS) return;
+// Start job of the last fired alarm. Audio starts in the background, so
+// loop() checks it and reports audio_error if the whole fallback chain failed.
+static uint32_t alarmAudioJob = 0;
+static uint32_t alarmAudioJobAlarmId = 0;
+
+static void jsonAudioJob(JsonObject o, const AudioJobStatus& st) {
+  o["id"] = st.id;
+  o["voice"] = audioVoiceName(st.voice);
+  o["state"] = audioJobStateName(st.state);
+  o["elapsed_ms"] = st.elapsedMs;
+  if (st.source[0]) o["source"] = st.source;
+  if (st.error[0]) o["error"] = st.error;
+  JsonArray steps = o["steps"].to<JsonArray>();
+  for (uint8_t i = 0; i < st.steps && i < AUDIO_CHAIN_MAX; i++) {
+    JsonObject s = steps.add<JsonObject>();
+    s["kind"] = audioStepKindName(st.log[i].kind);
+    s["ok"] = st.log[i].ok;
+    s["ms"] = st.log[i].ms;
+    if (st.log[i].error[0]) s["error"] = st.log[i].error;
+  }
+}
 
-  if (activeAlarmIndex >= 0 && activeAlarmIndex != idx) stopActiveAlarm("system", false);
+static void audioJobTick() {
+  if (!alarmAudioJob) return;
+  AudioJobStatus st;
+  if (!audio.jobStatus(alarmAudioJob, st)) { alarmAudioJob = 0; return; }
+  if (!st.settled()) return;
+  alarmAudioJob = 0;
+  addLogLine(String("[audio] job ") + st.id + " " + audioJobStateName(st.state) + " after " + st.elapsedMs + " ms" +
+             (st.source[0] ? String(" ") + st.source : String()) + (st.error[0] ? String(" last_error=") + st.error : String()));
+  if (st.state != AUDIO_JOB_FAILED) return;
+
+  int idx = findAlarmIndexById(alarmAudioJobAlarmId);
+  AlarmConfig a;
+  if (idx < 0 || !alarmStore.load(idx, a) || strlen(a.on_fire_url) == 0) return;
+  JsonDocument tmp;
+  JsonObject detail = tmp.to<JsonObject>();
+  detail["error"] = st.error;
+  jsonAudioJob(detail["job"].to<JsonObject>(), st);
+  String body = buildEventPayload(a, "audio_error", "audio", detail);
+  enqueueWebhook(String(a.on_fire_url), body, a.id, "audio_error");
+}
+
+// false when the alarm's record cannot be read; it does not ring then, and
+// a scheduled one moves on to its next time so it is not retried every tick.
+static bool fireAlarmNow(int idx, const String& source, bool isScheduled) {
+  if (idx < 0 || idx >= MAX_ALARMS) return false;
 
-  AlarmConfig& a = alarms[idx];
+  AlarmConfig a;
+  if (!loadAlarmForAction(idx, a, "fire")) {
+    if (isScheduled) setNextFire(idx, computeNextFire(alarmStore.hot(idx), time(nullptr)));
+    return false;
+  }
+
+  if (activeAlarmIndex >= 0 && activeAlarmIndex != idx) stopActiveAlarm("system", false);
   AlarmRuntime& r = alarmRt[idx];
 
   activeAlarmIndex = idx;
@@ -510,50 +649,80 @@ static void fireAlarmNow(int idx, const String& source, bool isScheduled) {
   r.current_fire_unix = isScheduled ? r.next_fire_unix : now;
 
   a.last_fired_unix = (uint32_t)r.current_fire_unix;
-  saveAlarmToNvs(idx);
+  alarmStore.save(idx, a);
 
-  bool ok = playAlarmAudioWithFallback(a);
-  if (!ok) {
-    JsonDocument tmp;
-    JsonObject detail = tmp.to<JsonObject>();
-    detail["error"] = lastAudioError;
-    String body = buildEventPayload(a, "audio_error", source, detail);
-    if (strlen(a.on_fire_url) > 0) enqueueWebhook(String(a.on_fire_url), body, a.id, "audio_error");
-  }
+  audioCache.cancel();
+  alarmAudioJob = startAlarmAudio(a);
+  alarmAudioJobAlarmId = a.id;
 
   if (strlen(a.on_fire_url) > 0) fireOutboundEvent(a, "fired", source, String(a.on_fire_url));
 
   if (strlen(a.once_date) == 10) {
     a.enabled = false;
     a.once_date[0] = 0;
-    saveAlarmToNvs(idx);
+    alarmStore.save(idx, a);
   }
 
-  r.next_fire_unix = computeNextFire(a, now);
+  setNextFire(idx, computeNextFire(alarmStore.hot(idx), now));
+  return true;
 }
 
 static void schedulerTick() {
   time_t now = time(nullptr);
   if (!isValidEpoch(now)) return;
 
-  static uint32_t lastSaveMs = 0;
-  if (millis() - lastSaveMs > 60000) {
+  if (millis() - lastTimeSaveMs >= LAST_GOOD_SAVE_MS) {
     saveLastGoodTimeIfValid();
-    lastSaveMs = millis();
+    lastTimeSaveMs = millis();
   }
 
-  for (int i = 0; i < MAX_ALARMS; i++) {
-    if (alarms[i].id == 0) continue;
-    if (!alarms[i].enabled) continue;
+  // Deadlines computed before the clock was set, or before it stepped back,
+  // are stale. A step forward keeps them so that passed alarms still fire.
+  static time_t lastNow = 0;
+  tz.refresh(now);
+  if (lastNow == 0 || now < lastNow) rebuildSchedule(now);
+  lastNow = now;
+
+  time_t due;
+  int i = schedule.top(&due);
+  if (i >= 0 && now >= due) fireAlarmNow(i, "system", true);
+
+  // Ring limit: the audio voice stops itself at max_ring_sec, this ends the ring.
+  if (activeAlarmIndex >= 0) {
+    const AlarmHot& a = alarmStore.hot(activeAlarmIndex);
+    const AlarmRuntime& r = alarmRt[activeAlarmIndex];
+    if (r.ringing && a.max_ring_sec > 0 && now - r.current_fire_unix >= (time_t)a.max_ring_sec) {
+      addLogLine(String("[alarm] ") + a.id + " rang " + a.max_ring_sec + "s, stopping");
+      stopActiveAlarm("system", false);
+    }
+  }
+}
 
-    AlarmRuntime& r = alarmRt[i];
-    if (r.next_fire_unix == 0) r.next_fire_unix = computeNextFire(alarms[i], now);
-    if (r.next_fire_unix == 0) continue;
+// Copies URL alarm audio to flash shortly before it is due, and revalidates
+// it (If-None-Match) once for every upcoming fire.
+static void prefetchTick() {
+  audioCache.loop();
+  if (!wifiConnected || audioCache.busy() || activeAlarmIndex >= 0) return;
 
-    if (now >= r.next_fire_unix) {
-      fireAlarmNow(i, "system", true);
-      break;
-    }
+  if (millis() - lastPrefetchCheckMs < PREFETCH_CHECK_MS) return;
+  lastPrefetchCheckMs = millis();
+
+  time_t now = time(nullptr);
+  if (!isValidEpoch(now)) return;
+
+  for (int i = 0; i < MAX_ALARMS; i++) {
+    const AlarmHot& h = alarmStore.hot(i);
+    AlarmRuntime& r = alarmRt[i];
+    if (h.id == 0 || !h.enabled() || !(h.flags & ALARM_HOT_URL_AUDIO)) continue;
+    if (r.next_fire_unix == 0 || r.next_fire_unix - now > PREFETCH_LEAD_SEC) continue;
+    if (r.prefetched_for == r.next_fire_unix) continue;
+
+    AlarmConfig a;
+    r.prefetched_for = r.next_fire_unix;
+    if (!alarmStore.load(i, a)) continue;
+    if (audioCache.fetch(String(a.url))) addLogLine(String("[cache] prefetch alarm ") + a.id);
+    else addLogLine(String("[cache] prefetch failed alarm ") + a.id + " " + audioCache.lastError());
+    break;
   }
 }
 
@@ -568,7 +737,8 @@ static ButtonState btn;
 
 static void buttonTick() {
   if (activeAlarmIndex < 0) return;
-  int pin = alarms[activeAlarmIndex].gpio_pin;
+  const AlarmHot& h = alarmStore.hot(activeAlarmIndex);
+  int pin = h.gpio_pin;
   if (pin <= 0) return;
 
   bool level = (digitalRead(pin) == HIGH);
@@ -585,24 +755,46 @@ static void buttonTick() {
         addLogLine(String("[button] press start on pin ") + pin);
       } else {
         if (!btn.longFired) {
-          addLogLine(String("[button] release -> snooze alarm ") + alarms[activeAlarmIndex].id);
+          addLogLine(String("[button] release -> snooze alarm ") + h.id);
           snoozeActiveAlarm("gpio");
         }
       }
     }
   } else {
     if (!level && !btn.longFired) {
-      uint32_t lp = alarms[activeAlarmIndex].long_press_ms;
+      uint32_t lp = h.long_press_ms;
       if (lp == 0) lp = DEFAULT_LONG_PRESS_MS;
       if (nowMs - btn.pressStartMs >= lp) {
         btn.longFired = true;
-        addLogLine(String("[button] long press -> dismiss alarm ") + alarms[activeAlarmIndex].id);
+        addLogLine(String("[button] long press -> dismiss alarm ") + h.id);
         stopActiveAlarm("gpio", true);
       }
     }
   }
 }
 
+static uint32_t msUntil(uint32_t sinceMs, uint32_t periodMs) {
+  uint32_t elapsed = millis() - sinceMs;
+  return elapsed >= periodMs ? 0 : periodMs - elapsed;
+}
+
+// When buttonTick() next has something to decide without a new edge: the
+// end of a debounce, or a held button reaching the long press.
+static uint32_t buttonSleepMs() {
+  if (activeAlarmIndex < 0) return LOOP_MAX_SLEEP_MS;
+  const AlarmHot& h = alarmStore.hot(activeAlarmIndex);
+  int pin = h.gpio_pin;
+  if (pin <= 0) return LOOP_MAX_SLEEP_MS;
+
+  bool level = (digitalRead(pin) == HIGH);
+  if (level != btn.lastLevel) return msUntil(btn.lastChangeMs, BUTTON_DEBOUNCE_MS);
+  if (!level && !btn.longFired) {
+    uint32_t lp = h.long_press_ms;
+    return msUntil(btn.pressStartMs, lp ? lp : DEFAULT_LONG_PRESS_MS);
+  }
+  return LOOP_MAX_SLEEP_MS;
+}
+
 static void handlePutAlarm(AsyncWebServerRequest* req, uint32_t id);
 
 /* JSON body collector */
@@ -656,9 +848,11 @@ static void withJsonBody(AsyncWebServerRequest* req, std::function<void(JsonDocu
 /* Upload */
 struct UploadCtx {
   File file;
+  std::unique_ptr<WavTranscoder> tc;  // set when a WAV is converted to .pcm
   size_t written = 0;
   bool ok = false;
   String path;
+  String replaces;   // /audio/x.wav when it is stored as /audio/x.pcm
   String error;
 };
 static std::map<AsyncWebServerRequest*, UploadCtx> gUpload;
@@ -723,6 +917,61 @@ static void startWiFiFlow() {
 }
 
 /* API helpers */
+// month_days and weeks list -1 for the last day/weekday of the month.
+static void jsonRepeat(JsonObject o, const AlarmConfig& a) {
+  o["kind"] = repeatKindName(a.repeat_kind);
+  o["interval"] = a.repeat_interval ? a.repeat_interval : 1;
+  JsonArray days = o["month_days"].to<JsonArray>();
+  for (int d = 1; d <= 31; d++) if (a.month_days & (1UL << (d - 1))) days.add(d);
+  if (a.month_days & REPEAT_LAST_DAY) days.add(-1);
+  JsonArray weeks = o["weeks"].to<JsonArray>();
+  for (int k = 1; k <= 4; k++) if (a.month_weeks & (1 << (k - 1))) weeks.add(k);
+  if (a.month_weeks & REPEAT_LAST_WEEK) weeks.add(-1);
+  char date[11] = "";
+  if (a.repeat_start_day) isoDateFromDay(a.repeat_start_day, date);
+  o["start_date"] = date;
+}
+
+static bool applyRepeatFromJson(AlarmConfig& a, JsonObjectConst in, String& err) {
+  if (!in["kind"].isNull()) {
+    int k = repeatKindFromName(in["kind"].as<const char*>());
+    if (k < 0) { err = "repeat_kind_invalid"; return false; }
+    a.repeat_kind = (uint8_t)k;
+  }
+  if (!in["interval"].isNull()) {
+    int n = in["interval"].as<int>();
+    if (n < 1 || n > MAX_REPEAT_INTERVAL) { err = "repeat_interval_invalid"; return false; }
+    a.repeat_interval = (uint8_t)n;
+  }
+  if (!in["month_days"].isNull()) {
+    uint32_t mask = 0;
+    for (JsonVariantConst v : in["month_days"].as<JsonArrayConst>()) {
+      int d = v.as<int>();
+      if (d == -1) mask |= REPEAT_LAST_DAY;
+      else if (d >= 1 && d <= 31) mask |= 1UL << (d - 1);
+      else { err = "month_days_invalid"; return false; }
+    }
+    a.month_days = mask;
+  }
+  if (!in["weeks"].isNull()) {
+    uint8_t mask = 0;
+    for (JsonVariantConst v : in["weeks"].as<JsonArrayConst>()) {
+      int k = v.as<int>();
+      if (k == -1) mask |= REPEAT_LAST_WEEK;
+      else if (k >= 1 && k <= 4) mask |= 1 << (k - 1);
+      else { err = "weeks_invalid"; return false; }
+    }
+    a.month_weeks = mask;
+  }
+  if (!in["start_date"].isNull()) {
+    const char* sd = in["start_date"].as<const char*>();
+    int32_t day = (sd && sd[0]) ? dayFromIsoDate(sd) : 0;
+    if (day < 0 || day > 0xFFFF) { err = "start_date_invalid"; return false; }
+    a.repeat_start_day = (uint16_t)day;
+  }
+  return true;
+}
+
 static void jsonAlarm(JsonObject o, const AlarmConfig& a, const AlarmRuntime& r) {
   o["id"] = a.id;
   o["enabled"] = a.enabled;
@@ -735,12 +984,21 @@ static void jsonAlarm(JsonObject o, const AlarmConfig& a, const AlarmRuntime& r)
   o["gpio_pin"] = a.gpio_pin;
   o["long_press_ms"] = a.long_press_ms;
   o["volume"] = a.volume;
+  o["fade_in_sec"] = a.fade_in_sec;
+  o["loop_audio"] = a.loop_audio;
+  o["loop_crescendo"] = a.loop_crescendo;
+  o["max_ring_sec"] = a.max_ring_sec;
+  o["skip_holidays"] = a.skip_holidays;
+  jsonRepeat(o["repeat"].to<JsonObject>(), a);
 
   JsonObject audioObj = o["audio_source"].to<JsonObject>();
-  audioObj["type"] = (a.audio_type == AUDIO_URL) ? "url" : "local";
+  audioObj["type"] = (a.audio_type == AUDIO_URL) ? "url" : (a.audio_type == AUDIO_SYNTH) ? "synth" : "local";
   audioObj["local_path"] = a.local_path;
   audioObj["url"] = a.url;
   audioObj["fallback_local_path"] = a.fallback_local_path;
+  audioObj["synth_pattern"] = synthPatternName(a.synth_pattern);
+  audioObj["synth_freq_hz"] = a.synth_freq_hz ? a.synth_freq_hz : ToneSynth::BASE_HZ_DEFAULT;
+  audioObj["url_cached"] = (a.audio_type == AUDIO_URL) && audioCache.contains(String(a.url));
 
   JsonObject wh = o["outbound_webhooks"].to<JsonObject>();
   wh["on_set_url"] = a.on_set_url;
@@ -765,16 +1023,38 @@ static bool applyAlarmFromJson(AlarmConfig& a, JsonObjectConst in, String& err)
   if (!in["once_date"].isNull()) {
     const char* od = in["once_date"].as<const char*>();
     if (od && strlen(od) > 0) {
-      if (strlen(od) != 10) { err = "once_date_invalid"; return false; }
+      if (dayFromIsoDate(od) < 0) { err = "once_date_invalid"; return false; }
       strlcpy(a.once_date, od, sizeof(a.once_date));
     } else a.once_date[0] = 0;
   }
 
+  if (!in["repeat"].isNull()) {
+    JsonObjectConst rp = in["repeat"].as<JsonObjectConst>();
+    if (rp.isNull() || !applyRepeatFromJson(a, rp, err)) { if (!err.length()) err = "repeat_invalid"; return false; }
+  }
+  if (!in["skip_holidays"].isNull()) a.skip_holidays = in["skip_holidays"].as<bool>();
+
   if (!in["snooze_minutes"].isNull()) a.snooze_minutes = (int16_t)in["snooze_minutes"].as<int>();
   if (!in["gpio_pin"].isNull()) a.gpio_pin = (int8_t)in["gpio_pin"].as<int>();
   if (!in["long_press_ms"].isNull()) a.long_press_ms = (uint16_t)in["long_press_ms"].as<int>();
   if (!in["inbound_webhook_token"].isNull()) strlcpy(a.inbound_token, in["inbound_webhook_token"].as<const char*>(), sizeof(a.inbound_token));
   if (!in["volume"].isNull()) a.volume = (uint8_t)in["volume"].as<int>();
+  if (!in["fade_in_sec"].isNull()) {
+    int f = in["fade_in_sec"].as<int>();
+    if (f < 0 || f > MAX_FADE_IN_SEC) { err = "fade_in_invalid"; return false; }
+    a.fade_in_sec = (uint16_t)f;
+  }
+  if (!in["loop_audio"].isNull()) a.loop_audio = in["loop_audio"].as<bool>();
+  if (!in["loop_crescendo"].isNull()) {
+    int c = in["loop_crescendo"].as<int>();
+    if (c < 0 || c > MAX_LOOP_CRESCENDO) { err = "loop_crescendo_invalid"; return false; }
+    a.loop_crescendo = (uint8_t)c;
+  }
+  if (!in["max_ring_sec"].isNull()) {
+    int m = in["max_ring_sec"].as<int>();
+    if (m < 0 || m > MAX_RING_SEC) { err = "max_ring_invalid"; return false; }
+    a.max_ring_sec = (uint16_t)m;
+  }
 
   if (!in["outbound_webhooks"].isNull()) {
     JsonObjectConst wh = in["outbound_webhooks"].as<JsonObjectConst>();
@@ -791,7 +1071,17 @@ static bool applyAlarmFromJson(AlarmConfig& a, JsonObjectConst in, String& err)
     if (!as.isNull()) {
       if (!as["type"].isNull()) {
         String t = as["type"].as<String>(); t.toLowerCase();
-        a.audio_type = (t == "url") ? AUDIO_URL : AUDIO_LOCAL;
+        a.audio_type = (t == "url") ? AUDIO_URL : (t == "synth") ? AUDIO_SYNTH : AUDIO_LOCAL;
+      }
+      if (!as["synth_pattern"].isNull()) {
+        int p = synthPatternFromName(as["synth_pattern"].as<const char*>());
+        if (p < 0) { err = "synth_pattern_invalid"; return false; }
+        a.synth_pattern = (uint8_t)p;
+      }
+      if (!as["synth_freq_hz"].isNull()) {
+        int f = as["synth_freq_hz"].as<int>();
+        if (f != 0 && (f < ToneSynth::BASE_HZ_MIN || f > ToneSynth::BASE_HZ_MAX)) { err = "synth_freq_invalid"; return false; }
+        a.synth_freq_hz = (uint16_t)f;
       }
       if (!as["local_path"].isNull()) strlcpy(a.local_path, as["local_path"].as<const char*>(), sizeof(a.local_path));
       if (!as["url"].isNull()) strlcpy(a.url, as["url"].as<const char*>(), sizeof(a.url));
@@ -800,12 +1090,81 @@ static bool applyAlarmFromJson(AlarmConfig& a, JsonObjectConst in, String& err)
   }
 
   if (a.hour > 23 || a.minute > 59) { err = "time_invalid"; return false; }
+  // An interval counts from the day it is set, unless start_date says
+  // otherwise. Without a clock yet, rebuildSchedule() sets it once the
+  // clock is valid.
+  if (a.repeat_interval > 1 && a.repeat_start_day == 0) {
+    time_t now = time(nullptr);
+    if (isValidEpoch(now)) a.repeat_start_day = (uint16_t)TimeZone::dayOf(tz.toLocal(now));
+  }
   if (a.snooze_minutes < 0 || a.snooze_minutes > 240) { err = "snooze_invalid"; return false; }
   if (a.volume > 100) a.volume = 100;
 
   return true;
 }
 
+static void jsonHolidays(JsonArray arr) {
+  char date[11];
+  for (int32_t d = holidays.next(0); d >= 0; d = holidays.next(d + 1)) {
+    isoDateFromDay(d, date);
+    arr.add(date);
+  }
+}
+
+// Replaces the holiday set; years beyond HolidaySet::YEARS drop the oldest.
+static bool applyHolidaysFromJson(JsonArrayConst in, String& err) {
+  if (in.isNull()) { err = "dates_invalid"; return false; }
+  HolidaySet next;
+  for (JsonVariantConst v : in) {
+    int32_t day = dayFromIsoDate(v.as<const char*>());
+    if (day < 0) { err = "date_invalid"; return false; }
+    next.add(day);
+  }
+  holidays = next;
+  saveHolidays();
+  time_t now = time(nullptr);
+  if (isValidEpoch(now)) rebuildSchedule(now);
+  return true;
+}
+
+template <int N>
+static void jsonHistogram(JsonObject o, const Log2Histogram<N>& h, const char* unit) {
+  o["unit"] = unit;
+  o["p50"] = h.percentile(50);
+  o["p99"] = h.percentile(99);
+  JsonArray b = o["log2_buckets"].to<JsonArray>();
+  for (int i = 0; i < N; i++) b.add((uint32_t)h.count[i]);
+}
+
+// Audio telemetry. The status view carries the totals and percentiles; the
+// full view (/api/audio/stats) adds the raw histogram buckets.
+static void jsonAudioStats(JsonObject o, bool full) {
+  const AudioStats& s = audioStats;
+  o["ring_fill"] = audio.ringFill();
+  o["ring_capacity"] = audio.ringCapacity();
+  o["output_blocks"] = (uint32_t)s.pulls;
+  o["underrun_events"] = (uint32_t)s.underrunEvents;
+  o["underrun_samples"] = (uint32_t)s.underrunSamples;
+  o["decode_blocks"] = (uint32_t)s.decodeBlocks;
+  o["starts"] = (uint32_t)s.starts;
+  o["first_sample_last_ms"] = (uint32_t)s.firstSampleLastMs;
+
+  JsonObject bytes = o["source_bytes"].to<JsonObject>();
+  for (int i = 0; i < AUDIO_SRC_COUNT; i++) bytes[audioSourceTypeName(i)] = (uint32_t)s.sourceBytes[i];
+
+  if (!full) {
+    o["decode_us_p99"] = s.decodeUs.percentile(99);
+    o["output_jitter_us_p99"] = s.pullJitterUs.percentile(99);
+    o["first_sample_ms_p99"] = s.firstSampleMs.percentile(99);
+    return;
+  }
+  JsonArray fill = o["ring_fill_eighths"].to<JsonArray>();
+  for (int i = 0; i < AudioStats::FILL_BUCKETS; i++) fill.add((uint32_t)s.ringFill[i]);
+  jsonHistogram(o["decode_time"].to<JsonObject>(), s.decodeUs, "us");
+  jsonHistogram(o["output_jitter"].to<JsonObject>(), s.pullJitterUs, "us");
+  jsonHistogram(o["first_sample"].to<JsonObject>(), s.firstSampleMs, "ms");
+}
+
 /* API handlers */
 static void handleStatus(AsyncWebServerRequest* req) {
   addLogLine("[api] GET /api/status");
@@ -824,9 +1183,33 @@ static void handleStatus(AsyncWebServerRequest* req) {
   doc["ts_iso"] = isoNow();
   doc["ts_unix"] = (int64_t)now;
 
-  doc["active_alarm_id"] = (activeAlarmIndex >= 0) ? (int64_t)alarms[activeAlarmIndex].id : 0;
+  doc["active_alarm_id"] = (activeAlarmIndex >= 0) ? (int64_t)alarmStore.hot(activeAlarmIndex).id : 0;
+  doc["alarm_count"] = alarmStore.count();
+  doc["alarm_capacity"] = MAX_ALARMS;
+  doc["next_deadline_in_sec"] = isValidEpoch(now) ? secondsToNextDeadline(now) : -1;
+  doc["loop_wakeups_per_min"] = loopWake.wakeupsPerMinute();
+  doc["loop_early_wakeups_per_min"] = loopWake.earlyWakeupsPerMinute();
+  doc["loop_sleep_ms"] = loopLastSleepMs;
+  doc["power_mode"] = powerModeName(powerMode);
   doc["audio_playing"] = audio.isPlaying();
-  doc["last_audio_error"] = lastAudioError;
+  doc["audio_sink"] = audio.sinkName();
+  doc["audio_decode_cycles_per_sec"] = audio.decodeCyclesPerSecond();
+  doc["audio_resample_cycles_per_block"] = audio.resampleCyclesPerBlock();
+  doc["audio_net_buffered"] = audio.netBuffered();
+  doc["audio_underruns"] = audio.underrunCount();
+  doc["audio_underrun_ms"] = audio.underrunMs();
+  doc["audio_task_stack_free"] = audio.taskStackFree();
+  doc["audio_mix_cycles_per_block"] = audio.mixCyclesPerBlock();
+  jsonAudioStats(doc["audio_stats"].to<JsonObject>(), false);
+
+  JsonObject cache = doc["audio_cache"].to<JsonObject>();
+  cache["entries"] = audioCache.entryCount();
+  cache["bytes"] = audioCache.totalBytes();
+  cache["max_bytes"] = audioCache.maxBytes();
+  cache["fetching"] = audioCache.busy();
+  cache["last_error"] = audioCache.lastError();
+  doc["last_audio_error"] = audio.lastStartError();
+  doc["audio_index_entries"] = audioIndex.count();
 
   JsonObject fs = doc["littlefs"].to<JsonObject>();
   fs["total"] = (int64_t)LittleFS.totalBytes();
@@ -842,27 +1225,63 @@ static void handleStatus(AsyncWebServerRequest* req) {
   req->send(200, "application/json", out);
 }
 
+// Alarm lists are sent chunked, one alarm read and serialized at a time,
+// so a full table never has to fit in RAM. head and tail wrap the array.
+struct AlarmListStream {
+  String pending;
+  String tail;
+  int next = 0;
+  bool withToken = false;
+  bool first = true;
+  bool done = false;
+};
+
+static void sendAlarmList(AsyncWebServerRequest* req, const String& head, const String& tail, bool withToken) {
+  auto st = std::make_shared<AlarmListStream>();
+  st->pending = head + "[";
+  st->tail = String("]") + tail;
+  st->withToken = withToken;
+
+  req->send(req->beginChunkedResponse("application/json", [st](uint8_t* buf, size_t maxLen, size_t) -> size_t {
+    while (st->pending.length() == 0 && !st->done) {
+      AlarmConfig a;
+      while (st->next < MAX_ALARMS && (alarmStore.hot(st->next).id == 0 || !alarmStore.load(st->next, a))) st->next++;
+      if (st->next >= MAX_ALARMS) {
+        st->pending = st->tail;
+        st->done = true;
+        break;
+      }
+      JsonDocument doc;
+      JsonObject o = doc.to<JsonObject>();
+      jsonAlarm(o, a, alarmRt[st->next]);
+      if (st->withToken) o["inbound_webhook_token"] = a.inbound_token;
+      String item; serializeJson(doc, item);
+      st->pending = st->first ? item : String(",") + item;
+      st->first = false;
+      st->next++;
+    }
+    size_t n = min(maxLen, (size_t)st->pending.length());
+    memcpy(buf, st->pending.c_str(), n);
+    st->pending.remove(0, n);
+    return n;
+  }));
+}
+
 static void handleGetAlarms(AsyncWebServerRequest* req) {
   addLogLine("[api] GET /api/alarms");
-  JsonDocument doc;
-  JsonArray arr = doc.to<JsonArray>();
-  for (int i = 0; i < MAX_ALARMS; i++) {
-    if (alarms[i].id == 0) continue;
-    JsonObject o = arr.add<JsonObject>();
-    jsonAlarm(o, alarms[i], alarmRt[i]);
-  }
-  String out; serializeJson(doc, out);
-  req->send(200, "application/json", out);
+  sendAlarmList(req, "", "", false);
 }
 
 static void handleGetAlarmById(AsyncWebServerRequest* req, uint32_t id) {
   addLogLine(String("[api] GET /api/alarms/") + id);
   int idx = findAlarmIndexById(id);
   if (idx < 0) { req->send(404, "application/json", "{\"error\":\"not_found\"}"); return; }
+  AlarmConfig a;
+  if (!alarmStore.load(idx, a)) { req->send(500, "application/json", "{\"error\":\"storage\"}"); return; }
   JsonDocument doc;
   JsonObject o = doc.to<JsonObject>();
-  jsonAlarm(o, alarms[idx], alarmRt[idx]);
-  o["inbound_webhook_token"] = alarms[idx].inbound_token;
+  jsonAlarm(o, a, alarmRt[idx]);
+  o["inbound_webhook_token"] = a.inbound_token;
   String out; serializeJson(doc, out);
   req->send(200, "application/json", out);
 }
@@ -873,8 +1292,7 @@ static void handlePostAlarm(AsyncWebServerRequest* req) {
   withJsonBody(req, [&](JsonDocument& doc) {
     JsonObjectConst in = doc.as<JsonObjectConst>();
 
-    int freeIdx = -1;
-    for (int i = 0; i < MAX_ALARMS; i++) if (alarms[i].id == 0) { freeIdx = i; break; }
+    int freeIdx = alarmStore.freeSlot();
     if (freeIdx < 0) { req->send(409, "application/json", "{\"error\":\"max_alarms\"}"); return; }
 
     AlarmConfig a {};
@@ -898,9 +1316,11 @@ static void handlePostAlarm(AsyncWebServerRequest* req) {
       return;
     }
 
-    alarms[freeIdx] = a;
-    alarmRt[freeIdx].next_fire_unix = computeNextFire(alarms[freeIdx], time(nullptr));
-    saveAlarmToNvs(freeIdx);
+    if (!alarmStore.save(freeIdx, a)) {
+      req->send(500, "application/json", String("{\"error\":\"") + alarmStore.lastError() + "\"}");
+      return;
+    }
+    setNextFire(freeIdx, computeNextFire(alarmStore.hot(freeIdx), time(nullptr)));
     ensurePinsConfigured();
 
     if (strlen(a.on_set_url) > 0) fireOutboundEvent(a, "set", "webgui", String(a.on_set_url));
@@ -922,16 +1342,21 @@ static void handlePutAlarm(AsyncWebServerRequest* req, uint32_t id) {
   withJsonBody(req, [&](JsonDocument& doc) {
     JsonObjectConst in = doc.as<JsonObjectConst>();
     String err;
-    if (!applyAlarmFromJson(alarms[idx], in, err)) {
+    AlarmConfig a;
+    if (!loadAlarmForAction(idx, a, "update")) { req->send(500, "application/json", "{\"error\":\"storage\"}"); return; }
+    if (!applyAlarmFromJson(a, in, err)) {
       req->send(400, "application/json", String("{\"error\":\"") + err + "\"}");
       return;
     }
+    if (!alarmStore.save(idx, a)) {
+      req->send(500, "application/json", String("{\"error\":\"") + alarmStore.lastError() + "\"}");
+      return;
+    }
 
-    saveAlarmToNvs(idx);
     ensurePinsConfigured();
-    alarmRt[idx].next_fire_unix = computeNextFire(alarms[idx], time(nullptr));
+    setNextFire(idx, computeNextFire(alarmStore.hot(idx), time(nullptr)));
 
-    if (strlen(alarms[idx].on_set_url) > 0) fireOutboundEvent(alarms[idx], "set", "webgui", String(alarms[idx].on_set_url));
+    if (strlen(a.on_set_url) > 0) fireOutboundEvent(a, "set", "webgui", String(a.on_set_url));
     req->send(200, "application/json", "{\"ok\":true}");
   });
 }
@@ -943,9 +1368,9 @@ static void handleDeleteAlarm(AsyncWebServerRequest* req, uint32_t id) {
   int idx = findAlarmIndexById(id);
   if (idx < 0) { req->send(404, "application/json", "{\"error\":\"not_found\"}"); return; }
 
-  memset(&alarms[idx], 0, sizeof(AlarmConfig));
+  alarmStore.erase(idx);
   alarmRt[idx] = AlarmRuntime{};
-  saveAlarmToNvs(idx);
+  schedule.remove(idx);
   req->send(200, "application/json", "{\"ok\":true}");
 }
 
@@ -956,17 +1381,33 @@ static void handleEnableDisable(AsyncWebServerRequest* req, uint32_t id, bool en
   int idx = findAlarmIndexById(id);
   if (idx < 0) { req->send(404, "application/json", "{\"error\":\"not_found\"}"); return; }
 
-  alarms[idx].enabled = en;
-  saveAlarmToNvs(idx);
-  alarmRt[idx].next_fire_unix = computeNextFire(alarms[idx], time(nullptr));
+  AlarmConfig a;
+  if (!loadAlarmForAction(idx, a, en ? "enable" : "disable")) { req->send(500, "application/json", "{\"error\":\"storage\"}"); return; }
+  a.enabled = en;
+  if (!alarmStore.save(idx, a)) {
+    req->send(500, "application/json", String("{\"error\":\"") + alarmStore.lastError() + "\"}");
+    return;
+  }
+  setNextFire(idx, computeNextFire(alarmStore.hot(idx), time(nullptr)));
 
   String ev = en ? "enabled" : "disabled";
   addLogLine(String("[alarm] ") + id + " " + ev + " via webgui");
-  if (strlen(alarms[idx].on_set_url) > 0) fireOutboundEvent(alarms[idx], ev, "webgui", String(alarms[idx].on_set_url));
+  if (strlen(a.on_set_url) > 0) fireOutboundEvent(a, ev, "webgui", String(a.on_set_url));
 
   req->send(200, "application/json", "{\"ok\":true}");
 }
 
+// Playback starts in the background: 202 with the job to poll.
+static void sendAudioJobAccepted(AsyncWebServerRequest* req, uint32_t job) {
+  if (!job) { req->send(500, "application/json", "{\"ok\":false,\"error\":\"audio_start_failed\"}"); return; }
+  JsonDocument doc;
+  doc["ok"] = true;
+  doc["job"] = job;
+  doc["status_url"] = String("/api/audio/jobs/") + job;
+  String out; serializeJson(doc, out);
+  req->send(202, "application/json", out);
+}
+
 static void handleSnoozeDismissFire(AsyncWebServerRequest* req, uint32_t id, const String& action) {
   if (!requireAdmin(req)) return;
   addLogLine(String("[api] POST /api/alarms/") + id + "/" + action);
@@ -976,18 +1417,23 @@ static void handleSnoozeDismissFire(AsyncWebServerRequest* req, uint32_t id, con
 
   if (action == "fire") {
     addLogLine(String("[alarm] ") + id + " fire via webgui");
-    fireAlarmNow(idx, "webgui", false);
-    req->send(200, "application/json", "{\"ok\":true}");
+    if (!fireAlarmNow(idx, "webgui", false)) { req->send(500, "application/json", "{\"error\":\"storage\"}"); return; }
+    sendAudioJobAccepted(req, alarmAudioJob);
     return;
   }
 
-  if (activeAlarmIndex < 0 || alarms[activeAlarmIndex].id != id) {
+  if (activeAlarmIndex != idx) {
     addLogLine(String("[alarm] ") + id + " action=" + action + " but no active alarm");
     req->send(409, "application/json", "{\"error\":\"not_ringing\"}");
     return;
   }
 
-  if (action == "snooze") { addLogLine(String("[alarm] ") + id + " snooze via webgui"); snoozeActiveAlarm("webgui"); req->send(200, "application/json", "{\"ok\":true}"); return; }
+  if (action == "snooze") {
+    addLogLine(String("[alarm] ") + id + " snooze via webgui");
+    if (!snoozeActiveAlarm("webgui")) { req->send(500, "application/json", "{\"error\":\"storage\"}"); return; }
+    req->send(200, "application/json", "{\"ok\":true}");
+    return;
+  }
   if (action == "dismiss") { addLogLine(String("[alarm] ") + id + " dismiss via webgui"); stopActiveAlarm("webgui", true); req->send(200, "application/json", "{\"ok\":true}"); return; }
 
   req->send(400, "application/json", "{\"error\":\"bad_action\"}");
@@ -1000,13 +1446,140 @@ static void handleTestAudio(AsyncWebServerRequest* req, uint32_t id) {
   int idx = findAlarmIndexById(id);
   if (idx < 0) { req->send(404, "application/json", "{\"error\":\"not_found\"}"); return; }
 
-  bool ok = playAlarmAudioWithFallback(alarms[idx]);
-  addLogLine(String("[audio] test alarm ") + id + (ok ? " ok" : " failed"));
+  AlarmConfig a;
+  if (!loadAlarmForAction(idx, a, "test audio")) { req->send(500, "application/json", "{\"error\":\"storage\"}"); return; }
+  uint32_t job = startAlarmAudio(a, AUDIO_VOICE_PREVIEW);
+  addLogLine(String("[audio] test alarm ") + id + " job " + job);
+  sendAudioJobAccepted(req, job);
+}
+
+// GET /api/audio/jobs lists recent start jobs, /api/audio/jobs/{id} one of them.
+static void handleAudioJobs(AsyncWebServerRequest* req) {
+  String rest = req->url().substring(strlen("/api/audio/jobs"));
+  JsonDocument doc;
+  if (rest.length() > 1) {
+    AudioJobStatus st;
+    if (!audio.jobStatus((uint32_t)rest.substring(1).toInt(), st)) {
+      req->send(404, "application/json", "{\"error\":\"not_found\"}");
+      return;
+    }
+    jsonAudioJob(doc.to<JsonObject>(), st);
+  } else {
+    std::vector<AudioJobStatus> list(8);
+    size_t n = audio.recentJobs(list.data(), list.size());
+    JsonArray arr = doc["jobs"].to<JsonArray>();
+    for (size_t i = 0; i < n; i++) jsonAudioJob(arr.add<JsonObject>(), list[i]);
+  }
+  String out; serializeJson(doc, out);
+  req->send(200, "application/json", out);
+}
+
+static void handleAudioStats(AsyncWebServerRequest* req) {
   JsonDocument doc;
-  doc["ok"] = ok;
-  doc["last_audio_error"] = lastAudioError;
+  jsonAudioStats(doc.to<JsonObject>(), true);
   String out; serializeJson(doc, out);
-  req->send(ok ? 200 : 500, "application/json", out);
+  req->send(200, "application/json", out);
+}
+
+static void handleAudioVoices(AsyncWebServerRequest* req) {
+  JsonDocument doc;
+  JsonArray arr = doc["voices"].to<JsonArray>();
+  for (uint8_t v = 0; v < AUDIO_VOICE_COUNT; v++) {
+    AudioVoiceStatus st = audio.voiceStatus(v);
+    JsonObject o = arr.add<JsonObject>();
+    o["voice"] = audioVoiceName(v);
+    o["active"] = st.active;
+    if (!st.active) continue;
+    o["kind"] = st.kind;
+    o["looping"] = st.looping;
+    o["loops"] = st.loops;
+    o["target"] = st.target;
+    if (st.title.length()) o["title"] = st.title;
+    o["volume"] = st.volume;
+    o["played_ms"] = st.playedMs;
+  }
+  doc["mix_cycles_per_block"] = audio.mixCyclesPerBlock();
+  String out; serializeJson(doc, out);
+  req->send(200, "application/json", out);
+}
+
+// Plays a file or URL on a non-alarm voice, e.g. a chime over a ringing alarm.
+static void handleAudioPlay(AsyncWebServerRequest* req) {
+  if (!requireAdmin(req)) return;
+  addLogLine("[api] POST /api/audio/play");
+
+  withJsonBody(req, [&](JsonDocument& doc) {
+    int voice = audioVoiceFromName(doc["voice"] | "chime");
+    if (voice < 0) { req->send(400, "application/json", "{\"error\":\"bad_voice\"}"); return; }
+    if (voice == AUDIO_VOICE_ALARM) { req->send(409, "application/json", "{\"error\":\"voice_reserved\"}"); return; }
+
+    AudioChain chain;
+    chain.voice = (uint8_t)voice;
+    chain.volume = (uint8_t)constrain((int)(doc["volume"] | 70), 0, 100);
+    String path = doc["path"] | "";
+    String url = doc["url"] | "";
+    bool added;
+    if (!doc["synth"].isNull()) {
+      int p = synthPatternFromName(doc["synth"].as<const char*>());
+      if (p < 0) { req->send(400, "application/json", "{\"error\":\"bad_synth_pattern\"}"); return; }
+      added = chain.addSynth((uint8_t)p, (uint16_t)(doc["freq_hz"] | 0));
+    } else if (path.length()) {
+      AudioAssetInfo info;
+      bool known = audioIndex.lookup(path, info);
+      added = chain.addLocal(path, known ? &info : nullptr);
+    }
+    else if (url.length()) added = chain.addUrl(url);
+    else { req->send(400, "application/json", "{\"error\":\"missing_source\"}"); return; }
+    if (!added) { req->send(400, "application/json", "{\"error\":\"source_too_long\"}"); return; }
+
+    sendAudioJobAccepted(req, audio.startChain(chain));
+  });
+}
+
+static void handleGetHolidays(AsyncWebServerRequest* req) {
+  JsonDocument doc;
+  jsonHolidays(doc["dates"].to<JsonArray>());
+  doc["count"] = holidays.count();
+  doc["max_years"] = HolidaySet::YEARS;
+  String out; serializeJson(doc, out);
+  req->send(200, "application/json", out);
+}
+
+static void handlePutHolidays(AsyncWebServerRequest* req) {
+  if (!requireAdmin(req)) return;
+  addLogLine("[api] PUT /api/holidays");
+
+  withJsonBody(req, [&](JsonDocument& doc) {
+    String err;
+    if (!applyHolidaysFromJson(doc["dates"].as<JsonArrayConst>(), err)) {
+      req->send(400, "application/json", String("{\"error\":\"") + err + "\"}");
+      return;
+    }
+    req->send(200, "application/json", String("{\"ok\":true,\"count\":") + holidays.count() + "}");
+  });
+}
+
+static void handleAudioStop(AsyncWebServerRequest* req) {
+  if (!requireAdmin(req)) return;
+
+  uint8_t voice = AUDIO_VOICE_ALL;
+  if (req->hasParam("voice")) {
+    int v = audioVoiceFromName(req->getParam("voice")->value());
+    if (v < 0) { req->send(400, "application/json", "{\"error\":\"bad_voice\"}"); return; }
+    voice = (uint8_t)v;
+  }
+  // The alarm voice is owned by the ringing alarm; dismiss/snooze stops it.
+  if (voice == AUDIO_VOICE_ALARM && activeAlarmIndex >= 0) {
+    req->send(409, "application/json", "{\"error\":\"alarm_ringing\"}");
+    return;
+  }
+  if (voice == AUDIO_VOICE_ALL && activeAlarmIndex >= 0) {
+    audio.stop(AUDIO_VOICE_CHIME);
+    audio.stop(AUDIO_VOICE_PREVIEW);
+  } else {
+    audio.stop(voice);
+  }
+  req->send(200, "application/json", "{\"ok\":true}");
 }
 
 static void handleFilesList(AsyncWebServerRequest* req) {
@@ -1015,21 +1588,22 @@ static void handleFilesList(AsyncWebServerRequest* req) {
   JsonDocument doc;
   JsonArray arr = doc.to<JsonArray>();
 
-  File root = LittleFS.open("/audio", "r");
-  if (root && root.isDirectory()) {
-    File f = root.openNextFile();
-    while (f) {
-      if (!f.isDirectory()) {
-        JsonObject o = arr.add<JsonObject>();
-        String fname = f.name();
-        String name = fname;
-        int slash = name.lastIndexOf('/');
-        if (slash >= 0 && slash + 1 < name.length()) name = name.substring(slash + 1);
-        o["name"] = name;
-        o["path"] = fname.startsWith("/") ? fname : (String("/audio/") + fname);
-        o["size"] = (int64_t)f.size();
-      }
-      f = root.openNextFile();
+  for (const AudioAsset& a : audioIndex.snapshot()) {
+    JsonObject o = arr.add<JsonObject>();
+    o["name"] = a.path.substring(a.path.lastIndexOf('/') + 1);
+    o["path"] = a.path;
+    o["size"] = a.info.size;
+    o["format"] = audioAssetFormatName(a.info.format);
+    if (a.info.format == AUDIO_ASSET_UNKNOWN) continue;
+    o["sample_rate"] = a.info.sampleRate;
+    o["channels"] = a.info.channels;
+    if (a.info.bits) o["bits"] = a.info.bits;
+    o["duration_ms"] = a.info.durationMs;
+    if (a.info.levels) {
+      o["peak"] = a.info.peak;
+      o["rms"] = a.info.rms;
+      if (a.info.loudness != LoudnessMeter::NONE) o["loudness_lufs"] = a.info.loudness / 10.0f;
+      if (a.info.normGain) o["norm_gain_db"] = roundf(200.0f * log10f((float)a.info.normGain / LOUDNESS_GAIN_UNITY)) / 10.0f;
     }
   }
 
@@ -1057,7 +1631,10 @@ static void handleFilesDelete(AsyncWebServerRequest* req) {
   if (!fileExists(path.c_str())) { req->send(404, "application/json", "{\"error\":\"not_found\"}"); return; }
   if (isFileUsedByAnyAlarm(path)) { req->send(409, "application/json", "{\"error\":\"file_in_use\"}"); return; }
 
+  audioIndex.remove(path);
   bool ok = LittleFS.remove(path);
+  if (!ok) audioIndex.update(path);
+  loopWake.wake();   // the index is saved from loop()
   req->send(ok ? 200 : 500, "application/json", ok ? "{\"ok\":true}" : "{\"error\":\"delete_failed\"}");
 }
 
@@ -1070,19 +1647,18 @@ static void handleConfigExport(AsyncWebServerRequest* req) {
   JsonObject sys = doc["system"].to<JsonObject>();
   sys["admin_token"] = adminToken;
   sys["audio_pwm_pin"] = prefs.getInt("audpin", DEFAULT_AUDIO_PWM_PIN);
+  sys["audio_sink"] = prefs.getString("audsink", DEFAULT_AUDIO_SINK);
+  sys["audio_net_start_bytes"] = prefs.getULong("netstart", AUDIO_NET_START_DEFAULT);
+  sys["audio_net_low_bytes"] = prefs.getULong("netlow", AUDIO_NET_LOW_DEFAULT);
+  sys["audio_cache_max_bytes"] = prefs.getULong("cachemax", AUDIO_CACHE_MAX_DEFAULT);
+  sys["audio_normalize"] = prefs.getBool("audnorm", true);
   sys["wifi_ssid"] = prefs.getString("ssid", "");
   sys["wifi_pass"] = prefs.getString("pass", "");
+  jsonHolidays(doc["holidays"].to<JsonArray>());
 
-  JsonArray arr = doc["alarms"].to<JsonArray>();
-  for (int i = 0; i < MAX_ALARMS; i++) {
-    if (alarms[i].id == 0) continue;
-    JsonObject o = arr.add<JsonObject>();
-    jsonAlarm(o, alarms[i], alarmRt[i]);
-    o["inbound_webhook_token"] = alarms[i].inbound_token;
-  }
-
-  String out; serializeJson(doc, out);
-  req->send(200, "application/json", out);
+  String head; serializeJson(doc, head);
+  head.remove(head.length() - 1);   // reopen the object for "alarms"
+  sendAlarmList(req, head + ",\"alarms\":", "}", true);
 }
 
 static void handleLogs(AsyncWebServerRequest* req) {
@@ -1107,22 +1683,46 @@ static void handleConfigImport(AsyncWebServerRequest* req) {
           adminToken = sys["admin_token"].as<String>();
           prefs.putString("admin", adminToken);
         }
-        if (!sys["audio_pwm_pin"].isNull()) {
-          int pin = sys["audio_pwm_pin"].as<int>();
-          prefs.putInt("audpin", pin);
-          audio.begin(pin);
+        if (!sys["audio_sink"].isNull()) {
+          prefs.putString("audsink", sys["audio_sink"].as<String>());
+        }
+        if (!sys["audio_pwm_pin"].isNull() || !sys["audio_sink"].isNull()) {
+          int pin = prefs.getInt("audpin", DEFAULT_AUDIO_PWM_PIN);
+          if (!sys["audio_pwm_pin"].isNull()) {
+            pin = sys["audio_pwm_pin"].as<int>();
+            prefs.putInt("audpin", pin);
+          }
+          audio.begin(pin, audioSinkFromName(prefs.getString("audsink", DEFAULT_AUDIO_SINK)));
+        }
+        if (!sys["audio_net_start_bytes"].isNull() || !sys["audio_net_low_bytes"].isNull()) {
+          if (!sys["audio_net_start_bytes"].isNull()) prefs.putULong("netstart", sys["audio_net_start_bytes"].as<uint32_t>());
+          if (!sys["audio_net_low_bytes"].isNull()) prefs.putULong("netlow", sys["audio_net_low_bytes"].as<uint32_t>());
+          audio.setNetWatermarks(prefs.getULong("netstart", AUDIO_NET_START_DEFAULT),
+                                 prefs.getULong("netlow", AUDIO_NET_LOW_DEFAULT));
+        }
+        if (!sys["audio_cache_max_bytes"].isNull()) {
+          prefs.putULong("cachemax", sys["audio_cache_max_bytes"].as<uint32_t>());
+          audioCache.setMaxBytes(prefs.getULong("cachemax", AUDIO_CACHE_MAX_DEFAULT));
+        }
+        if (!sys["audio_normalize"].isNull()) {
+          prefs.putBool("audnorm", sys["audio_normalize"].as<bool>());
+          audio.setNormalize(prefs.getBool("audnorm", true));
         }
         if (!sys["wifi_ssid"].isNull()) prefs.putString("ssid", sys["wifi_ssid"].as<const char*>());
         if (!sys["wifi_pass"].isNull()) prefs.putString("pass", sys["wifi_pass"].as<const char*>());
       }
     }
 
-    for (int i = 0; i < MAX_ALARMS; i++) {
-      memset(&alarms[i], 0, sizeof(AlarmConfig));
-      alarms[i].version = FW_CONFIG_VERSION;
-      saveAlarmToNvs(i);
+    if (!root["holidays"].isNull()) {
+      String err;
+      if (!applyHolidaysFromJson(root["holidays"].as<JsonArrayConst>(), err)) {
+        req->send(400, "application/json", String("{\"error\":\"") + err + "\"}");
+        return;
+      }
     }
 
+    for (int i = 0; i < MAX_ALARMS; i++) if (alarmStore.hot(i).id != 0) alarmStore.erase(i);
+
     if (!root["alarms"].isNull()) {
       JsonArrayConst arr = root["alarms"].as<JsonArrayConst>();
       int idx = 0;
@@ -1141,8 +1741,7 @@ static void handleConfigImport(AsyncWebServerRequest* req) {
         String err;
         if (!applyAlarmFromJson(a, aIn, err)) continue;
 
-        alarms[idx] = a;
-        saveAlarmToNvs(idx);
+        if (!alarmStore.save(idx, a)) break;
         idx++;
       }
     }
@@ -1167,7 +1766,9 @@ static void handleAlarmWebhook(AsyncWebServerRequest* req, uint32_t id) {
 
   if (!req->hasParam("token")) { req->send(401, "application/json", "{\"error\":\"missing_token\"}"); return; }
   String token = req->getParam("token")->value();
-  if (token != String(alarms[idx].inbound_token)) { req->send(401, "application/json", "{\"error\":\"bad_token\"}"); return; }
+  AlarmConfig a;
+  if (!alarmStore.load(idx, a)) { req->send(500, "application/json", "{\"error\":\"storage\"}"); return; }
+  if (token != a.inbound_token) { req->send(401, "application/json", "{\"error\":\"bad_token\"}"); return; }
 
   withJsonBody(req, [&](JsonDocument& doc) {
     JsonObjectConst in = doc.as<JsonObjectConst>();
@@ -1175,34 +1776,39 @@ static void handleAlarmWebhook(AsyncWebServerRequest* req, uint32_t id) {
 
     if (action == "set") {
       String err;
-      if (!applyAlarmFromJson(alarms[idx], in, err)) { req->send(400, "application/json", String("{\"error\":\"") + err + "\"}"); return; }
-      saveAlarmToNvs(idx);
-      alarmRt[idx].next_fire_unix = computeNextFire(alarms[idx], time(nullptr));
-      if (strlen(alarms[idx].on_set_url) > 0) fireOutboundEvent(alarms[idx], "set", "webhook", String(alarms[idx].on_set_url));
+      if (!applyAlarmFromJson(a, in, err)) { req->send(400, "application/json", String("{\"error\":\"") + err + "\"}"); return; }
+      alarmStore.save(idx, a);
+      setNextFire(idx, computeNextFire(alarmStore.hot(idx), time(nullptr)));
+      if (strlen(a.on_set_url) > 0) fireOutboundEvent(a, "set", "webhook", String(a.on_set_url));
       req->send(200, "application/json", "{\"ok\":true}");
       return;
     }
 
-    if (action == "enable") { alarms[idx].enabled = true; saveAlarmToNvs(idx); alarmRt[idx].next_fire_unix = computeNextFire(alarms[idx], time(nullptr));
-      if (strlen(alarms[idx].on_set_url) > 0) fireOutboundEvent(alarms[idx], "enabled", "webhook", String(alarms[idx].on_set_url));
+    if (action == "enable") { a.enabled = true; alarmStore.save(idx, a); setNextFire(idx, computeNextFire(alarmStore.hot(idx), time(nullptr)));
+      if (strlen(a.on_set_url) > 0) fireOutboundEvent(a, "enabled", "webhook", String(a.on_set_url));
       req->send(200, "application/json", "{\"ok\":true}"); return;
     }
 
-    if (action == "disable") { alarms[idx].enabled = false; saveAlarmToNvs(idx); alarmRt[idx].next_fire_unix = 0;
-      if (strlen(alarms[idx].on_set_url) > 0) fireOutboundEvent(alarms[idx], "disabled", "webhook", String(alarms[idx].on_set_url));
+    if (action == "disable") { a.enabled = false; alarmStore.save(idx, a); setNextFire(idx, 0);
+      if (strlen(a.on_set_url) > 0) fireOutboundEvent(a, "disabled", "webhook", String(a.on_set_url));
       req->send(200, "application/json", "{\"ok\":true}"); return;
     }
 
-    if (action == "fire") { fireAlarmNow(idx, "webhook", false); req->send(200, "application/json", "{\"ok\":true}"); return; }
+    if (action == "fire") {
+      if (!fireAlarmNow(idx, "webhook", false)) { req->send(500, "application/json", "{\"error\":\"storage\"}"); return; }
+      sendAudioJobAccepted(req, alarmAudioJob);
+      return;
+    }
 
     if (action == "snooze") {
-      if (activeAlarmIndex >= 0 && alarms[activeAlarmIndex].id == id) { snoozeActiveAlarm("webhook"); req->send(200, "application/json", "{\"ok\":true}"); }
-      else req->send(409, "application/json", "{\"error\":\"not_ringing\"}");
+      if (activeAlarmIndex != idx) req->send(409, "application/json", "{\"error\":\"not_ringing\"}");
+      else if (!snoozeActiveAlarm("webhook")) req->send(500, "application/json", "{\"error\":\"storage\"}");
+      else req->send(200, "application/json", "{\"ok\":true}");
       return;
     }
 
     if (action == "dismiss") {
-      if (activeAlarmIndex >= 0 && alarms[activeAlarmIndex].id == id) { stopActiveAlarm("webhook", true); req->send(200, "application/json", "{\"ok\":true}"); }
+      if (activeAlarmIndex == idx) { stopActiveAlarm("webhook", true); req->send(200, "application/json", "{\"ok\":true}"); }
       else req->send(409, "application/json", "{\"error\":\"not_ringing\"}");
       return;
     }
@@ -1223,54 +1829,34 @@ static bool parseIdFromPath(const String& path, const char* prefix, uint32_t& id
 }
 
 /* Default audio */
+// Older firmware wrote one second of silence to /audio/default.wav as the
+// last-resort sound. The tone synthesizer replaces it, and a silent file
+// would shadow it, so the placeholder is removed if it is still unchanged.
+static void removeSilentDefaultAudio() {
+  const char* path = "/audio/default.wav";
+  File f = LittleFS.open(path, "r");
+  if (!f) return;
+  bool silent = (f.size() == 44 + 32000) && f.seek(44);
+  uint8_t buf[512];
+  while (silent && f.available()) {
+    size_t n = f.read(buf, sizeof(buf));
+    if (n == 0) break;
+    for (size_t i = 0; i < n && silent; i++) silent = (buf[i] == 0);
+  }
+  f.close();
+  if (silent) {
+    LittleFS.remove(path);
+    addLogLine("[audio] removed silent default.wav placeholder");
+  }
+}
+
 static void ensureDefaultAudio() {
   if (!LittleFS.exists("/audio")) LittleFS.mkdir("/audio");
-  if (!LittleFS.exists("/audio/default.wav")) {
-    File f = LittleFS.open("/audio/default.wav", "w");
-    if (f) {
-      const uint32_t sr = 16000;
-      const uint16_t ch = 1;
-      const uint16_t bits = 16;
-      const uint32_t samples = sr * 1;
-      const uint32_t dataSize = samples * 2;
-
-      uint8_t h[44] = {0};
-      memcpy(h + 0, "RIFF", 4);
-      uint32_t riffSize = 36 + dataSize;
-      h[4] = riffSize & 0xFF; h[5] = (riffSize >> 8) & 0xFF; h[6] = (riffSize >> 16) & 0xFF; h[7] = (riffSize >> 24) & 0xFF;
-      memcpy(h + 8, "WAVE", 4);
-      memcpy(h + 12, "fmt ", 4);
-      uint32_t fmtSize = 16;
-      h[16] = fmtSize & 0xFF; h[17] = (fmtSize >> 8) & 0xFF; h[18] = (fmtSize >> 16) & 0xFF; h[19] = (fmtSize >> 24) & 0xFF;
-      uint16_t audioFmt = 1;
-      h[20] = audioFmt & 0xFF; h[21] = (audioFmt >> 8) & 0xFF;
-      h[22] = ch & 0xFF; h[23] = (ch >> 8) & 0xFF;
-      h[24] = sr & 0xFF; h[25] = (sr >> 8) & 0xFF; h[26] = (sr >> 16) & 0xFF; h[27] = (sr >> 24) & 0xFF;
-      uint32_t byteRate = sr * ch * (bits / 8);
-      h[28] = byteRate & 0xFF; h[29] = (byteRate >> 8) & 0xFF; h[30] = (byteRate >> 16) & 0xFF; h[31] = (byteRate >> 24) & 0xFF;
-      uint16_t blockAlign = ch * (bits / 8);
-      h[32] = blockAlign & 0xFF; h[33] = (blockAlign >> 8) & 0xFF;
-      h[34] = bits & 0xFF; h[35] = (bits >> 8) & 0xFF;
-      memcpy(h + 36, "data", 4);
-      h[40] = dataSize & 0xFF; h[41] = (dataSize >> 8) & 0xFF; h[42] = (dataSize >> 16) & 0xFF; h[43] = (dataSize >> 24) & 0xFF;
-
-      f.write(h, 44);
-      uint8_t zeros[512] = {0};
-      uint32_t rem = dataSize;
-      while (rem > 0) {
-        uint32_t n = min((uint32_t)sizeof(zeros), rem);
-        f.write(zeros, n);
-        rem -= n;
-      }
-      f.close();
-    }
-  }
+  removeSilentDefaultAudio();
 }
 
 static void ensureAtLeastOneAlarm() {
-  bool any = false;
-  for (int i = 0; i < MAX_ALARMS; i++) if (alarms[i].id != 0) any = true;
-  if (any) return;
+  if (alarmStore.count() > 0) return;
 
   AlarmConfig a {};
   a.version = FW_CONFIG_VERSION;
@@ -1287,9 +1873,8 @@ static void ensureAtLeastOneAlarm() {
   strlcpy(a.local_path, "/audio/default.wav", sizeof(a.local_path));
   a.volume = 80;
 
-  alarms[0] = a;
-  saveAlarmToNvs(0);
-  alarmRt[0].next_fire_unix = computeNextFire(alarms[0], time(nullptr));
+  if (!alarmStore.save(0, a)) return;
+  setNextFire(0, computeNextFire(alarmStore.hot(0), time(nullptr)));
 }
 
 /* Server */
@@ -1366,12 +1951,51 @@ server.on("/app.js", HTTP_GET, [](AsyncWebServerRequest* req) {
       if (!requireAdmin(req)) return;
 
       auto it = gUpload.find(req);
-      bool ok = (it != gUpload.end() && it->second.ok);
-      String err = (it != gUpload.end()) ? it->second.error : "no_ctx";
-      if (it != gUpload.end()) gUpload.erase(it);
+      if (it == gUpload.end()) {
+        req->send(400, "application/json", "{\"error\":\"upload_failed\",\"detail\":\"no_ctx\"}");
+        return;
+      }
+      UploadCtx& ctx = it->second;
+      if (!ctx.ok) {
+        req->send(400, "application/json", String("{\"error\":\"upload_failed\",\"detail\":\"") + ctx.error + "\"}");
+        gUpload.erase(it);
+        return;
+      }
 
-      if (ok) req->send(200, "application/json", "{\"ok\":true}");
-      else req->send(400, "application/json", String("{\"error\":\"upload_failed\",\"detail\":\"") + err + "\"}");
+      JsonDocument doc;
+      doc["ok"] = true;
+      doc["path"] = ctx.path;
+      doc["source_size"] = (int64_t)ctx.written;
+      // x.wav stored as x.pcm: alarms follow the new file, and an older
+      // x.wav goes once nothing refers to it any more.
+      if (ctx.replaces.length()) {
+        int moved = redirectAlarmAudio(ctx.replaces, ctx.path);
+        doc["alarms_updated"] = max(moved, 0);
+        if (moved >= 0 && fileExists(ctx.replaces.c_str())) {
+          audioIndex.remove(ctx.replaces);
+          if (LittleFS.remove(ctx.replaces)) doc["replaced"] = ctx.replaces;
+          else audioIndex.update(ctx.replaces);
+        }
+        if (moved > 0) addLogLine(String("[upload] ") + moved + " alarm(s) moved from " + ctx.replaces + " to " + ctx.path);
+      }
+      if (ctx.tc) {
+        const NativePcmInfo& info = ctx.tc->info();
+        doc["format"] = (ctx.tc->format() == TRANSCODE_ADPCM) ? "adpcm" : "pcm";
+        doc["size"] = ctx.tc->bytesWritten();
+        doc["sample_rate"] = info.sampleRate;
+        doc["bits"] = info.bits;
+        doc["samples"] = info.samples;
+        doc["source_rate"] = ctx.tc->sourceRate();
+        doc["source_channels"] = ctx.tc->sourceChannels();
+        doc["source_bits"] = ctx.tc->sourceBits();
+      } else {
+        String lp = ctx.path; lp.toLowerCase();
+        doc["format"] = lp.substring(lp.lastIndexOf('.') + 1);
+        doc["size"] = (int64_t)ctx.written;
+      }
+      gUpload.erase(it);
+      String out; serializeJson(doc, out);
+      req->send(200, "application/json", out);
     },
     [](AsyncWebServerRequest* req, const String& filename, size_t index, uint8_t* data, size_t len, bool final) {
       if (adminToken.length() && (!req->hasHeader("X-Admin-Token") || req->getHeader("X-Admin-Token")->value() != adminToken)) {
@@ -1384,6 +2008,8 @@ server.on("/app.js", HTTP_GET, [](AsyncWebServerRequest* req) {
         ctx.ok = false;
         ctx.error = "";
         ctx.written = 0;
+        ctx.tc.reset();
+        ctx.replaces = "";
 
         String clean = sanitizeFileName(filename);
         if (!hasAllowedExt(clean)) { ctx.error = "bad_ext"; return; }
@@ -1391,24 +2017,89 @@ server.on("/app.js", HTTP_GET, [](AsyncWebServerRequest* req) {
         if (!LittleFS.exists("/audio")) LittleFS.mkdir("/audio");
         ctx.path = "/audio/" + clean;
 
-        ctx.file = LittleFS.open(ctx.path, "w");
-        if (!ctx.file) { ctx.error = "open_failed"; return; }
+        // WAV is converted while it streams in (?transcode=0 keeps the original).
+        // Native files are 8-bit for the LEDC sink, else 16-bit (?bits= overrides).
+        // ?format=adpcm stores a 4-bit IMA-ADPCM WAV under the uploaded name instead.
+        String lower = clean; lower.toLowerCase();
+        bool transcode = lower.endsWith(".wav") &&
+                         !(req->hasParam("transcode") && req->getParam("transcode")->value() == "0");
+        if (transcode) {
+          uint8_t bits = (strcmp(audio.sinkName(), "ledc") == 0) ? 8 : 16;
+          if (req->hasParam("bits")) bits = (req->getParam("bits")->value().toInt() == 8) ? 8 : 16;
+          TranscodeFormat fmt = TRANSCODE_PCM;
+          if (req->hasParam("format") && req->getParam("format")->value() == "adpcm") fmt = TRANSCODE_ADPCM;
+          if (fmt == TRANSCODE_PCM) {
+            ctx.replaces = ctx.path;
+            ctx.path = "/audio/" + clean.substring(0, clean.length() - 4) + ".pcm";
+          }
+          ctx.tc.reset(new WavTranscoder());
+          if (!ctx.tc->begin(ctx.path, bits, fmt)) { ctx.error = ctx.tc->error(); return; }
+        } else {
+          ctx.file = LittleFS.open(ctx.path, "w");
+          if (!ctx.file) { ctx.error = "open_failed"; return; }
+        }
+        audioIndex.remove(ctx.path);
       }
 
-      if (!ctx.file) { if (ctx.error.length() == 0) ctx.error = "no_file"; return; }
+      if (ctx.error.length()) return;
+      if (!ctx.tc && !ctx.file) { ctx.error = "no_file"; return; }
       if ((ctx.written + len) > MAX_UPLOAD_BYTES) {
         ctx.error = "too_large";
-        ctx.file.close();
-        LittleFS.remove(ctx.path);
+        if (ctx.tc) ctx.tc->abort();
+        else { ctx.file.close(); LittleFS.remove(ctx.path); }
         return;
       }
 
-      size_t w = ctx.file.write(data, len);
-      ctx.written += w;
+      if (ctx.tc) {
+        if (!ctx.tc->feed(data, len)) { ctx.error = ctx.tc->error(); return; }
+        ctx.written += len;
+      } else {
+        size_t w = ctx.file.write(data, len);
+        ctx.written += w;
+      }
 
       if (final) {
-        ctx.file.close();
+        if (ctx.tc) {
+          if (!ctx.tc->finish()) ctx.error = ctx.tc->error();
+        } else {
+          ctx.file.close();
+        }
         ctx.ok = (ctx.error.length() == 0);
+        if (ctx.ok) {
+          audioIndex.update(ctx.path);
+          loopWake.wake();   // levels are measured from loop()
+        }
+      }
+    }
+  );
+
+  server.on("/api/audio/voices", HTTP_GET, handleAudioVoices);
+  server.on("/api/audio/stats", HTTP_GET, handleAudioStats);
+  server.on("/api/audio/stop", HTTP_POST, handleAudioStop);
+  server.on("/api/audio/jobs", HTTP_GET, handleAudioJobs);
+  server.on("/api/audio/play", HTTP_POST,
+    [](AsyncWebServerRequest* req) {},
+    nullptr,
+    [](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total) {
+      auto& buf = gBody[req];
+      if (index == 0) { buf.clear(); buf.reserve(total); }
+      buf.insert(buf.end(), data, data + len);
+      if (index + len == total) {
+        handleAudioPlay(req);
+      }
+    }
+  );
+
+  server.on("/api/holidays", HTTP_GET, handleGetHolidays);
+  server.on("/api/holidays", HTTP_PUT,
+    [](AsyncWebServerRequest* req) {},
+    nullptr,
+    [](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total) {
+      auto& buf = gBody[req];
+      if (index == 0) { buf.clear(); buf.reserve(total); }
+      buf.insert(buf.end(), data, data + len);
+      if (index + len == total) {
+        handlePutHolidays(req);
       }
     }
   );
@@ -1577,8 +2268,13 @@ void setup() {
   // Sätt TZ tidigt (Europe/Stockholm)
   setupTimezone();
 
+  loopWake.begin();
+  schedule.begin();
   loadAllFromNvs();
+  audio.setJobHook([] { loopWake.wake(); });
+  audioCache.begin();
   ensureDefaultAudio();
+  audioIndex.begin();
   ensureAtLeastOneAlarm();
   ensurePinsConfigured();
 
@@ -1597,7 +2293,8 @@ void setup() {
     }
 
     // Uppdatera status och "värm upp" TZ-konvertering
-    updateNtpStatus();
+    ntpSynced = ok && isValidEpoch(time(nullptr));
+    ntpSyncPending = false;
     tzset();
     time_t now = time(nullptr);
     struct tm tmp;
@@ -1622,27 +2319,100 @@ void setup() {
   addLogLine("[boot] ready");
 }
 
-void loop() {
-  if (wifiConnected) {
-    static uint32_t lastNtpCheckMs = 0;
-    if (millis() - lastNtpCheckMs > 5000) {
-      updateNtpStatus();
-      lastNtpCheckMs = millis();
+/* Main loop timing */
+// Milliseconds until unix time t, using the sub-second part of the clock.
+static uint32_t msUntilUnix(time_t t) {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (t <= tv.tv_sec) return 0;
+  int64_t ms = (int64_t)(t - tv.tv_sec) * 1000 - tv.tv_usec / 1000;
+  return ms > (int64_t)LOOP_MAX_SLEEP_MS ? LOOP_MAX_SLEEP_MS : (uint32_t)ms;
+}
+
+// Earliest deadline of everything loop() drives. Work that streams (audio
+// without its task, a cache download, a level scan) keeps the old cadence.
+static uint32_t loopSleepMs() {
+  if (audio.needsLoop() || audioCache.busy() || (activeAlarmIndex < 0 && audioIndex.busy())) return LOOP_POLL_MS;
+
+  uint32_t ms = LOOP_MAX_SLEEP_MS;
+  for (int i = 0; i < webhookJobCount; i++) {
+    int32_t d = (int32_t)(webhookJobs[i].nextAttemptMs - millis());
+    ms = min(ms, d > 0 ? (uint32_t)d : (uint32_t)0);
+  }
+  ms = min(ms, buttonSleepMs());
+
+  time_t now = time(nullptr);
+  if (!isValidEpoch(now)) return ms;
+  ms = min(ms, msUntil(lastTimeSaveMs, LAST_GOOD_SAVE_MS));
+
+  time_t due;
+  if (schedule.top(&due) >= 0) ms = min(ms, msUntilUnix(due));
+
+  if (activeAlarmIndex >= 0) {
+    const AlarmHot& a = alarmStore.hot(activeAlarmIndex);
+    const AlarmRuntime& r = alarmRt[activeAlarmIndex];
+    if (r.ringing && a.max_ring_sec > 0) ms = min(ms, msUntilUnix(r.current_fire_unix + a.max_ring_sec));
+  } else if (wifiConnected) {
+    for (int i = 0; i < MAX_ALARMS; i++) {
+      const AlarmHot& h = alarmStore.hot(i);
+      const AlarmRuntime& r = alarmRt[i];
+      if (h.id == 0 || !h.enabled() || !(h.flags & ALARM_HOT_URL_AUDIO)) continue;
+      if (r.next_fire_unix == 0 || r.prefetched_for == r.next_fire_unix) continue;
+      uint32_t d = max(msUntilUnix(r.next_fire_unix - PREFETCH_LEAD_SEC), msUntil(lastPrefetchCheckMs, PREFETCH_CHECK_MS));
+      ms = min(ms, d);
     }
   }
+  return ms;
+}
+
+// Idle: WiFi modem sleep, and automatic light sleep with frequency scaling
+// when the SDK supports it. Ringing, playing, downloading or serving the AP
+// portal: full speed.
+static void applyPowerMode(bool idle) {
+  if (powerMode != POWER_UNSET && (powerMode == POWER_ACTIVE) != idle) return;
+
+  WiFi.setSleep(idle ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);
+
+  esp_pm_config_esp32c3_t pm = {};
+  pm.max_freq_mhz = 160;
+  pm.min_freq_mhz = idle ? 40 : 160;
+  pm.light_sleep_enable = idle;
+  esp_err_t err = esp_pm_configure(&pm);
+  if (idle && err != ESP_OK) {
+    static bool logged = false;
+    if (!logged) addLogLine(String("[power] light sleep unavailable: ") + esp_err_to_name(err));
+    logged = true;
+    pm.light_sleep_enable = false;
+    esp_pm_configure(&pm);
+  }
+
+  PowerMode next = !idle ? POWER_ACTIVE : pm.light_sleep_enable ? POWER_LIGHT_SLEEP : POWER_MODEM_SLEEP;
+  if (next != powerMode) addLogLine(String("[power] ") + powerModeName(next));
+  powerMode = next;
+}
+
+void loop() {
+  if (ntpSyncPending) {
+    ntpSyncPending = false;
+    bool valid = isValidEpoch(time(nullptr));
+    if (valid && !ntpSynced) addLogLine(String("[ntp] time synced ") + isoNow());
+    ntpSynced = valid;
+  }
 
   schedulerTick();
   buttonTick();
   audio.loop();
+  audioJobTick();
+  // Level scans read flash; leave it to the ringing alarm.
+  if (activeAlarmIndex < 0) audioIndex.loop();
   processWebhookQueue();
+  prefetchTick();
 
-  // Periodic heartbeat on Serial to confirm runtime logging works beyond boot
-  static uint32_t lastTickMs = 0;
-  uint32_t now = millis();
-  if (now - lastTickMs > 2000) {
-    Serial.printf("loop tick %lu\n", (unsigned long)(now / 1000));
-    lastTickMs = now;
-  }
+  bool idle = wifiConnected && activeAlarmIndex < 0 && alarmAudioJob == 0 && !audio.isPlaying() && !audioCache.busy();
+  applyPowerMode(idle);
 
-  delay(5);
+  // Sleep until the next deadline; API changes, button edges and settled
+  // audio jobs wake it early.
+  loopLastSleepMs = loopSleepMs();
+  loopWake.wait(loopLastSleepMs);
 }
@@ -0,0 +1,239 @@
+#include "native_pcm.h"
+#include "audio_voice.h"
+#include "pcm_convert.h"
+
+static uint32_t le32(const uint8_t* b) {
+  return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+static uint16_t le16(const uint8_t* b) { return (uint16_t)(b[0] | (b[1] << 8)); }
+static void put32(uint8_t* b, uint32_t v) { b[0] = v; b[1] = v >> 8; b[2] = v >> 16; b[3] = v >> 24; }
+
+bool nativePcmParseHeader(const uint8_t* h, NativePcmInfo& info) {
+  if (memcmp(h, "GMPC", 4) != 0 || h[4] != NATIVE_PCM_VERSION) return false;
+  if (h[5] != 8 && h[5] != 16) return false;
+  info.bits = h[5];
+  info.sampleRate = le32(h + 8);
+  info.samples = le32(h + 12);
+  return true;
+}
+
+void nativePcmWriteHeader(uint8_t* h, const NativePcmInfo& info) {
+  memcpy(h, "GMPC", 4);
+  h[4] = NATIVE_PCM_VERSION;
+  h[5] = info.bits;
+  h[6] = h[7] = 0;
+  put32(h + 8, info.sampleRate);
+  put32(h + 12, info.samples);
+}
+
+bool WavTranscoder::begin(const String& outPath, uint8_t bits, TranscodeFormat format) {
+  path = outPath;
+  err = "";
+  out = NativePcmInfo();
+  outFormat = format;
+  out.bits = (format == TRANSCODE_ADPCM) ? 4 : (bits == 8) ? 8 : 16;
+  out.sampleRate = AUDIO_OUTPUT_RATE;
+  written = 0;
+  adpcmOut.reset();
+  adpcmFill = 0;
+  state = ST_RIFF;
+  hdrNeed = 12;
+  hdrHave = 0;
+  haveFmt = false;
+  inFill = 0;
+
+  file = LittleFS.open(path, "w");
+  if (!file) return fail("open_failed");
+  // Placeholder header; finish() rewrites it with the final counts.
+  uint8_t h[IMA_ADPCM_WAV_HEADER_BYTES];
+  if (outFormat == TRANSCODE_ADPCM) {
+    imaAdpcmWriteWavHeader(h, out.sampleRate, 0, 0);
+    return writeBytes(h, IMA_ADPCM_WAV_HEADER_BYTES);
+  }
+  nativePcmWriteHeader(h, out);
+  return writeBytes(h, NATIVE_PCM_HEADER_BYTES);
+}
+
+bool WavTranscoder::fail(const char* e) {
+  if (err.length() == 0) err = e;
+  abort();
+  return false;
+}
+
+void WavTranscoder::abort() {
+  if (file) file.close();
+  if (path.length()) LittleFS.remove(path);
+  state = ST_DONE;
+}
+
+bool WavTranscoder::parseFmt() {
+  uint16_t fmt = le16(hdr);
+  srcChannels = le16(hdr + 2);
+  srcRate = le32(hdr + 4);
+  srcBits = le16(hdr + 14);
+  if (fmt == 0xFFFE && hdrNeed >= 26) fmt = le16(hdr + 24);
+  srcAdpcm = (fmt == IMA_ADPCM_FORMAT_TAG);
+  if (srcAdpcm) {
+    if (srcBits != 4 || !adpcmIn.begin(srcChannels, le16(hdr + 12))) return fail("wav_adpcm_unsupported");
+    if (srcRate < 8000 || srcRate > 48000) return fail("wav_rate_unsupported");
+    bytesPerFrame = (uint32_t)adpcmIn.unitBytes();
+    rs.configure(srcRate, AUDIO_OUTPUT_RATE);
+    haveFmt = true;
+    return true;
+  }
+  if (fmt != 1) return fail("wav_not_pcm");
+  if (srcBits != 8 && srcBits != 16 && srcBits != 24) return fail("wav_bits_unsupported");
+  if (srcChannels < 1 || srcChannels > 2) return fail("wav_channels_bad");
+  if (srcRate < 8000 || srcRate > 48000) return fail("wav_rate_unsupported");
+  bytesPerFrame = (uint32_t)srcChannels * (srcBits / 8);
+  rs.configure(srcRate, AUDIO_OUTPUT_RATE);
+  haveFmt = true;
+  return true;
+}
+
+bool WavTranscoder::feed(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    if (state == ST_DONE) return err.length() == 0;
+
+    if (state == ST_SKIP) {
+      uint32_t n = min((uint32_t)len, skipLeft);
+      skipLeft -= n; data += n; len -= n;
+      if (skipLeft == 0) { state = ST_CHUNK; hdrNeed = 8; hdrHave = 0; }
+      continue;
+    }
+
+    if (state == ST_DATA) {
+      uint32_t n = min((uint32_t)len, min(dataLeft, (uint32_t)sizeof(inBuf) - inFill));
+      memcpy(inBuf + inFill, data, n);
+      inFill += n; dataLeft -= n; data += n; len -= n;
+      size_t frames = inFill / bytesPerFrame;
+      if (frames > 0 && !convertFrames(frames)) return false;
+      if (dataLeft == 0) state = ST_DONE;
+      continue;
+    }
+
+    // Header states: collect hdrNeed bytes, then act on them.
+    uint32_t n = min((uint32_t)len, hdrNeed - hdrHave);
+    memcpy(hdr + hdrHave, data, n);
+    hdrHave += n; data += n; len -= n;
+    if (hdrHave < hdrNeed) continue;
+
+    if (state == ST_RIFF) {
+      if (memcmp(hdr, "RIFF", 4) != 0) return fail("wav_not_riff");
+      if (memcmp(hdr + 8, "WAVE", 4) != 0) return fail("wav_not_wave");
+      state = ST_CHUNK; hdrNeed = 8; hdrHave = 0;
+    } else if (state == ST_CHUNK) {
+      uint32_t size = le32(hdr + 4);
+      uint32_t padded = size + (size & 1);
+      if (memcmp(hdr, "fmt ", 4) == 0) {
+        if (size < 16) return fail("wav_no_fmt");
+        state = ST_FMT;
+        hdrNeed = min(size, (uint32_t)sizeof(hdr));
+        skipLeft = padded - hdrNeed;
+        hdrHave = 0;
+      } else if (memcmp(hdr, "data", 4) == 0) {
+        if (!haveFmt) return fail("wav_no_fmt");
+        state = ST_DATA;
+        dataLeft = size;
+      } else {
+        state = ST_SKIP;
+        skipLeft = padded;
+        if (skipLeft == 0) { state = ST_CHUNK; hdrNeed = 8; hdrHave = 0; }
+      }
+    } else if (state == ST_FMT) {
+      if (!parseFmt()) return false;
+      state = ST_SKIP;
+      if (skipLeft == 0) { state = ST_CHUNK; hdrNeed = 8; hdrHave = 0; }
+    }
+  }
+  return true;
+}
+
+bool WavTranscoder::convertFrames(size_t frames) {
+  const uint8_t* p = inBuf;
+  size_t left = frames;
+  while (left > 0) {
+    // An ADPCM unit decodes to at most 8 samples.
+    size_t n = min(left, (size_t)(srcAdpcm ? BLOCK_FRAMES / 8 : BLOCK_FRAMES));
+    size_t samples = n;
+    if (srcAdpcm) samples = adpcmIn.decode(p, n, mono);
+    else pcmToMono16(p, mono, n, srcChannels, srcBits);
+    if (rs.passthrough()) {
+      if (!writeSamples(mono, samples)) return false;
+    } else {
+      size_t m = rs.process(mono, samples, rsOut);
+      if (!writeSamples(rsOut, m)) return false;
+    }
+    p += n * bytesPerFrame;
+    left -= n;
+  }
+  // Keep the partial frame, if any, at the (aligned) start of the buffer.
+  uint32_t used = (uint32_t)(frames * bytesPerFrame);
+  memmove(inBuf, inBuf + used, inFill - used);
+  inFill -= used;
+  return true;
+}
+
+bool WavTranscoder::writeBytes(const uint8_t* b, size_t n) {
+  if (file.write(b, n) != n) return fail("write_failed");
+  written += (uint32_t)n;
+  return true;
+}
+
+// Encodes the collected block; the final one is padded with its last sample.
+bool WavTranscoder::flushAdpcm(bool final) {
+  if (adpcmFill == 0 || (!final && adpcmFill < ImaAdpcmEncoder::SAMPLES_PER_BLOCK)) return true;
+  int16_t last = adpcmBlock[adpcmFill - 1];
+  while (adpcmFill < ImaAdpcmEncoder::SAMPLES_PER_BLOCK) adpcmBlock[adpcmFill++] = last;
+  uint8_t enc[ImaAdpcmEncoder::BLOCK_BYTES];
+  adpcmOut.encodeBlock(adpcmBlock, enc);
+  adpcmFill = 0;
+  return writeBytes(enc, sizeof(enc));
+}
+
+bool WavTranscoder::writeSamples(int16_t* s, size_t n) {
+  if (n == 0) return true;
+  if (outFormat == TRANSCODE_ADPCM) {
+    out.samples += (uint32_t)n;
+    while (n > 0) {
+      size_t k = min(n, (size_t)(ImaAdpcmEncoder::SAMPLES_PER_BLOCK - adpcmFill));
+      memcpy(adpcmBlock + adpcmFill, s, k * sizeof(int16_t));
+      adpcmFill += (uint32_t)k;
+      s += k;
+      n -= k;
+      if (!flushAdpcm(false)) return false;
+    }
+    return true;
+  }
+  size_t bytes;
+  if (out.bits == 8) {
+    uint8_t* b = (uint8_t*)s;
+    for (size_t i = 0; i < n; i++) b[i] = (uint8_t)(((uint16_t)s[i] ^ 0x8000) >> 8);
+    bytes = n;
+  } else {
+    bytes = n * 2;   // the target is little-endian already
+  }
+  if (!writeBytes((const uint8_t*)s, bytes)) return false;
+  out.samples += (uint32_t)n;
+  return true;
+}
+
+bool WavTranscoder::finish() {
+  if (err.length()) return false;
+  if (!haveFmt || (state != ST_DATA && state != ST_DONE)) return fail("wav_no_data");
+  if (inFill >= bytesPerFrame && !convertFrames(inFill / bytesPerFrame)) return false;
+
+  uint8_t h[IMA_ADPCM_WAV_HEADER_BYTES];
+  size_t hlen = NATIVE_PCM_HEADER_BYTES;
+  if (outFormat == TRANSCODE_ADPCM) {
+    if (!flushAdpcm(true)) return false;
+    hlen = IMA_ADPCM_WAV_HEADER_BYTES;
+    imaAdpcmWriteWavHeader(h, out.sampleRate, out.samples, written - (uint32_t)hlen);
+  } else {
+    nativePcmWriteHeader(h, out);
+  }
+  if (!file.seek(0) || file.write(h, hlen) != hlen) return fail("write_failed");
+  file.close();
+  state = ST_DONE;
+  return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "resampler.h"
+#include "ima_adpcm.h"
+
+// Device-native audio file (.pcm): a 16-byte header followed by mono samples
+// at AUDIO_OUTPUT_RATE, either signed 16-bit LE or unsigned 8-bit (the LEDC
+// duty resolution). Playback needs no parsing, downmix or resampling.
+//   0  "GMPC"
+//   4  u8  version (1)
+//   5  u8  bits (8 or 16)
+//   6  u16 reserved
+//   8  u32 sample rate
+//   12 u32 sample count
+static const uint8_t NATIVE_PCM_VERSION = 1;
+static const size_t NATIVE_PCM_HEADER_BYTES = 16;
+
+struct NativePcmInfo {
+  uint8_t bits = 16;
+  uint32_t sampleRate = 0;
+  uint32_t samples = 0;
+};
+
+bool nativePcmParseHeader(const uint8_t* h, NativePcmInfo& info);
+void nativePcmWriteHeader(uint8_t* h, const NativePcmInfo& info);
+
+enum TranscodeFormat : uint8_t { TRANSCODE_PCM, TRANSCODE_ADPCM };
+
+// Streaming WAV -> native converter for the upload handler. Bytes arrive in
+// arbitrary pieces; the RIFF header is parsed incrementally and the data is
+// converted, resampled and quantized one block at a time. The source may be
+// PCM or IMA-ADPCM. The output is a .pcm file (8/16-bit) or, with
+// TRANSCODE_ADPCM, a mono IMA-ADPCM WAV at the output rate (4 bits/sample).
+class WavTranscoder {
+public:
+  bool begin(const String& outPath, uint8_t bits, TranscodeFormat format = TRANSCODE_PCM);
+  bool feed(const uint8_t* data, size_t len);
+  bool finish();
+  void abort();
+
+  const String& error() const { return err; }
+  const NativePcmInfo& info() const { return out; }
+  TranscodeFormat format() const { return outFormat; }
+  uint32_t sourceRate() const { return srcRate; }
+  uint16_t sourceChannels() const { return srcChannels; }
+  uint16_t sourceBits() const { return srcBits; }
+  uint32_t bytesWritten() const { return written; }
+
+private:
+  enum State : uint8_t { ST_RIFF, ST_CHUNK, ST_FMT, ST_SKIP, ST_DATA, ST_DONE };
+  static const int BLOCK_FRAMES = 256;
+
+  bool fail(const char* e);
+  bool parseFmt();
+  bool convertFrames(size_t frames);
+  bool writeSamples(int16_t* s, size_t n);
+  bool writeBytes(const uint8_t* b, size_t n);
+  bool flushAdpcm(bool final);
+
+  File file;
+  String path;
+  String err;
+  NativePcmInfo out;
+  TranscodeFormat outFormat = TRANSCODE_PCM;
+  uint32_t written = 0;
+  Resampler rs;
+
+  State state = ST_RIFF;
+  uint8_t hdr[40];
+  uint32_t hdrNeed = 12;
+  uint32_t hdrHave = 0;
+  uint32_t skipLeft = 0;
+  uint32_t dataLeft = 0;
+  bool haveFmt = false;
+
+  uint32_t srcRate = 0;
+  uint16_t srcChannels = 0;
+  uint16_t srcBits = 0;
+  uint32_t bytesPerFrame = 0;
+  bool srcAdpcm = false;
+  ImaAdpcmDecoder adpcmIn;
+
+  ImaAdpcmEncoder adpcmOut;
+  int16_t adpcmBlock[ImaAdpcmEncoder::SAMPLES_PER_BLOCK];
+  uint32_t adpcmFill = 0;
+
+  alignas(4) uint8_t inBuf[BLOCK_FRAMES * 6];
+  uint32_t inFill = 0;
+  int16_t mono[BLOCK_FRAMES];
+  int16_t rsOut[BLOCK_FRAMES * 3 + 8];   // maxOutput() at 8 kHz in
+};
@@ -0,0 +1,101 @@
+#include "pcm_convert.h"
+#include <string.h>
+
+static inline bool aligned4(const void* p) { return ((uintptr_t)p & 3) == 0; }
+
+static inline int16_t s16(const uint8_t* p) { return (int16_t)(p[0] | (p[1] << 8)); }
+static inline int16_t s24hi(const uint8_t* p) { return (int16_t)(p[1] | (p[2] << 8)); }
+
+static void mono16(const uint8_t* in, int16_t* out, size_t n) {
+  memcpy(out, in, n * 2);
+}
+
+static void stereo16(const uint8_t* in, int16_t* out, size_t n) {
+  size_t i = 0;
+  if (aligned4(in)) {
+    const uint32_t* w = (const uint32_t*)in;
+    for (; i + 4 <= n; i += 4) {
+      uint32_t a = w[i], b = w[i + 1], c = w[i + 2], d = w[i + 3];
+      out[i + 0] = (int16_t)(((int32_t)(int16_t)a + (int32_t)(int16_t)(a >> 16)) >> 1);
+      out[i + 1] = (int16_t)(((int32_t)(int16_t)b + (int32_t)(int16_t)(b >> 16)) >> 1);
+      out[i + 2] = (int16_t)(((int32_t)(int16_t)c + (int32_t)(int16_t)(c >> 16)) >> 1);
+      out[i + 3] = (int16_t)(((int32_t)(int16_t)d + (int32_t)(int16_t)(d >> 16)) >> 1);
+    }
+  }
+  for (; i < n; i++) out[i] = (int16_t)(((int32_t)s16(in + 4 * i) + (int32_t)s16(in + 4 * i + 2)) >> 1);
+}
+
+static void mono8(const uint8_t* in, int16_t* out, size_t n) {
+  size_t i = 0;
+  if (aligned4(in)) {
+    const uint32_t* w = (const uint32_t*)in;
+    for (; i + 4 <= n; i += 4) {
+      uint32_t a = w[i >> 2] ^ 0x80808080u;
+      out[i + 0] = (int16_t)(a << 8);
+      out[i + 1] = (int16_t)(a & 0xFF00);
+      out[i + 2] = (int16_t)((a >> 8) & 0xFF00);
+      out[i + 3] = (int16_t)((a >> 16) & 0xFF00);
+    }
+  }
+  for (; i < n; i++) out[i] = (int16_t)((in[i] ^ 0x80) << 8);
+}
+
+static void stereo8(const uint8_t* in, int16_t* out, size_t n) {
+  size_t i = 0;
+  if (aligned4(in)) {
+    const uint32_t* w = (const uint32_t*)in;
+    for (; i + 2 <= n; i += 2) {
+      uint32_t a = w[i >> 1];
+      out[i + 0] = (int16_t)(((int32_t)(a & 0xFF) + (int32_t)((a >> 8) & 0xFF) - 256) << 7);
+      out[i + 1] = (int16_t)(((int32_t)((a >> 16) & 0xFF) + (int32_t)(a >> 24) - 256) << 7);
+    }
+  }
+  for (; i < n; i++) out[i] = (int16_t)(((int32_t)in[2 * i] + (int32_t)in[2 * i + 1] - 256) << 7);
+}
+
+// 24-bit keeps the top 16 bits; four mono frames (or two stereo frames)
+// are exactly three words.
+static void mono24(const uint8_t* in, int16_t* out, size_t n) {
+  size_t i = 0;
+  if (aligned4(in)) {
+    const uint32_t* w = (const uint32_t*)in;
+    for (; i + 4 <= n; i += 4) {
+      const uint32_t* g = w + (i / 4) * 3;
+      uint32_t a = g[0], b = g[1], c = g[2];
+      out[i + 0] = (int16_t)(a >> 8);
+      out[i + 1] = (int16_t)b;
+      out[i + 2] = (int16_t)((b >> 24) | (c << 8));
+      out[i + 3] = (int16_t)(c >> 16);
+    }
+  }
+  for (; i < n; i++) out[i] = s24hi(in + 3 * i);
+}
+
+static void stereo24(const uint8_t* in, int16_t* out, size_t n) {
+  size_t i = 0;
+  if (aligned4(in)) {
+    const uint32_t* w = (const uint32_t*)in;
+    for (; i + 2 <= n; i += 2) {
+      const uint32_t* g = w + (i / 2) * 3;
+      uint32_t a = g[0], b = g[1], c = g[2];
+      int32_t l0 = (int16_t)(a >> 8), r0 = (int16_t)b;
+      int32_t l1 = (int16_t)((b >> 24) | (c << 8)), r1 = (int16_t)(c >> 16);
+      out[i + 0] = (int16_t)((l0 + r0) >> 1);
+      out[i + 1] = (int16_t)((l1 + r1) >> 1);
+    }
+  }
+  for (; i < n; i++) out[i] = (int16_t)(((int32_t)s24hi(in + 6 * i) + (int32_t)s24hi(in + 6 * i + 3)) >> 1);
+}
+
+bool pcmToMono16(const uint8_t* in, int16_t* out, size_t n, uint16_t channels, uint16_t bits) {
+  if (channels == 1) {
+    if (bits == 16) { mono16(in, out, n); return true; }
+    if (bits == 8) { mono8(in, out, n); return true; }
+    if (bits == 24) { mono24(in, out, n); return true; }
+  } else if (channels == 2) {
+    if (bits == 16) { stereo16(in, out, n); return true; }
+    if (bits == 8) { stereo8(in, out, n); return true; }
+    if (bits == 24) { stereo24(in, out, n); return true; }
+  }
+  return false;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Converts n frames of interleaved little-endian PCM (8-bit unsigned,
+// 16-bit or 24-bit signed; 1 or 2 channels) to mono int16. Stereo is
+// averaged. When in is 4-byte aligned the kernels work a word at a time,
+// four frames per iteration; otherwise they fall back to byte loads.
+// Returns false for an unsupported layout.
+bool pcmToMono16(const uint8_t* in, int16_t* out, size_t n, uint16_t channels, uint16_t bits);
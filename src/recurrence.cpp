@@ -0,0 +1,175 @@
+#include "recurrence.h"
+#include "time_zone.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int daysInMonth(int y, int m) {
+  static const uint8_t len[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if (m == 2 && (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0))) return 29;
+  return len[m - 1];
+}
+
+static const char* const KIND_NAMES[] = {"weekly", "month_days", "month_weekday"};
+
+const char* repeatKindName(uint8_t kind) {
+  return kind < sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0]) ? KIND_NAMES[kind] : KIND_NAMES[0];
+}
+
+int repeatKindFromName(const char* name) {
+  if (!name) return -1;
+  for (int i = 0; i < (int)(sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0])); i++) {
+    if (strcmp(name, KIND_NAMES[i]) == 0) return i;
+  }
+  return -1;
+}
+
+int32_t dayFromIsoDate(const char* s) {
+  if (!s || strlen(s) != 10 || s[4] != '-' || s[7] != '-') return -1;
+  int y = atoi(s), m = atoi(s + 5), d = atoi(s + 8);
+  if (y < 2000 || m < 1 || m > 12 || d < 1 || d > daysInMonth(y, m)) return -1;
+  return (int32_t)TimeZone::daysFromCivil(y, m, d);
+}
+
+void isoDateFromDay(int32_t day, char out[11]) {
+  int y, m, d;
+  TimeZone::civilFromDays(day, y, m, d);
+  snprintf(out, 11, "%04d-%02d-%02d", y, m, d);
+}
+
+/* HolidaySet */
+void HolidaySet::clear() {
+  memset(years, 0, sizeof(years));
+  for (Year& y : years) y.firstDay = -1;
+}
+
+bool HolidaySet::contains(int32_t day) const {
+  for (const Year& y : years) {
+    if (y.firstDay < 0) continue;
+    int32_t i = day - y.firstDay;
+    // i == 365 of a common year is Jan 1 of the next; its bit is never set.
+    if (i >= 0 && i < 366 && ((y.bits[i >> 5] >> (i & 31)) & 1)) return true;
+  }
+  return false;
+}
+
+bool HolidaySet::add(int32_t day) {
+  int yy, m, d;
+  TimeZone::civilFromDays(day, yy, m, d);
+  int32_t first = (int32_t)TimeZone::daysFromCivil(yy, 1, 1);
+
+  Year* slot = nullptr;
+  for (Year& y : years) if (y.firstDay == first) slot = &y;
+  if (!slot) {
+    for (Year& y : years) if (!slot || y.firstDay < slot->firstDay) slot = &y;
+    if (slot->firstDay > first) return false;
+    memset(slot->bits, 0, sizeof(slot->bits));
+    slot->firstDay = first;
+  }
+  int32_t i = day - first;
+  slot->bits[i >> 5] |= 1UL << (i & 31);
+  return true;
+}
+
+int HolidaySet::count() const {
+  int n = 0;
+  for (const Year& y : years) {
+    if (y.firstDay < 0) continue;
+    for (uint32_t w : y.bits) n += __builtin_popcount(w);
+  }
+  return n;
+}
+
+int32_t HolidaySet::next(int32_t from) const {
+  int32_t best = -1;
+  for (const Year& y : years) {
+    if (y.firstDay < 0) continue;
+    int32_t i = from > y.firstDay ? from - y.firstDay : 0;
+    for (; i < 366; i = (i | 31) + 1) {
+      uint32_t w = y.bits[i >> 5] >> (i & 31);
+      if (!w) continue;
+      int32_t day = y.firstDay + i + __builtin_ctz(w);
+      if (best < 0 || day < best) best = day;
+      break;
+    }
+  }
+  return best;
+}
+
+/* Recurrence */
+int32_t Recurrence::next(int32_t from, const HolidaySet* holidays) const {
+  if (from < start_day) from = start_day;
+  for (int i = 0; i < MAX_SKIPS; i++) {
+    int32_t d = nextMatch(from);
+    if (d < 0 || !skip_holidays || !holidays || !holidays->contains(d)) return d;
+    from = d + 1;
+  }
+  return -1;
+}
+
+int32_t Recurrence::nextMatch(int32_t from) const {
+  return kind == REPEAT_WEEKLY ? nextWeekly(from) : nextMonthly(from);
+}
+
+// Weeks run Monday..Sunday; active weeks are every interval-th week counted
+// from the week of start_day.
+int32_t Recurrence::nextWeekly(int32_t from) const {
+  uint32_t mask = days_mask & 0x7F;
+  if (mask == 0) return -1;
+  int32_t n = interval ? interval : 1;
+
+  int wd = TimeZone::weekdayMon0(from);
+  int32_t week = from - wd;
+  int32_t anchor = start_day - TimeZone::weekdayMon0(start_day);
+  int32_t off = ((week - anchor) / 7) % n;
+
+  if (off == 0) {
+    uint32_t rest = mask >> wd;
+    if (rest) return from + __builtin_ctz(rest);
+  }
+  return week + 7 * (n - off) + __builtin_ctz(mask);
+}
+
+// Active months are every interval-th month counted from the month of
+// start_day.
+int32_t Recurrence::nextMonthly(int32_t from) const {
+  if (kind == REPEAT_MONTH_DAYS && month_days == 0) return -1;
+  if (kind == REPEAT_MONTH_WEEKDAY && ((days_mask & 0x7F) == 0 || (month_weeks & 0x1F) == 0)) return -1;
+  int32_t n = interval ? interval : 1;
+
+  int y, m, d, ay, am, ad;
+  TimeZone::civilFromDays(from, y, m, d);
+  TimeZone::civilFromDays(start_day, ay, am, ad);
+  int32_t month = y * 12 + (m - 1);
+  int32_t off = (month - (ay * 12 + (am - 1))) % n;
+  if (off) { month += n - off; d = 1; }
+
+  for (int i = 0; i < MAX_MONTHS; i++, month += n, d = 1) {
+    y = month / 12;
+    m = month % 12 + 1;
+    uint32_t rest = monthMask(y, m) >> (d - 1);
+    if (rest) return (int32_t)TimeZone::daysFromCivil(y, m, d + __builtin_ctz(rest));
+  }
+  return -1;
+}
+
+// The rule's days in one month as bit d-1 = day d.
+uint32_t Recurrence::monthMask(int y, int m) const {
+  int len = daysInMonth(y, m);
+  uint32_t all = 0x7FFFFFFFUL >> (31 - len);
+
+  if (kind == REPEAT_MONTH_DAYS) {
+    uint32_t mask = month_days & all;
+    if (month_days & REPEAT_LAST_DAY) mask |= 1UL << (len - 1);
+    return mask;
+  }
+
+  uint32_t mask = 0;
+  int wd1 = TimeZone::weekdayMon0(TimeZone::daysFromCivil(y, m, 1));
+  for (uint32_t wds = days_mask & 0x7F; wds; wds &= wds - 1) {
+    int first = 1 + (__builtin_ctz(wds) - wd1 + 7) % 7;
+    for (int k = 0; k < 4; k++) if (month_weeks & (1 << k)) mask |= 1UL << (first + 7 * k - 1);
+    if (month_weeks & REPEAT_LAST_WEEK) mask |= 1UL << (first + 7 * ((len - first) / 7) - 1);
+  }
+  return mask;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+
+// Days are counted from 1970-01-01 (TimeZone::dayOf of a local time).
+
+// Dates to skip, one bitset per calendar year (46 bytes a year). Years are
+// kept in a few fixed slots; adding a new year evicts the oldest one.
+class HolidaySet {
+public:
+  static const int YEARS = 4;
+  struct Year {
+    int32_t firstDay;     // Jan 1 of the year, -1 for a free slot
+    uint32_t bits[12];    // bit i = day firstDay + i
+  };
+
+  HolidaySet() { clear(); }
+  void clear();
+  bool contains(int32_t day) const;
+  // false when the year is older than every year already kept.
+  bool add(int32_t day);
+  int count() const;
+  // First holiday >= from, -1 if there is none.
+  int32_t next(int32_t from) const;
+
+  Year years[YEARS];
+};
+
+enum RepeatKind : uint8_t {
+  REPEAT_WEEKLY = 0,          // days_mask, every interval weeks
+  REPEAT_MONTH_DAYS = 1,      // month_days, every interval months
+  REPEAT_MONTH_WEEKDAY = 2,   // days_mask x month_weeks, every interval months
+};
+
+static const uint32_t REPEAT_LAST_DAY = 1UL << 31;   // month_days: last day of the month
+static const uint8_t REPEAT_LAST_WEEK = 1 << 4;      // month_weeks: last such weekday
+
+// A repeating schedule. Every rule is answered arithmetically: the next week
+// or month that is on the interval, then a bit scan of the matching days in
+// it. A month rule looks at most 48 months ahead, which covers any interval
+// against the 4-year cycle of month lengths (29 February).
+struct Recurrence {
+  uint32_t month_days = 0;    // bit d-1 = day d, REPEAT_LAST_DAY
+  uint16_t start_day = 0;     // first possible day; anchors the interval
+  uint8_t kind = REPEAT_WEEKLY;
+  uint8_t interval = 1;       // 0 is read as 1
+  uint8_t days_mask = 0;      // bit0=Mon..bit6=Sun
+  uint8_t month_weeks = 0;    // bit0 = 1st .. bit3 = 4th, REPEAT_LAST_WEEK
+  bool skip_holidays = false;
+
+  // First matching day >= from, or -1 if there is none. Holidays are skipped
+  // a bounded number of times (MAX_SKIPS), so a rule that only ever lands on
+  // holidays also gives -1.
+  int32_t next(int32_t from, const HolidaySet* holidays) const;
+
+  static const int MAX_SKIPS = 64;
+  static const int MAX_MONTHS = 48;
+
+private:
+  int32_t nextMatch(int32_t from) const;
+  int32_t nextWeekly(int32_t from) const;
+  int32_t nextMonthly(int32_t from) const;
+  uint32_t monthMask(int y, int m) const;
+};
+
+int daysInMonth(int y, int m);
+const char* repeatKindName(uint8_t kind);
+int repeatKindFromName(const char* name);   // -1 if unknown
+
+// YYYY-MM-DD <-> days since 1970; -1 if the text is not a date.
+int32_t dayFromIsoDate(const char* s);
+void isoDateFromDay(int32_t day, char out[11]);
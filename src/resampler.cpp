@@ -0,0 +1,94 @@
+#include "resampler.h"
+#include <math.h>
+#include <string.h>
+
+// The low-pass is -6 dB at 0.45 x the output rate; the Kaiser window trades
+// transition width for about 55 dB of stopband.
+static const float LOWPASS_CUTOFF = 0.45f;
+static const float KAISER_BETA = 5.0f;
+
+// Zeroth-order modified Bessel function, for the Kaiser window.
+static float besselI0(float x) {
+  float sum = 1.0f, term = 1.0f;
+  for (int k = 1; k < 25; k++) {
+    float t = x / (2.0f * k);
+    term *= t * t;
+    sum += term;
+    if (term < sum * 1e-7f) break;
+  }
+  return sum;
+}
+
+// Only runs when a voice changes rate, so float math is fine here.
+void Resampler::configure(uint32_t inRate, uint32_t outRate) {
+  if (inRate == 0 || outRate == 0) inRate = outRate = 1;
+  step = (uint32_t)(((uint64_t)inRate << 16) / outRate);
+  lowpass = inRate > outRate;
+  if (lowpass) {
+    float fc = LOWPASS_CUTOFF * (float)outRate / (float)inRate;   // cycles per input sample
+    float h[TAPS / 2];
+    float sum = 0;
+    for (int i = 0; i < TAPS / 2; i++) {
+      float t = (float)i - (TAPS - 1) * 0.5f;
+      float r = 2.0f * t / (TAPS - 1);
+      float x = 2.0f * (float)M_PI * fc * t;
+      h[i] = 2.0f * fc * sinf(x) / x * besselI0(KAISER_BETA * sqrtf(1.0f - r * r)) / besselI0(KAISER_BETA);
+      sum += 2.0f * h[i];
+    }
+    // Unity gain at DC; the rounding residue goes to the centre taps.
+    int32_t q = 0;
+    for (int i = 0; i < TAPS / 2; i++) {
+      coef[i] = (int16_t)lroundf(h[i] / sum * 32768.0f);
+      q += 2 * coef[i];
+    }
+    coef[TAPS / 2 - 1] += (int16_t)((32768 - q) / 2);
+  }
+  reset();
+}
+
+void Resampler::reset() {
+  phase = 0;
+  prev = 0;
+  memset(hist, 0, sizeof(hist));
+  histPos = 0;
+}
+
+size_t Resampler::maxOutput(size_t n) const {
+  return (size_t)((((uint64_t)n << 16) + step - 1) / step) + 2;
+}
+
+size_t Resampler::maxInput(size_t outCap) const {
+  if (outCap <= 2) return 0;
+  return (size_t)(((uint64_t)(outCap - 2) * step) >> 16);
+}
+
+// One output of the FIR. The pairs are folded, so 16 multiplies per sample;
+// sum |coef| stays under 1.4 in Q15, which keeps the sum inside 32 bits.
+int32_t Resampler::filter(int32_t x) {
+  histPos = (histPos + 1) & (TAPS - 1);
+  hist[histPos] = hist[histPos + TAPS] = (int16_t)x;
+  const int16_t* w = hist + histPos + 1;   // oldest .. newest
+  int32_t acc = 1 << 14;
+  for (int i = 0; i < TAPS / 2; i++) acc += coef[i] * ((int32_t)w[i] + w[TAPS - 1 - i]);
+  acc >>= 15;
+  if (acc > 32767) acc = 32767;
+  if (acc < -32768) acc = -32768;
+  return acc;
+}
+
+size_t Resampler::process(const int16_t* in, size_t n, int16_t* out) {
+  size_t o = 0;
+  for (size_t i = 0; i < n; i++) {
+    int32_t x = lowpass ? filter(in[i]) : in[i];
+    // Emit every output point that falls between prev and x. The fraction
+    // is taken as Q15 so (x - prev) * frac stays inside 32 bits.
+    int32_t d = x - prev;
+    while (phase < ONE) {
+      out[o++] = (int16_t)(prev + ((d * (int32_t)(phase >> 1)) >> 15));
+      phase += step;
+    }
+    phase -= ONE;
+    prev = x;
+  }
+  return o;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed-point linear-interpolation resampler for mono int16 blocks.
+// Position is tracked in Q16 input samples, so any rate pair in the
+// 8-48 kHz range converts without drift. When decimating, the input first
+// passes a 32-tap Kaiser-windowed sinc low-pass (Q15) cut off just below the
+// output Nyquist, so content above it is attenuated instead of folding back.
+class Resampler {
+public:
+  static const uint32_t ONE = 1UL << 16;
+  static const int TAPS = 32;
+
+  void configure(uint32_t inRate, uint32_t outRate);
+  void reset();
+  bool passthrough() const { return step == ONE && !lowpass; }
+
+  // Upper bound of output samples produced from n input samples.
+  size_t maxOutput(size_t n) const;
+  // Largest input block whose output is guaranteed to fit in outCap.
+  size_t maxInput(size_t outCap) const;
+
+  // Consumes all n input samples; out must hold maxOutput(n) samples.
+  size_t process(const int16_t* in, size_t n, int16_t* out);
+
+private:
+  int32_t filter(int32_t x);
+
+  uint32_t step = ONE;
+  uint32_t phase = 0;
+  bool lowpass = false;
+  int32_t prev = 0;
+  // Symmetric taps, so only the first half is kept. The history is stored
+  // twice so the newest TAPS samples are always contiguous.
+  int16_t coef[TAPS / 2] = {};
+  int16_t hist[2 * TAPS] = {};
+  int histPos = 0;
+};
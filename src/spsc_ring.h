@@ -0,0 +1,93 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+// Lock-free single-producer/single-consumer ring.
+// head is only written by the producer, tail only by the consumer. Both are
+// free-running counters, so fill level is head - tail and wrap is a mask.
+// The span APIs expose the contiguous region up to the wrap point so callers
+// can decode into (or play out of) the buffer without an extra copy.
+template <typename T, uint32_t CAP>
+class SpscRing {
+  static_assert(CAP > 0 && (CAP & (CAP - 1)) == 0, "SpscRing capacity must be a power of two");
+public:
+  static const uint32_t CAPACITY = CAP;
+
+  // Only valid while neither side is running.
+  void reset() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  uint32_t size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+  uint32_t space() const { return CAP - size(); }
+  bool empty() const { return size() == 0; }
+
+  /* Producer side */
+  size_t writeSpan(T** p) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t t = tail.load(std::memory_order_acquire);
+    uint32_t idx = h & MASK;
+    uint32_t avail = CAP - (h - t);
+    uint32_t contig = CAP - idx;
+    *p = buf + idx;
+    return avail < contig ? avail : contig;
+  }
+
+  void commitWrite(size_t n) {
+    head.store(head.load(std::memory_order_relaxed) + (uint32_t)n, std::memory_order_release);
+  }
+
+  size_t write(const T* src, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+      T* dst;
+      size_t span = writeSpan(&dst);
+      if (span == 0) break;
+      if (span > n - done) span = n - done;
+      memcpy(dst, src + done, span * sizeof(T));
+      commitWrite(span);
+      done += span;
+    }
+    return done;
+  }
+
+  /* Consumer side */
+  size_t readSpan(const T** p) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    uint32_t idx = t & MASK;
+    uint32_t avail = h - t;
+    uint32_t contig = CAP - idx;
+    *p = buf + idx;
+    return avail < contig ? avail : contig;
+  }
+
+  void commitRead(size_t n) {
+    tail.store(tail.load(std::memory_order_relaxed) + (uint32_t)n, std::memory_order_release);
+  }
+
+  size_t read(T* dst, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+      const T* src;
+      size_t span = readSpan(&src);
+      if (span == 0) break;
+      if (span > n - done) span = n - done;
+      memcpy(dst + done, src, span * sizeof(T));
+      commitRead(span);
+      done += span;
+    }
+    return done;
+  }
+
+private:
+  static const uint32_t MASK = CAP - 1;
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+  T buf[CAP];
+};
@@ -0,0 +1,194 @@
+#include "time_zone.h"
+#include <ctype.h>
+
+static const int32_t SECS_PER_DAY = 86400;
+
+// Days since 1970-01-01 (Howard Hinnant's algorithm).
+int64_t TimeZone::daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+void TimeZone::civilFromDays(int64_t days, int& y, int& m, int& d) {
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int64_t doe = days - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  d = (int)(doy - (153 * mp + 2) / 5 + 1);
+  m = (int)(mp < 10 ? mp + 3 : mp - 9);
+  y = (int)(yoe + era * 400 + (m <= 2));
+}
+
+static bool isLeap(int y) { return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0; }
+
+/* POSIX TZ parsing */
+static const char* parseName(const char* p) {
+  if (*p == '<') {
+    while (*p && *p != '>') p++;
+    return *p ? p + 1 : nullptr;
+  }
+  const char* s = p;
+  while (isalpha((unsigned char)*p)) p++;
+  return (p - s >= 3) ? p : nullptr;
+}
+
+static const char* parseNumber(const char* p, int& v, int maxDigits) {
+  if (!isdigit((unsigned char)*p)) return nullptr;
+  v = 0;
+  for (int i = 0; i < maxDigits && isdigit((unsigned char)*p); i++) v = v * 10 + (*p++ - '0');
+  return p;
+}
+
+// [+|-]hh[:mm[:ss]]
+static const char* parseTime(const char* p, int32_t& secs) {
+  int sign = 1;
+  if (*p == '+' || *p == '-') sign = (*p++ == '-') ? -1 : 1;
+  int h, m = 0, s = 0;
+  if (!(p = parseNumber(p, h, 3))) return nullptr;
+  if (*p == ':' && !(p = parseNumber(p + 1, m, 2))) return nullptr;
+  if (*p == ':' && !(p = parseNumber(p + 1, s, 2))) return nullptr;
+  secs = sign * (h * 3600 + m * 60 + s);
+  return p;
+}
+
+static const char* parseRule(const char* p, char& kind, int16_t& month, int16_t& week, int16_t& day, int32_t& secs) {
+  int a, b = 0, c = 0;
+  if (*p == 'M') {
+    kind = 'M';
+    if (!(p = parseNumber(p + 1, a, 2)) || *p != '.') return nullptr;
+    if (!(p = parseNumber(p + 1, b, 1)) || *p != '.') return nullptr;
+    if (!(p = parseNumber(p + 1, c, 1))) return nullptr;
+    if (a < 1 || a > 12 || b < 1 || b > 5 || c > 6) return nullptr;
+  } else if (*p == 'J') {
+    kind = 'J';
+    if (!(p = parseNumber(p + 1, a, 3)) || a < 1 || a > 365) return nullptr;
+  } else {
+    kind = 'D';
+    if (!(p = parseNumber(p, a, 3)) || a > 365) return nullptr;
+  }
+  month = (int16_t)a;
+  week = (int16_t)b;
+  day = (int16_t)c;
+  secs = 7200;
+  if (*p == '/' && !(p = parseTime(p + 1, secs))) return nullptr;
+  return p;
+}
+
+bool TimeZone::begin(const char* posix) {
+  err = "";
+  hasDst = false;
+  tables[0] = Table{};
+  tables[1] = Table{};
+
+  const char* p = posix ? parseName(posix) : nullptr;
+  int32_t off;
+  if (!p || !(p = parseTime(p, off))) { err = "bad standard time"; return false; }
+  stdOffset = -off;   // POSIX counts hours west of UTC
+  dstOffset = stdOffset;
+  if (!*p) return true;
+
+  if (!(p = parseName(p))) { err = "bad dst name"; return false; }
+  hasDst = true;
+  dstOffset = stdOffset + 3600;
+  if (*p && *p != ',') {
+    if (!(p = parseTime(p, off))) { err = "bad dst offset"; return false; }
+    dstOffset = -off;
+  }
+
+  // US rules when none are given, as libc does.
+  start = Rule{'M', 3, 2, 0, 7200};
+  end = Rule{'M', 11, 1, 0, 7200};
+  if (!*p) return true;
+  if (*p != ',' || !(p = parseRule(p + 1, start.kind, start.month, start.week, start.day, start.secs))) {
+    err = "bad dst start rule";
+    return false;
+  }
+  if (*p != ',' || !(p = parseRule(p + 1, end.kind, end.month, end.week, end.day, end.secs))) {
+    err = "bad dst end rule";
+    return false;
+  }
+  if (*p) { err = "trailing characters"; return false; }
+  return true;
+}
+
+/* Transitions */
+int64_t TimeZone::ruleLocal(const Rule& r, int year) const {
+  int64_t jan1 = daysFromCivil(year, 1, 1);
+  int64_t day;
+  if (r.kind == 'J') {
+    day = jan1 + r.month - 1 + (isLeap(year) && r.month >= 60 ? 1 : 0);
+  } else if (r.kind == 'D') {
+    day = jan1 + r.month;
+  } else {
+    int64_t first = daysFromCivil(year, r.month, 1);
+    int64_t next = r.month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, r.month + 1, 1);
+    int firstSun0 = (weekdayMon0(first) + 1) % 7;
+    day = first + (r.day - firstSun0 + 7) % 7 + (r.week - 1) * 7;
+    if (day >= next) day -= 7;   // week 5 means the last one
+  }
+  return day * SECS_PER_DAY + r.secs;
+}
+
+void TimeZone::build(Table& tb, int year) const {
+  tb.n = 0;
+  tb.base = stdOffset;
+  tb.from = (time_t)(daysFromCivil(year, 1, 1) * SECS_PER_DAY);
+  tb.to = (time_t)(daysFromCivil(year + 2, 1, 1) * SECS_PER_DAY);
+  if (!hasDst) return;
+
+  // The start rule is given in standard time, the end rule in DST.
+  for (int y = year - 1; y <= year + 2; y++) {
+    Transition both[2] = {{(time_t)(ruleLocal(start, y) - stdOffset), dstOffset},
+                          {(time_t)(ruleLocal(end, y) - dstOffset), stdOffset}};
+    for (const Transition& x : both) {
+      uint8_t i = tb.n++;
+      while (i > 0 && tb.t[i - 1].at > x.at) { tb.t[i] = tb.t[i - 1]; i--; }
+      tb.t[i] = x;
+    }
+  }
+  tb.base = tb.t[0].offset == dstOffset ? stdOffset : dstOffset;
+}
+
+int32_t TimeZone::lookup(const Table& tb, time_t utc) {
+  int32_t off = tb.base;
+  for (uint8_t i = 0; i < tb.n && tb.t[i].at <= utc; i++) off = tb.t[i].offset;
+  return off;
+}
+
+void TimeZone::refresh(time_t now) {
+  const Table& tb = tables[cur];
+  if (tb.to > tb.from && now >= tb.from && now < tb.to - 2 * SECS_PER_DAY) return;
+  int y, m, d;
+  civilFromDays(dayOf(now), y, m, d);
+  build(tables[cur ^ 1], y);
+  cur ^= 1;
+}
+
+int32_t TimeZone::offsetAt(time_t utc) const {
+  if (!hasDst) return stdOffset;
+  const Table& tb = tables[cur];
+  if (utc >= tb.from && utc < tb.to) return lookup(tb, utc);
+
+  Table tmp;
+  int y, m, d;
+  civilFromDays(dayOf(utc), y, m, d);
+  build(tmp, y);
+  return lookup(tmp, utc);
+}
+
+time_t TimeZone::toUtc(int64_t local) const {
+  if (!hasDst) return (time_t)(local - stdOffset);
+  int32_t lo = stdOffset < dstOffset ? stdOffset : dstOffset;
+  int32_t hi = stdOffset < dstOffset ? dstOffset : stdOffset;
+  time_t early = (time_t)(local - hi);
+  time_t late = (time_t)(local - lo);
+  // Valid at the larger offset: unambiguous, or the first pass of an overlap.
+  // Otherwise the smaller offset, which is also how a gap time is read.
+  return offsetAt(early) == hi ? early : late;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+
+// UTC offsets from a POSIX TZ string ("CET-1CEST,M3.5.0/2,M10.5.0/3")
+// without going through libc. The DST transitions around the current and
+// next year are kept as UTC instants, so a lookup is a few compares.
+// Local times are "local epoch" seconds: the wall clock read as if it were
+// UTC, so local / 86400 is the local day number.
+class TimeZone {
+public:
+  bool begin(const char* posix);
+  const char* error() const { return err; }
+
+  // Moves the cached table to the year of now once it has run out.
+  void refresh(time_t now);
+
+  // Seconds east of UTC.
+  int32_t offsetAt(time_t utc) const;
+  int64_t toLocal(time_t utc) const { return (int64_t)utc + offsetAt(utc); }
+  // Wall time to UTC. A time skipped by a spring-forward gap moves forward by
+  // the gap (02:30 becomes 03:30); a time repeated in the fall overlap is
+  // the first of the two.
+  time_t toUtc(int64_t local) const;
+
+  static int64_t daysFromCivil(int y, int m, int d);
+  static void civilFromDays(int64_t days, int& y, int& m, int& d);
+  static int64_t dayOf(int64_t secs) { return secs >= 0 ? secs / 86400 : -((-secs + 86399) / 86400); }
+  static int weekdayMon0(int64_t days) { return (int)(((days + 3) % 7 + 7) % 7); }
+
+private:
+  struct Rule {
+    char kind = 'M';     // 'M' month.week.day, 'J' 1..365 without Feb 29, 'D' 0..365
+    int16_t month = 0, week = 0, day = 0;
+    int32_t secs = 7200; // local time of day of the change
+  };
+  struct Transition {
+    time_t at;
+    int32_t offset;      // in effect from at
+  };
+  // Transitions of the year before through two years after firstYear, so
+  // every instant of firstYear and the year after is covered.
+  struct Table {
+    time_t from = 0, to = 0;
+    int32_t base = 0;    // offset before the first transition
+    Transition t[8];
+    uint8_t n = 0;
+  };
+
+  void build(Table& tb, int year) const;
+  int64_t ruleLocal(const Rule& r, int year) const;
+  static int32_t lookup(const Table& tb, time_t utc);
+
+  int32_t stdOffset = 0;
+  int32_t dstOffset = 0;
+  bool hasDst = false;
+  Rule start, end;
+  const char* err = "";
+
+  Table tables[2];
+  volatile uint8_t cur = 0;  // refresh() fills the other table, then flips
+};
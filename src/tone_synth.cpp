@@ -0,0 +1,117 @@
+#include "tone_synth.h"
+#include <string.h>
+
+// sin(2*pi*i/256) * 23170 (-3 dBFS) for the first quarter, i = 0..64.
+static const int16_t SINE_Q[65] = {
+  0, 569, 1137, 1704, 2271, 2836, 3400, 3961, 4520, 5077, 5630, 6180, 6726,
+  7268, 7806, 8339, 8867, 9389, 9906, 10417, 10922, 11420, 11912, 12396, 12873, 13341,
+  13802, 14255, 14699, 15134, 15560, 15977, 16384, 16781, 17168, 17545, 17911, 18266, 18610,
+  18943, 19265, 19575, 19874, 20160, 20434, 20696, 20945, 21182, 21406, 21617, 21816, 22001,
+  22172, 22331, 22476, 22607, 22725, 22829, 22919, 22996, 23058, 23107, 23142, 23163, 23170,
+};
+
+// Attack/release length in samples (~3 ms at 22050 Hz), as a shift.
+static const int RAMP_SHIFT = 6;
+static const uint32_t RAMP = 1u << RAMP_SHIFT;
+
+static const ToneSynth::Step PAT_BEEP[] = { {256, 200}, {0, 800} };
+static const ToneSynth::Step PAT_DOUBLE[] = { {256, 150}, {0, 100}, {256, 150}, {0, 600} };
+static const ToneSynth::Step PAT_TRIPLE[] = { {256, 100}, {0, 80}, {256, 100}, {0, 80}, {256, 100}, {0, 540} };
+static const ToneSynth::Step PAT_CHIRP[] = { {192, 120}, {256, 120}, {320, 120}, {0, 640} };
+static const ToneSynth::Step PAT_SIREN[] = { {256, 400}, {341, 400} };
+
+struct PatternDef {
+  const char* name;
+  const ToneSynth::Step* steps;
+  uint8_t count;
+};
+
+#define PATTERN(n, s) { n, s, (uint8_t)(sizeof(s) / sizeof(s[0])) }
+static const PatternDef PATTERNS[SYNTH_PATTERN_COUNT] = {
+  PATTERN("beep", PAT_BEEP),
+  PATTERN("double", PAT_DOUBLE),
+  PATTERN("triple", PAT_TRIPLE),
+  PATTERN("chirp", PAT_CHIRP),
+  PATTERN("siren", PAT_SIREN),
+};
+#undef PATTERN
+
+const char* synthPatternName(uint8_t pattern) {
+  return pattern < SYNTH_PATTERN_COUNT ? PATTERNS[pattern].name : PATTERNS[0].name;
+}
+
+int synthPatternFromName(const char* name) {
+  if (!name) return -1;
+  for (int i = 0; i < SYNTH_PATTERN_COUNT; i++) {
+    if (strcmp(name, PATTERNS[i].name) == 0) return i;
+  }
+  return -1;
+}
+
+static inline int16_t sineAt(uint32_t phase) {
+  uint32_t idx = phase >> 24;
+  uint32_t pos = idx & 63;
+  switch (idx >> 6) {
+    case 0: return SINE_Q[pos];
+    case 1: return SINE_Q[64 - pos];
+    case 2: return (int16_t)-SINE_Q[pos];
+    default: return (int16_t)-SINE_Q[64 - pos];
+  }
+}
+
+void ToneSynth::start(uint8_t pattern, uint16_t hz, uint32_t sampleRate, uint32_t cycleCount) {
+  if (pattern >= SYNTH_PATTERN_COUNT) pattern = SYNTH_BEEP;
+  if (hz < BASE_HZ_MIN || hz > BASE_HZ_MAX) hz = BASE_HZ_DEFAULT;
+  steps = PATTERNS[pattern].steps;
+  stepCount = PATTERNS[pattern].count;
+  rate = sampleRate;
+  baseHz = hz;
+  cycles = 0;
+  cycleLimit = cycleCount;
+  phase = 0;
+  finished = false;
+  enterStep(0);
+}
+
+void ToneSynth::enterStep(uint8_t i) {
+  step = i;
+  stepPos = 0;
+  stepLen = (steps[i].ms * rate) / 1000;
+  // Phase increment = f * 2^32 / rate, with f = base * ratio / 256.
+  uint64_t f = ((uint64_t)baseHz * steps[i].ratioQ8) << 24;
+  inc = (uint32_t)(f / rate);
+}
+
+size_t ToneSynth::render(int16_t* out, size_t n) {
+  size_t done = 0;
+  while (done < n && !finished) {
+    size_t k = n - done;
+    if (k > stepLen - stepPos) k = stepLen - stepPos;
+
+    if (inc == 0) {
+      memset(out + done, 0, k * sizeof(int16_t));
+    } else {
+      for (size_t i = 0; i < k; i++) {
+        int32_t s = sineAt(phase);
+        phase += inc;
+        uint32_t p = stepPos + (uint32_t)i;
+        uint32_t edge = p < stepLen - 1 - p ? p : stepLen - 1 - p;
+        if (edge < RAMP) s = (s * (int32_t)edge) >> RAMP_SHIFT;
+        out[done + i] = (int16_t)s;
+      }
+    }
+    done += k;
+    stepPos += (uint32_t)k;
+
+    if (stepPos >= stepLen) {
+      if (step + 1 < stepCount) {
+        enterStep(step + 1);
+      } else {
+        cycles++;
+        if (cycleLimit && cycles >= cycleLimit) finished = true;
+        else enterStep(0);
+      }
+    }
+  }
+  return done;
+}
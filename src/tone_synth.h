@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Built-in beep patterns. A pattern is a short list of tone/silence steps
+// that repeats; tone pitches are relative to a base frequency.
+enum SynthPattern : uint8_t {
+  SYNTH_BEEP, SYNTH_DOUBLE, SYNTH_TRIPLE, SYNTH_CHIRP, SYNTH_SIREN, SYNTH_PATTERN_COUNT
+};
+
+const char* synthPatternName(uint8_t pattern);
+int synthPatternFromName(const char* name);   // -1 if unknown
+
+// Direct digital synthesis from a quarter-wave sine table (65 entries in
+// flash): a 32-bit phase accumulator per sample, no file system, network or
+// heap. Each tone is shaped by a short linear attack/release so step edges
+// do not click. Output is mono int16 at the configured rate.
+class ToneSynth {
+public:
+  static const uint16_t BASE_HZ_DEFAULT = 880;
+  static const uint16_t BASE_HZ_MIN = 100;
+  static const uint16_t BASE_HZ_MAX = 4000;
+
+  // cycles = number of pattern repeats, 0 = until stopped.
+  void start(uint8_t pattern, uint16_t baseHz, uint32_t sampleRate, uint32_t cycles);
+  // Fills up to n samples; fewer only once the last cycle has ended.
+  size_t render(int16_t* out, size_t n);
+  void setCycleLimit(uint32_t n) { cycleLimit = n; }
+  bool done() const { return finished; }
+  uint32_t cyclesDone() const { return cycles; }
+
+  struct Step {
+    uint16_t ratioQ8;   // pitch relative to base, 256 = base, 0 = silence
+    uint16_t ms;
+  };
+
+private:
+  void enterStep(uint8_t i);
+
+  const Step* steps = nullptr;
+  uint8_t stepCount = 0;
+  uint8_t step = 0;
+  uint32_t stepPos = 0;
+  uint32_t stepLen = 0;
+  uint32_t phase = 0;
+  uint32_t inc = 0;
+  uint32_t rate = 22050;
+  uint16_t baseHz = BASE_HZ_DEFAULT;
+  uint32_t cycles = 0;
+  uint32_t cycleLimit = 0;
+  bool finished = true;
+};
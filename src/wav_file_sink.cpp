@@ -0,0 +1,64 @@
+#include "wav_file_sink.h"
+#include <string.h>
+
+bool WavFileSink::begin(int sr, AudioPullFn fn, void* c) {
+  pull = fn;
+  ctx = c;
+  sampleRate = sr;
+  return path != nullptr;
+}
+
+void WavFileSink::end() { stop(); }
+
+void WavFileSink::start() {
+  if (fp) return;
+  fp = fopen(path, "wb");
+  dataBytes = 0;
+  if (fp) writeHeader();
+}
+
+void WavFileSink::stop() {
+  if (!fp) return;
+  fseek(fp, 0, SEEK_SET);
+  writeHeader();
+  fclose(fp);
+  fp = nullptr;
+}
+
+size_t WavFileSink::render(size_t frames) {
+  if (!fp) return 0;
+  int16_t buf[256];
+  size_t real = 0;
+  while (frames > 0) {
+    size_t n = frames < 256 ? frames : 256;
+    real += pull(ctx, buf, n);
+    uint8_t le[512];
+    for (size_t i = 0; i < n; i++) {
+      le[i * 2 + 0] = (uint8_t)(buf[i] & 0xFF);
+      le[i * 2 + 1] = (uint8_t)((buf[i] >> 8) & 0xFF);
+    }
+    dataBytes += (uint32_t)fwrite(le, 1, n * 2, fp);
+    frames -= n;
+  }
+  return real;
+}
+
+void WavFileSink::writeHeader() {
+  uint8_t h[44];
+  auto le16 = [&](int off, uint16_t v) { h[off] = v & 0xFF; h[off + 1] = (v >> 8) & 0xFF; };
+  auto le32 = [&](int off, uint32_t v) { le16(off, v & 0xFFFF); le16(off + 2, v >> 16); };
+  memcpy(h + 0, "RIFF", 4);
+  le32(4, 36 + dataBytes);
+  memcpy(h + 8, "WAVE", 4);
+  memcpy(h + 12, "fmt ", 4);
+  le32(16, 16);
+  le16(20, 1);
+  le16(22, 1);
+  le32(24, (uint32_t)sampleRate);
+  le32(28, (uint32_t)sampleRate * 2);
+  le16(32, 2);
+  le16(34, 16);
+  memcpy(h + 36, "data", 4);
+  le32(40, dataBytes);
+  fwrite(h, 1, sizeof(h), fp);
+}
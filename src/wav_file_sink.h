@@ -0,0 +1,29 @@
+#pragma once
+#include "audio_sink.h"
+#include <stdio.h>
+
+// Host/regression sink: renders the pipeline into a 16-bit mono WAV file.
+// Nothing clocks it; the caller drives it with render(). Plain stdio only,
+// so it builds on the host (tools/host/audio_bench.cpp) as well.
+class WavFileSink : public AudioSink {
+public:
+  explicit WavFileSink(const char* path) : path(path) {}
+  const char* name() const override { return "wav_file"; }
+  bool begin(int sampleRate, AudioPullFn pull, void* ctx) override;
+  void end() override;
+  void setSampleRate(int sr) override { sampleRate = sr; }
+  void start() override;
+  void stop() override;
+  // Pulls and writes frames samples; returns how many came from the source.
+  size_t render(size_t frames);
+  bool isOpen() const { return fp != nullptr; }
+private:
+  void writeHeader();
+
+  const char* path;
+  int sampleRate = 16000;
+  AudioPullFn pull = nullptr;
+  void* ctx = nullptr;
+  FILE* fp = nullptr;
+  uint32_t dataBytes = 0;
+};
@@ -0,0 +1,416 @@
+// Host benchmark for the audio decode path (AudioVoice: file/stream reader,
+// WAV/PCM/ADPCM/MP3 decoders, resampler, gain). Built by the native-bench
+// environment in platformio.ini against the shims in tools/host/shim.
+//
+// Each case renders through WavFileSink, 256-sample blocks at a time as the
+// PDM sink pulls them, into <root>/out/<case>.wav for listening. The virtual
+// clock moves on by one block per pull, so URL streams see their simulated
+// throughput in audio time. Reported per case: output
+// samples, best wall time over --repeat runs, output samples per second,
+// speed relative to real time, underrun blocks and an FNV-1a hash of what was
+// played: every block as the sink received it, silence padding included, and
+// how many of its samples came from the voice, so underruns and where they
+// fall change the hash too. MP3 cases also report what MP3Decode() itself
+// cost per second of audio, the host counterpart of the device's
+// audio_decode_cycles_per_sec: host nanoseconds scaled to the C3's 160 MHz
+// clock, so 160 would be the whole CPU. WAV inputs are generated with
+// integer math and the MP3 input is the committed tools/host/bench.mp3 (3 s,
+// 22.05 kHz mono, 32 kbit/s), so the hashes are the same on every machine
+// for a given Helix version. tools/host/audio_bench.golden holds
+// the reference for the default --seconds; --check it after a change, or
+// --save a new one when a change to the output is intended.
+//
+// --fill instead times the WAV fill path alone against the original loop
+// (tools/host/wav_fill_bench.cpp).
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <errno.h>
+#include <sys/stat.h>
+#include "audio_voice.h"
+#include "wav_file_sink.h"
+#include "native_pcm.h"
+#include "wav_fill_bench.h"
+
+AudioStats audioStats;
+
+static const int BLOCK_SAMPLES = 256;
+static const uint64_t BLOCK_US = (uint64_t)BLOCK_SAMPLES * 1000000 / AUDIO_OUTPUT_RATE;
+static const double C3_CYCLES_PER_NS = 0.160;
+static const char* MP3_FIXTURE = "tools/host/bench.mp3";
+
+// What the sink pulled from the voice, folded into an FNV-1a hash.
+struct PullTally {
+  uint32_t hash = 2166136261u;
+  uint64_t samples = 0;
+
+  void add(const void* data, size_t bytes) {
+    const uint8_t* b = (const uint8_t*)data;
+    for (size_t i = 0; i < bytes; i++) hash = (hash ^ b[i]) * 16777619u;
+  }
+};
+
+static AudioVoice voice;
+
+static size_t pullVoice(void* ctx, int16_t* dst, size_t n) {
+  PullTally* t = (PullTally*)ctx;
+  voice.pump();
+  size_t got = voice.read(dst, n);
+  memset(dst + got, 0, (n - got) * sizeof(int16_t));
+  uint32_t real = (uint32_t)got;
+  t->add(&real, sizeof(real));
+  t->add(dst, n * sizeof(int16_t));
+  t->samples += got;
+  return got;
+}
+
+/* Inputs */
+static void put16(std::vector<uint8_t>& v, uint16_t x) { v.push_back(x & 0xFF); v.push_back(x >> 8); }
+static void put32(std::vector<uint8_t>& v, uint32_t x) { put16(v, x & 0xFFFF); put16(v, x >> 16); }
+
+// A 200 Hz -> 4 kHz triangle sweep plus noise at -30 dB, the right channel a
+// quarter period behind the left.
+static std::vector<uint8_t> makeWav(uint32_t rate, uint16_t channels, uint16_t bits, uint32_t seconds) {
+  uint32_t frames = rate * seconds;
+  uint16_t blockAlign = channels * (bits / 8);
+  std::vector<uint8_t> w;
+  w.insert(w.end(), {'R', 'I', 'F', 'F'});
+  put32(w, 36 + frames * blockAlign);
+  w.insert(w.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+  put32(w, 16);
+  put16(w, 1);
+  put16(w, channels);
+  put32(w, rate);
+  put32(w, rate * blockAlign);
+  put16(w, blockAlign);
+  put16(w, bits);
+  w.insert(w.end(), {'d', 'a', 't', 'a'});
+  put32(w, frames * blockAlign);
+
+  uint32_t phase = 0;
+  uint32_t noise = 12345;
+  for (uint32_t i = 0; i < frames; i++) {
+    uint32_t hz = 200 + (uint32_t)((uint64_t)3800 * i / frames);
+    phase += (uint32_t)(((uint64_t)hz << 32) / rate);
+    for (uint16_t c = 0; c < channels; c++) {
+      uint32_t p = phase - c * 0x40000000u;
+      int32_t tri = (int32_t)(p >> 15);   // 0..131071
+      tri = (tri < 65536 ? tri : 131071 - tri) - 32768;
+      noise = noise * 1664525u + 1013904223u;
+      int32_t s = tri * 3 / 4 + ((int32_t)(noise >> 16) - 32768) / 32;
+      if (bits == 8) w.push_back((uint8_t)((s >> 8) + 128));
+      else put16(w, (uint16_t)(int16_t)s);
+    }
+  }
+  return w;
+}
+
+static bool writeFsFile(const char* path, const std::vector<uint8_t>& data) {
+  File f = LittleFS.open(path, "w");
+  if (!f) return false;
+  bool ok = f.write(data.data(), data.size()) == data.size();
+  f.close();
+  return ok;
+}
+
+static bool readHostFile(const char* path, std::vector<uint8_t>& out) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp) return false;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(fp);
+  return true;
+}
+
+// Sends the body in chunks of assorted sizes, one with an extension.
+static std::vector<uint8_t> chunked(const std::vector<uint8_t>& in) {
+  static const size_t SIZES[] = {1, 1000, 4096, 333, 17000};
+  std::vector<uint8_t> out;
+  size_t pos = 0;
+  for (int i = 0; pos < in.size(); i++) {
+    size_t n = min(SIZES[i % 5], in.size() - pos);
+    char line[32];
+    int len = snprintf(line, sizeof(line), i == 2 ? "%zx;name=value\r\n" : "%zX\r\n", n);
+    out.insert(out.end(), line, line + len);
+    out.insert(out.end(), in.begin() + pos, in.begin() + pos + n);
+    out.insert(out.end(), {'\r', '\n'});
+    pos += n;
+  }
+  const char* last = "0\r\nX-Trailer: 1\r\n\r\n";
+  out.insert(out.end(), last, last + strlen(last));
+  return out;
+}
+
+// Inserts an ICY metadata block every metaInt bytes, as a radio server does;
+// every other block is empty.
+static std::vector<uint8_t> icy(const std::vector<uint8_t>& in, uint32_t metaInt) {
+  std::vector<uint8_t> out;
+  for (size_t pos = 0, block = 0; pos < in.size(); pos += metaInt, block++) {
+    size_t n = min((size_t)metaInt, in.size() - pos);
+    out.insert(out.end(), in.begin() + pos, in.begin() + pos + n);
+    if (n < metaInt) break;
+    if (block % 2) { out.push_back(0); continue; }
+    char meta[64];
+    snprintf(meta, sizeof(meta), "StreamTitle='Bench %zu';StreamUrl='';", block);
+    size_t len = (strlen(meta) + 15) / 16 * 16;
+    out.push_back((uint8_t)(len / 16));
+    out.insert(out.end(), meta, meta + strlen(meta));
+    out.insert(out.end(), len - strlen(meta), 0);
+  }
+  return out;
+}
+
+// Runs a WAV through the upload transcoder, in upload-sized pieces.
+static bool transcode(const std::vector<uint8_t>& wav, const char* outPath, TranscodeFormat fmt) {
+  WavTranscoder tc;
+  if (!tc.begin(outPath, 16, fmt)) return false;
+  for (size_t pos = 0; pos < wav.size(); pos += 1460) {
+    if (!tc.feed(wav.data() + pos, min((size_t)1460, wav.size() - pos))) return false;
+  }
+  return tc.finish();
+}
+
+/* Cases */
+struct BenchCase {
+  String name;
+  String path;                  // local file, or empty for a URL case
+  const std::vector<uint8_t>* body = nullptr;
+  uint32_t bytesPerSec = 0;     // URL throughput
+  String url;
+  bool chunked = false;
+  uint32_t icyMetaInt = 0;
+  const char* contentType = nullptr;
+  const char* sameAs = nullptr;   // earlier case whose output this must equal
+};
+
+static BenchCase fileCase(const char* name, const char* path) {
+  BenchCase c;
+  c.name = name;
+  c.path = path;
+  return c;
+}
+
+static BenchCase urlCase(const char* name, const std::vector<uint8_t>* body, uint32_t bytesPerSec, const char* url,
+                         bool chunked = false, uint32_t icyMetaInt = 0, const char* contentType = nullptr) {
+  BenchCase c;
+  c.name = name;
+  c.body = body;
+  c.bytesPerSec = bytesPerSec;
+  c.url = url;
+  c.chunked = chunked;
+  c.icyMetaInt = icyMetaInt;
+  c.contentType = contentType;
+  return c;
+}
+
+struct BenchResult {
+  bool ok = false;
+  String error;
+  uint64_t samples = 0;
+  double wallMs = 0;
+  uint32_t underruns = 0;
+  uint32_t hash = 0;
+  uint32_t decodeNsPerSec = 0;   // MP3Decode() time per second of audio, 0 if not MP3
+};
+
+static bool startCase(const BenchCase& c, String& err) {
+  if (c.path.length()) {
+    if (!voice.startLocal(c.path, 100, 0)) { err = voice.lastError(); return false; }
+  } else {
+    hostNetServe(*c.body, c.bytesPerSec);
+    if (c.chunked) hostNetHeader("Transfer-Encoding", "chunked");
+    if (c.icyMetaInt) hostNetHeader("icy-metaint", String((unsigned long)c.icyMetaInt).c_str());
+    if (c.contentType) hostNetHeader("Content-Type", c.contentType);
+    AudioHttpStream* s = new AudioHttpStream();
+    int code = (s->connect(c.url, 4000) && s->sendRequest()) ? s->pollResponse() : -1;
+    if (code != 200) { delete s; err = "http_failed"; return false; }
+    voice.startStream(s, c.url, 100, 0, AUDIO_NET_START_DEFAULT, AUDIO_NET_LOW_DEFAULT, 5000);
+  }
+  // Streams prebuffer and MP3 primes one step per producer pass.
+  int r = 1;
+  while (voice.starting() && (r = voice.pollStart()) == 0) hostAdvanceMicros(BLOCK_US);
+  if (r < 0) { err = voice.lastError(); return false; }
+  return true;
+}
+
+static BenchResult runCase(const BenchCase& c, const std::string& outDir, int repeat, uint32_t maxSeconds) {
+  using namespace std::chrono;
+  BenchResult res;
+  std::string out = outDir + "/" + c.name.c_str() + ".wav";
+  WavFileSink sink(out.c_str());
+  PullTally tally;
+  sink.begin(AUDIO_OUTPUT_RATE, pullVoice, &tally);
+  uint64_t maxBlocks = (uint64_t)maxSeconds * AUDIO_OUTPUT_RATE / BLOCK_SAMPLES;
+
+  for (int run = 0; run < repeat; run++) {
+    if (!startCase(c, res.error)) return res;
+    tally = PullTally();
+    sink.start();
+    if (!sink.isOpen()) { res.error = "cannot write " + String(out.c_str()); voice.stop(); return res; }
+    uint32_t underruns = 0;
+    auto t0 = steady_clock::now();
+    for (uint64_t b = 0; b < maxBlocks && voice.active() && !voice.finished(); b++) {
+      // A short block at the very end is not an underrun.
+      if (sink.render(BLOCK_SAMPLES) < (size_t)BLOCK_SAMPLES && !voice.finished()) underruns++;
+      hostAdvanceMicros(BLOCK_US);
+    }
+    double ms = duration<double, std::milli>(steady_clock::now() - t0).count();
+    uint32_t decodeNs = voice.decodeCyclesPerSecond();   // host getCycleCount() counts ns
+    voice.stop();
+    sink.stop();
+
+    if (run > 0 && tally.hash != res.hash) { res.error = "nondeterministic"; return res; }
+    if (run == 0 || ms < res.wallMs) res.wallMs = ms;
+    if (run == 0 || decodeNs < res.decodeNsPerSec) res.decodeNsPerSec = decodeNs;
+    res.hash = tally.hash;
+    res.samples = tally.samples;
+    res.underruns = underruns;
+  }
+  res.ok = true;
+  return res;
+}
+
+static std::map<std::string, uint32_t> loadHashes(const char* path) {
+  std::map<std::string, uint32_t> m;
+  FILE* fp = fopen(path, "r");
+  if (!fp) return m;
+  char name[64];
+  unsigned long h;
+  while (fscanf(fp, "%63s %lx", name, &h) == 2) m[name] = (uint32_t)h;
+  fclose(fp);
+  return m;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: audio_bench [--root DIR] [--seconds N] [--repeat N] [--mp3 FILE (default %s)]\n"
+          "                   [--save FILE] [--check FILE] [--fill]\n", MP3_FIXTURE);
+}
+
+int main(int argc, char** argv) {
+  const char* root = "/tmp/audio_bench";
+  const char* mp3Path = MP3_FIXTURE;
+  const char* savePath = nullptr;
+  const char* checkPath = nullptr;
+  uint32_t seconds = 10;
+  int repeat = 5;
+  bool fill = false;
+  for (int i = 1; i < argc; i++) {
+    String a = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (a == "--root" && hasValue) root = argv[++i];
+    else if (a == "--seconds" && hasValue) seconds = (uint32_t)max(1, atoi(argv[++i]));
+    else if (a == "--repeat" && hasValue) repeat = max(1, atoi(argv[++i]));
+    else if (a == "--mp3" && hasValue) mp3Path = argv[++i];
+    else if (a == "--save" && hasValue) savePath = argv[++i];
+    else if (a == "--check" && hasValue) checkPath = argv[++i];
+    else if (a == "--fill") fill = true;
+    else { usage(); return 2; }
+  }
+
+  if (!hostFsBegin(root) || !LittleFS.mkdir("/bench")) {
+    fprintf(stderr, "cannot use %s as the flash root: %s (pick another with --root DIR)\n", root, strerror(errno));
+    return 2;
+  }
+  std::string outDir = std::string(root) + "/out";
+  ::mkdir(outDir.c_str(), 0755);
+
+  if (fill) {
+    static const WavFillInput inputs[] = {
+      {"wav_mono16_22k", "/bench/mono16_22k.wav"},
+      {"wav_stereo16_22k", "/bench/stereo16_22k.wav"},
+    };
+    if (!writeFsFile(inputs[0].path, makeWav(AUDIO_OUTPUT_RATE, 1, 16, seconds)) ||
+        !writeFsFile(inputs[1].path, makeWav(AUDIO_OUTPUT_RATE, 2, 16, seconds))) {
+      fprintf(stderr, "cannot write the inputs\n");
+      return 2;
+    }
+    return wavFillBench(inputs, 2, repeat) ? 1 : 0;
+  }
+
+  std::vector<uint8_t> mono16 = makeWav(16000, 1, 16, seconds);
+  std::vector<uint8_t> stereo16 = makeWav(44100, 2, 16, seconds);
+  std::vector<uint8_t> mono8 = makeWav(8000, 1, 8, seconds);
+  std::vector<uint8_t> mp3;
+  bool ok = writeFsFile("/bench/mono16_16k.wav", mono16) &&
+            writeFsFile("/bench/stereo16_44k.wav", stereo16) &&
+            writeFsFile("/bench/mono8_8k.wav", mono8) &&
+            transcode(mono16, "/bench/native16.pcm", TRANSCODE_PCM) &&
+            transcode(mono16, "/bench/adpcm.wav", TRANSCODE_ADPCM);
+  if (!ok) {
+    fprintf(stderr, "cannot write the inputs\n");
+    return 2;
+  }
+  if (!readHostFile(mp3Path, mp3) || !writeFsFile("/bench/input.mp3", mp3)) {
+    fprintf(stderr, "cannot read %s (run from the project root, or pass --mp3 FILE)\n", mp3Path);
+    return 2;
+  }
+
+  // Mono 16 kHz WAV needs 32000 B/s: fast has headroom, slow starves.
+  std::vector<BenchCase> cases;
+  cases.push_back(fileCase("wav_mono16_16k", "/bench/mono16_16k.wav"));
+  cases.push_back(fileCase("wav_stereo16_44k", "/bench/stereo16_44k.wav"));
+  cases.push_back(fileCase("wav_mono8_8k", "/bench/mono8_8k.wav"));
+  cases.push_back(fileCase("pcm_native16", "/bench/native16.pcm"));
+  cases.push_back(fileCase("wav_adpcm_22k", "/bench/adpcm.wav"));
+  // Chunked and ICY framing must not change the output: same hash as
+  // url_wav_128k. A fast MP3 stream, framed or not, must play exactly what the
+  // file does; that holds whatever the Helix version, unlike the goldens.
+  std::vector<uint8_t> monoChunked = chunked(mono16);
+  std::vector<uint8_t> monoRadio = chunked(icy(mono16, 8192));
+  cases.push_back(urlCase("url_wav_128k", &mono16, 128000, "http://bench.local/mono16_16k.wav"));
+  cases.push_back(urlCase("url_wav_24k", &mono16, 24000, "http://bench.local/mono16_16k.wav"));
+  cases.push_back(urlCase("url_wav_chunked", &monoChunked, 128000, "http://bench.local/mono16_16k.wav", true));
+  cases.back().sameAs = "url_wav_128k";
+  cases.push_back(urlCase("url_wav_icy", &monoRadio, 128000, "http://bench.local/radio", true, 8192, "audio/wav"));
+  cases.back().sameAs = "url_wav_128k";
+  std::vector<uint8_t> mp3Radio = icy(mp3, 4000);
+  cases.push_back(fileCase("mp3_file", "/bench/input.mp3"));
+  cases.push_back(urlCase("url_mp3_64k", &mp3, 64000, "http://bench.local/input.mp3"));
+  cases.back().sameAs = "mp3_file";
+  cases.push_back(urlCase("url_mp3_icy", &mp3Radio, 64000, "http://bench.local/stream", false, 4000, "audio/mpeg"));
+  cases.back().sameAs = "mp3_file";
+
+  std::map<std::string, uint32_t> expected;
+  if (checkPath) expected = loadHashes(checkPath);
+  FILE* save = savePath ? fopen(savePath, "w") : nullptr;
+  std::map<std::string, uint32_t> seen;
+  int changed = 0;
+
+  printf("%-18s %10s %9s %10s %9s %8s %10s  %s\n",
+         "case", "samples", "wall_ms", "Msamp/s", "realtime", "underrun", "dec_Mcyc/s", "hash");
+  for (const BenchCase& c : cases) {
+    BenchResult r = runCase(c, outDir, repeat, seconds * 4 + 10);
+    if (!r.ok) {
+      printf("%-18s failed: %s\n", c.name.c_str(), r.error.c_str());
+      changed++;
+      continue;
+    }
+    double audioMs = r.samples * 1000.0 / AUDIO_OUTPUT_RATE;
+    double rate = r.wallMs > 0 ? r.samples / r.wallMs / 1000.0 : 0;
+    double rt = r.wallMs > 0 ? audioMs / r.wallMs : 0;
+    String mark;
+    if (checkPath) {
+      auto it = expected.find(c.name.c_str());
+      if (it == expected.end()) mark = "  (no reference)";
+      else if (it->second != r.hash) { mark = "  CHANGED"; changed++; }
+    }
+    seen[c.name.c_str()] = r.hash;
+    if (c.sameAs && seen.count(c.sameAs) && seen[c.sameAs] != r.hash) {
+      mark += String("  DIFFERS from ") + c.sameAs;
+      changed++;
+    }
+    char dec[16] = "-";
+    if (r.decodeNsPerSec) snprintf(dec, sizeof(dec), "%.2f", r.decodeNsPerSec * C3_CYCLES_PER_NS / 1e6);
+    printf("%-18s %10llu %9.2f %10.2f %8.0fx %8lu %10s  %08lx%s\n", c.name.c_str(),
+           (unsigned long long)r.samples, r.wallMs, rate, rt,
+           (unsigned long)r.underruns, dec, (unsigned long)r.hash, mark.c_str());
+    if (save) fprintf(save, "%s %08lx\n", c.name.c_str(), (unsigned long)r.hash);
+  }
+  if (save) fclose(save);
+  return changed ? 1 : 0;
+}
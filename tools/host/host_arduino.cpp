@@ -0,0 +1,153 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <chrono>
+#include <errno.h>
+#include <sys/stat.h>
+
+EspClass ESP;
+HostFS LittleFS;
+
+static uint64_t virtualUs = 0;
+
+uint32_t millis() { return (uint32_t)(virtualUs / 1000); }
+uint32_t micros() { return (uint32_t)virtualUs; }
+void delay(uint32_t ms) { virtualUs += (uint64_t)ms * 1000; }
+void hostAdvanceMicros(uint64_t us) { virtualUs += us; }
+uint64_t hostMicros() { return virtualUs; }
+
+uint32_t EspClass::getCycleCount() {
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/* File */
+File::File(FILE* f) : h(std::make_shared<Handle>()) { h->fp = f; }
+
+size_t File::read(uint8_t* buf, size_t n) { return *this ? fread(buf, 1, n, h->fp) : 0; }
+
+int File::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+size_t File::write(const uint8_t* buf, size_t n) { return *this ? fwrite(buf, 1, n, h->fp) : 0; }
+
+bool File::seek(uint32_t pos) {
+  if (!*this || pos > size()) return false;
+  return fseek(h->fp, (long)pos, SEEK_SET) == 0;
+}
+
+size_t File::position() const { return *this ? (size_t)ftell(h->fp) : 0; }
+
+size_t File::size() const {
+  if (!*this) return 0;
+  fflush(h->fp);
+  struct stat st;
+  return fstat(fileno(h->fp), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+int File::available() { return *this ? (int)(size() - position()) : 0; }
+
+void File::close() {
+  if (!*this) return;
+  fclose(h->fp);
+  h->fp = nullptr;
+}
+
+/* LittleFS */
+static std::string fsRoot = ".";
+
+static std::string hostPath(const String& path) {
+  return fsRoot + (path.startsWith("/") ? "" : "/") + path.c_str();
+}
+
+// Creates missing parents too; errno tells why when it fails.
+bool hostFsBegin(const char* rootDir) {
+  fsRoot = rootDir;
+  for (size_t i = 1; i <= fsRoot.size(); i++) {
+    if (i < fsRoot.size() && fsRoot[i] != '/') continue;
+    if (::mkdir(fsRoot.substr(0, i).c_str(), 0755) != 0 && errno != EEXIST) return false;
+  }
+  struct stat st;
+  if (stat(rootDir, &st) != 0) return false;
+  if (!S_ISDIR(st.st_mode)) { errno = ENOTDIR; return false; }
+  return true;
+}
+
+File HostFS::open(const String& path, const char* mode, bool) {
+  const char* m = (mode[0] == 'w') ? "w+b" : (mode[0] == 'a') ? "a+b" : (mode[1] == '+') ? "r+b" : "rb";
+  FILE* fp = fopen(hostPath(path).c_str(), m);
+  return fp ? File(fp) : File();
+}
+
+bool HostFS::exists(const String& path) {
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool HostFS::remove(const String& path) { return ::remove(hostPath(path).c_str()) == 0; }
+
+bool HostFS::rename(const String& from, const String& to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool HostFS::mkdir(const String& path) {
+  ::mkdir(hostPath(path).c_str(), 0755);
+  return exists(path);
+}
+
+/* Network */
+static std::vector<uint8_t> netBody;
+static uint32_t netRate = 0;
+static int netStatus = 200;
+static std::vector<std::pair<String, String>> netHeaders;
+
+void hostNetServe(const std::vector<uint8_t>& body, uint32_t bytesPerSec, int status) {
+  netBody = body;
+  netRate = bytesPerSec;
+  netStatus = status;
+  netHeaders.clear();
+}
+
+void hostNetHeader(const char* name, const char* value) {
+  netHeaders.push_back({name, value});
+}
+
+// The status line and headers arrive at once; only the body is throttled.
+int WiFiClient::connect(const char*, uint16_t, int32_t) {
+  open = true;
+  startUs = hostMicros();
+  pos = 0;
+  head = "HTTP/1.1 " + std::to_string(netStatus) + " OK\r\n";
+  for (const auto& h : netHeaders) head += std::string(h.first.c_str()) + ": " + h.second.c_str() + "\r\n";
+  head += "\r\n";
+  return 1;
+}
+
+size_t WiFiClient::write(const uint8_t*, size_t n) {
+  return open ? n : 0;
+}
+
+int WiFiClient::available() {
+  if (!open) return 0;
+  size_t sent = netBody.size();
+  if (netRate) sent = min(sent, (size_t)((hostMicros() - startUs) * netRate / 1000000));
+  sent += head.size();
+  return sent > pos ? (int)(sent - pos) : 0;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t n) {
+  size_t k = min(n, (size_t)available());
+  for (size_t i = 0; i < k; i++, pos++) {
+    buf[i] = pos < head.size() ? (uint8_t)head[pos] : netBody[pos - head.size()];
+  }
+  return (int)k;
+}
+
+int WiFiClient::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+bool WiFiClient::connected() { return open && pos < head.size() + netBody.size(); }
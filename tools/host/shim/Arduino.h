@@ -0,0 +1,88 @@
+#pragma once
+// Just enough of the Arduino-ESP32 core to build the audio decode path on a
+// PC (see tools/host/audio_bench.cpp). Time is virtual: millis()/micros()
+// only move when the host program advances them or something delays.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+using std::min;
+using std::max;
+
+class String {
+public:
+  String() {}
+  String(const char* c) : s(c ? c : "") {}
+  String(const std::string& x) : s(x) {}
+  String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+
+  unsigned int length() const { return (unsigned int)s.size(); }
+  const char* c_str() const { return s.c_str(); }
+  bool startsWith(const String& p) const { return s.compare(0, p.s.size(), p.s) == 0; }
+  bool endsWith(const String& p) const {
+    return s.size() >= p.s.size() && s.compare(s.size() - p.s.size(), p.s.size(), p.s) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const { return found(s.find(c, from)); }
+  int indexOf(const String& x, unsigned int from = 0) const { return found(s.find(x.s, from)); }
+  int lastIndexOf(char c) const { return found(s.rfind(c)); }
+  int lastIndexOf(const String& x) const { return found(s.rfind(x.s)); }
+  String substring(unsigned int from) const { return from < s.size() ? s.substr(from) : std::string(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (to > s.size()) to = (unsigned int)s.size();
+    return from < to ? s.substr(from, to - from) : std::string();
+  }
+  void toLowerCase() { for (char& c : s) c = (char)tolower((unsigned char)c); }
+  long toInt() const { return atol(s.c_str()); }
+  void reserve(unsigned int n) { s.reserve(n); }
+  char operator[](unsigned int i) const { return i < s.size() ? s[i] : 0; }
+
+  String& operator+=(const String& o) { s += o.s; return *this; }
+  String& operator+=(const char* c) { s += c; return *this; }
+  String& operator+=(char c) { s += c; return *this; }
+  bool operator==(const String& o) const { return s == o.s; }
+  bool operator==(const char* o) const { return s == o; }
+  bool operator!=(const String& o) const { return s != o.s; }
+  friend String operator+(const String& a, const String& b) { return a.s + b.s; }
+  friend String operator+(const String& a, const char* b) { return a.s + b; }
+  friend String operator+(const char* a, const String& b) { return a + b.s; }
+
+private:
+  static int found(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  std::string s;
+};
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void hostAdvanceMicros(uint64_t us);
+uint64_t hostMicros();
+
+// getCycleCount() counts wall-clock nanoseconds on the host.
+struct EspClass {
+  uint32_t getCycleCount();
+};
+extern EspClass ESP;
+
+#if !defined(__APPLE__) && !(defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 38))
+inline size_t strlcpy(char* d, const char* src, size_t n) {
+  size_t l = strlen(src);
+  if (n) {
+    size_t c = l < n - 1 ? l : n - 1;
+    memcpy(d, src, c);
+    d[c] = 0;
+  }
+  return l;
+}
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+#include <stdio.h>
+#include <memory>
+
+// fs::File over stdio. Copies share one handle and close() closes it for
+// all of them, as on the device.
+class File {
+public:
+  File() {}
+  explicit File(FILE* f);
+
+  size_t read(uint8_t* buf, size_t n);
+  int read();
+  size_t write(const uint8_t* buf, size_t n);
+  size_t write(uint8_t b) { return write(&b, 1); }
+  bool seek(uint32_t pos);
+  size_t position() const;
+  size_t size() const;
+  int available();
+  void close();
+  explicit operator bool() const { return h && h->fp; }
+
+private:
+  struct Handle {
+    FILE* fp = nullptr;
+    ~Handle() { if (fp) fclose(fp); }
+  };
+  std::shared_ptr<Handle> h;
+};
@@ -0,0 +1,18 @@
+#pragma once
+#include "FS.h"
+
+// LittleFS on the host: absolute paths are mapped below a directory.
+class HostFS {
+public:
+  File open(const String& path, const char* mode = "r", bool create = false);
+  bool exists(const String& path);
+  bool remove(const String& path);
+  bool rename(const String& from, const String& to);
+  bool mkdir(const String& path);
+};
+
+extern HostFS LittleFS;
+
+// Directory that stands in for the flash root; created (with any missing
+// parents) if needed. false if it cannot be, with errno saying why.
+bool hostFsBegin(const char* rootDir);
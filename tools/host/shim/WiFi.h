@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+
+// A socket to the simulated server: the response head, then the body set
+// with hostNetServe() at its byte rate, measured on the virtual clock from
+// connect().
+class WiFiClient {
+public:
+  virtual ~WiFiClient() {}
+  int connect(const char* host, uint16_t port, int32_t timeoutMs);
+  size_t write(const uint8_t* buf, size_t n);   // the request is discarded
+  int available();
+  int read();
+  int read(uint8_t* buf, size_t n);
+  bool connected();
+  void stop() { open = false; }
+private:
+  bool open = false;
+  uint64_t startUs = 0;
+  size_t pos = 0;
+  std::string head;   // status line and headers, sent ahead of the body
+};
+
+// Body and throughput for the next connections; 0 bytes/s is unthrottled.
+void hostNetServe(const std::vector<uint8_t>& body, uint32_t bytesPerSec, int status = 200);
+// A response header for the next connections; hostNetServe() clears them.
+void hostNetHeader(const char* name, const char* value);
@@ -0,0 +1,23 @@
+#pragma once
+#include <Arduino.h>
+
+// The core's base64 helper, for HTTP basic auth.
+class base64 {
+public:
+  static String encode(const String& text) {
+    static const char* tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const uint8_t* p = (const uint8_t*)text.c_str();
+    size_t n = text.length();
+    String out;
+    for (size_t i = 0; i < n; i += 3) {
+      uint32_t v = (uint32_t)p[i] << 16;
+      if (i + 1 < n) v |= (uint32_t)p[i + 1] << 8;
+      if (i + 2 < n) v |= p[i + 2];
+      out += tbl[(v >> 18) & 63];
+      out += tbl[(v >> 12) & 63];
+      out += (i + 1 < n) ? tbl[(v >> 6) & 63] : '=';
+      out += (i + 2 < n) ? tbl[v & 63] : '=';
+    }
+    return out;
+  }
+};
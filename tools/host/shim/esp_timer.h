@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+
+typedef struct esp_timer* esp_timer_handle_t;
@@ -0,0 +1,5 @@
+#pragma once
+#include "FreeRTOS.h"
+
+// Only the handle type: the host build has no second task to lock against.
+typedef void* SemaphoreHandle_t;
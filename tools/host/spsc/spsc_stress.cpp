@@ -0,0 +1,125 @@
+// Host stress test of SpscRing (src/spsc_ring.h) with a real producer and
+// consumer thread. Built by the native-spsc environment in platformio.ini.
+//
+// The producer writes consecutive sequence numbers, the consumer checks that
+// every value arrives once and in order. Both sides switch between the copy
+// calls (write/read) and the span calls (writeSpan/commitWrite and
+// readSpan/commitRead) with pseudo-random block sizes, so blocks straddle the
+// wrap point in every alignment. The ring is small against the item count,
+// so it wraps millions of times, and each side also checks that the fill
+// level it sees stays within 0..CAPACITY.
+//
+//   program [--items N]   (default 50 000 000)
+//
+// With --items above 2^32 the free-running head and tail counters wrap as
+// well. Exit status 1 on the first error.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "spsc_ring.h"
+
+static const uint32_t RING_CAP = 256;
+static const uint32_t MAX_BLOCK = 97;   // prime, so blocks drift against the wrap point
+
+typedef SpscRing<uint32_t, RING_CAP> Ring;
+
+static std::atomic<bool> failed{false};
+static char failure[160];
+
+static void fail(const char* what, uint64_t at, uint64_t got, uint64_t want) {
+  bool first = !failed.exchange(true);
+  if (first) snprintf(failure, sizeof(failure), "%s at item %llu: got %llu, expected %llu", what,
+                      (unsigned long long)at, (unsigned long long)got, (unsigned long long)want);
+}
+
+static uint32_t xorshift(uint32_t& s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+static void producer(Ring& ring, uint64_t items) {
+  uint32_t rng = 0x12345678;
+  uint32_t buf[MAX_BLOCK];
+  uint64_t next = 0;
+  while (next < items && !failed) {
+    uint32_t r = xorshift(rng);
+    size_t want = 1 + r % MAX_BLOCK;
+    if (want > items - next) want = (size_t)(items - next);
+    uint32_t fill = ring.size();
+    if (fill > RING_CAP) { fail("producer saw fill", next, fill, RING_CAP); return; }
+
+    if (r & 0x80000000u) {
+      for (size_t i = 0; i < want; i++) buf[i] = (uint32_t)(next + i);
+      next += ring.write(buf, want);
+    } else {
+      uint32_t* dst;
+      size_t span = ring.writeSpan(&dst);
+      if (span > want) span = want;
+      for (size_t i = 0; i < span; i++) dst[i] = (uint32_t)(next + i);
+      ring.commitWrite(span);
+      next += span;
+    }
+    if (ring.space() == 0) std::this_thread::yield();
+  }
+}
+
+static void consumer(Ring& ring, uint64_t items, uint32_t& maxFill) {
+  uint32_t rng = 0x9E3779B9;
+  uint32_t buf[MAX_BLOCK];
+  uint64_t next = 0;
+  while (next < items && !failed) {
+    uint32_t r = xorshift(rng);
+    size_t want = 1 + r % MAX_BLOCK;
+    uint32_t fill = ring.size();
+    if (fill > RING_CAP) { fail("consumer saw fill", next, fill, RING_CAP); return; }
+    if (fill > maxFill) maxFill = fill;
+
+    const uint32_t* src;
+    size_t got;
+    if (r & 0x80000000u) {
+      got = ring.read(buf, want);
+      src = buf;
+    } else {
+      got = ring.readSpan(&src);
+      if (got > want) got = want;
+    }
+    for (size_t i = 0; i < got; i++) {
+      if (src[i] != (uint32_t)(next + i)) { fail("out of order", next + i, src[i], (uint32_t)(next + i)); return; }
+    }
+    if (!(r & 0x80000000u)) ring.commitRead(got);
+    next += got;
+    if (got == 0) std::this_thread::yield();
+  }
+  if (!failed && !ring.empty()) fail("left over", next, ring.size(), 0);
+}
+
+int main(int argc, char** argv) {
+  uint64_t items = 50000000ULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--items") == 0 && i + 1 < argc) items = strtoull(argv[++i], nullptr, 10);
+    else { fprintf(stderr, "usage: spsc_stress [--items N]\n"); return 2; }
+  }
+
+  static Ring ring;
+  uint32_t maxFill = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  std::thread c(consumer, std::ref(ring), items, std::ref(maxFill));
+  std::thread p(producer, std::ref(ring), items);
+  p.join();
+  c.join();
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  if (failed) {
+    printf("FAIL: %s\n", failure);
+    return 1;
+  }
+  printf("ok: %llu items through a %u-slot ring (%llu wraps) in %.2f s, %.1f M items/s, max fill %u\n",
+         (unsigned long long)items, RING_CAP, (unsigned long long)(items / RING_CAP), s,
+         s > 0 ? items / s / 1e6 : 0.0, maxFill);
+  return 0;
+}
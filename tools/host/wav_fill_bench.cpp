@@ -0,0 +1,184 @@
+// WAV fill path benchmark, run by audio_bench --fill (native-bench env).
+//
+// "loop" is the WAV reader as it was before the block reader: 256 frames
+// per file read into a stack buffer, converted one frame at a time and
+// pushed sample by sample into a volatile ring, which the output side pops
+// one sample at a time. "voice" is the current path: AudioVoice::read(),
+// i.e. block-aligned reads into wavIn, the word-at-a-time pcmToMono16
+// kernels straight into the caller's buffer, and the gain stage. Both are
+// drained in 256-sample blocks, as the PDM sink pulls them, and the loop
+// is only filled while the ring has room for a whole read, so it never
+// drops frames. The time is wall time on the host over the HostFS file;
+// the best of --repeat runs is reported, plus a hash of the samples and the
+// largest difference between the two outputs. Mono is bit-exact; the stereo
+// kernels round the average down where the loop truncated toward zero, so
+// stereo differs by at most 1.
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <chrono>
+#include <vector>
+#include "audio_voice.h"
+#include "wav_fill_bench.h"
+
+static const int BLOCK_SAMPLES = 256;
+static const int WAV_HEADER_BYTES = 44;
+
+// The original reader, kept as it was apart from being taken out of the
+// player class. Only canonical 16-bit headers are handled.
+struct LoopWavFill {
+  static const int RB_CAP = 8192;
+  static const int CHUNK_FRAMES = 256;
+
+  File file;
+  int wavChannels = 1;
+  uint32_t wavDataRemaining = 0;
+  bool inputEnded = false;
+  volatile int rbHead = 0, rbTail = 0, rbCount = 0;
+  int16_t rb[RB_CAP];
+
+  bool begin(const char* path) {
+    file = LittleFS.open(path, "r");
+    uint8_t h[WAV_HEADER_BYTES];
+    if (!file || file.read(h, sizeof(h)) != sizeof(h)) return false;
+    wavChannels = h[22] | (h[23] << 8);
+    wavDataRemaining = (uint32_t)h[40] | ((uint32_t)h[41] << 8) | ((uint32_t)h[42] << 16) | ((uint32_t)h[43] << 24);
+    inputEnded = false;
+    rbHead = rbTail = rbCount = 0;
+    return (h[34] | (h[35] << 8)) == 16 && (wavChannels == 1 || wavChannels == 2);
+  }
+
+  bool rbPush(int16_t s) {
+    if (rbCount >= RB_CAP) return false;
+    rb[rbHead] = s;
+    rbHead = (rbHead + 1) % RB_CAP;
+    rbCount++;
+    return true;
+  }
+
+  bool rbPop(int16_t& s) {
+    if (rbCount <= 0) return false;
+    s = rb[rbTail];
+    rbTail = (rbTail + 1) % RB_CAP;
+    rbCount--;
+    return true;
+  }
+
+  bool fillWav() {
+    if (wavDataRemaining == 0) { inputEnded = true; return false; }
+
+    uint8_t raw[CHUNK_FRAMES * 4];
+    int bytesPerFrame = wavChannels * 2;
+    uint32_t wantBytes = (uint32_t)CHUNK_FRAMES * (uint32_t)bytesPerFrame;
+    if (wantBytes > wavDataRemaining) wantBytes = wavDataRemaining;
+
+    size_t got = file.read(raw, wantBytes);
+    if (got == 0) return false;
+    wavDataRemaining -= (uint32_t)got;
+
+    int frames = (int)(got / bytesPerFrame);
+    for (int i = 0; i < frames; i++) {
+      int16_t l = (int16_t)(raw[i * bytesPerFrame + 0] | (raw[i * bytesPerFrame + 1] << 8));
+      int16_t s = l;
+      if (wavChannels == 2) {
+        int16_t r = (int16_t)(raw[i * bytesPerFrame + 2] | (raw[i * bytesPerFrame + 3] << 8));
+        s = (int16_t)(((int32_t)l + (int32_t)r) / 2);
+      }
+      if (!rbPush(s)) break;
+    }
+    return true;
+  }
+
+  // One output block, topping the ring up first while a whole read fits.
+  size_t read(int16_t* dst, size_t n) {
+    while (!inputEnded && rbCount <= RB_CAP - CHUNK_FRAMES && fillWav()) {}
+    size_t got = 0;
+    while (got < n && rbPop(dst[got])) got++;
+    return got;
+  }
+};
+
+struct FillRun {
+  bool ok = false;
+  uint64_t samples = 0;
+  uint32_t hash = 0;
+  double wallMs = 0;
+  std::vector<int16_t> out;
+};
+
+static uint32_t fnv(uint32_t h, const int16_t* s, size_t n) {
+  const uint8_t* b = (const uint8_t*)s;
+  for (size_t i = 0; i < n * sizeof(int16_t); i++) h = (h ^ b[i]) * 16777619u;
+  return h;
+}
+
+// Drains a source block by block until it returns nothing, keeping what it
+// delivered; the hash is taken after the clock has stopped.
+template <typename Source>
+static void drain(Source& src, FillRun& r) {
+  using namespace std::chrono;
+  r.out.clear();
+  int16_t block[BLOCK_SAMPLES];
+  auto t0 = steady_clock::now();
+  size_t n;
+  while ((n = src.read(block, BLOCK_SAMPLES)) > 0) r.out.insert(r.out.end(), block, block + n);
+  r.wallMs = duration<double, std::milli>(steady_clock::now() - t0).count();
+  r.samples = r.out.size();
+  r.hash = fnv(2166136261u, r.out.data(), r.out.size());
+}
+
+static FillRun runLoop(const char* path, int repeat) {
+  static LoopWavFill loop;
+  FillRun best;
+  for (int i = 0; i < repeat; i++) {
+    FillRun r;
+    if (!loop.begin(path)) return best;
+    drain(loop, r);
+    loop.file.close();
+    if (i == 0 || r.wallMs < best.wallMs) best = std::move(r);
+  }
+  best.ok = true;
+  return best;
+}
+
+static FillRun runVoice(const char* path, int repeat) {
+  static AudioVoice voice;
+  FillRun best;
+  for (int i = 0; i < repeat; i++) {
+    FillRun r;
+    if (!voice.startLocal(path, 100, 0)) return best;
+    drain(voice, r);
+    voice.stop();
+    if (i == 0 || r.wallMs < best.wallMs) best = std::move(r);
+  }
+  best.ok = true;
+  return best;
+}
+
+int wavFillBench(const WavFillInput* inputs, int count, int repeat) {
+  int bad = 0;
+  printf("%-18s %-6s %10s %9s %10s %8s  %-8s  %s\n",
+         "input", "path", "samples", "wall_ms", "Msamp/s", "speedup", "hash", "max_diff");
+  for (int i = 0; i < count; i++) {
+    const WavFillInput& in = inputs[i];
+    FillRun loop = runLoop(in.path, repeat);
+    FillRun now = runVoice(in.path, repeat);
+    if (!loop.ok || !now.ok) {
+      printf("%-18s failed to open %s\n", in.name, in.path);
+      bad++;
+      continue;
+    }
+    double loopRate = loop.wallMs > 0 ? loop.samples / loop.wallMs / 1000.0 : 0;
+    double nowRate = now.wallMs > 0 ? now.samples / now.wallMs / 1000.0 : 0;
+    int maxDiff = 0;
+    for (size_t k = 0; k < min(loop.out.size(), now.out.size()); k++) {
+      maxDiff = max(maxDiff, abs((int)loop.out[k] - (int)now.out[k]));
+    }
+    printf("%-18s %-6s %10llu %9.2f %10.2f %8s  %08lx\n", in.name, "loop",
+           (unsigned long long)loop.samples, loop.wallMs, loopRate, "", (unsigned long)loop.hash);
+    printf("%-18s %-6s %10llu %9.2f %10.2f %7.2fx  %08lx  %d\n", in.name, "voice",
+           (unsigned long long)now.samples, now.wallMs, nowRate, loopRate > 0 ? nowRate / loopRate : 0,
+           (unsigned long)now.hash, maxDiff);
+    if (now.samples != loop.samples || maxDiff > 1) bad++;
+  }
+  return bad;
+}
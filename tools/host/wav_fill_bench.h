@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+// WAV fill path throughput: the current AudioVoice reader against the
+// original per-sample loop, over canonical 16-bit PCM files that are already
+// at AUDIO_OUTPUT_RATE (the only layout the original loop could play).
+struct WavFillInput {
+  const char* name;
+  const char* path;   // on LittleFS
+};
+
+// Prints one line per input and path. Returns the number of inputs where
+// the two paths delivered a different number of samples or differ by more
+// than the 1 LSB of stereo rounding.
+int wavFillBench(const WavFillInput* inputs, int count, int repeat);
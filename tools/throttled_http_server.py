@@ -0,0 +1,69 @@
+"""
+HTTP file server that throttles and stalls its output, for testing the
+URL jitter buffer against a real network path.
+
+Usage:
+  python tools/throttled_http_server.py DIR [--port 8000] [--rate 48000]
+                                           [--stall-every 5] [--stall 1.5]
+Serves files from DIR at --rate bytes/s and, every --stall-every seconds,
+stops sending for --stall seconds. Point an alarm URL at
+http://<pc-ip>:8000/file.wav and watch audio_underruns in /api/status.
+"""
+
+import argparse
+import functools
+import http.server
+import os
+import time
+
+
+class ThrottledHandler(http.server.SimpleHTTPRequestHandler):
+    rate = 48000
+    stall_every = 0.0
+    stall = 0.0
+
+    def copyfile(self, source, outputfile) -> None:
+        chunk = max(256, self.rate // 20)
+        start = time.monotonic()
+        next_stall = start + self.stall_every if self.stall_every > 0 else None
+        sent = 0
+        while True:
+            data = source.read(chunk)
+            if not data:
+                break
+            outputfile.write(data)
+            sent += len(data)
+            now = time.monotonic()
+            if next_stall is not None and now >= next_stall:
+                print(f"[throttle] stalling {self.stall:.1f}s after {sent} bytes")
+                time.sleep(self.stall)
+                start += self.stall
+                next_stall = time.monotonic() + self.stall_every
+            ahead = start + sent / self.rate - time.monotonic()
+            if ahead > 0:
+                time.sleep(ahead)
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser()
+    ap.add_argument("dir")
+    ap.add_argument("--port", type=int, default=8000)
+    ap.add_argument("--rate", type=int, default=48000, help="bytes per second")
+    ap.add_argument("--stall-every", type=float, default=0.0, help="seconds between stalls (0 = never)")
+    ap.add_argument("--stall", type=float, default=1.0, help="stall length in seconds")
+    args = ap.parse_args()
+
+    ThrottledHandler.rate = args.rate
+    ThrottledHandler.stall_every = args.stall_every
+    ThrottledHandler.stall = args.stall
+    handler = functools.partial(ThrottledHandler, directory=os.path.abspath(args.dir))
+    server = http.server.ThreadingHTTPServer(("0.0.0.0", args.port), handler)
+    print(f"[throttle] serving {args.dir} on :{args.port} at {args.rate} B/s")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
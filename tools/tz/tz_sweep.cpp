@@ -0,0 +1,131 @@
+// Host check of TimeZone (src/time_zone.cpp) against the C library. Built by
+// the native-tz environment in platformio.ini.
+//
+// For each zone, every minute of the year is converted both ways:
+//  - UTC to offset, compared with localtime_r().
+//  - Wall time to UTC, compared with mktime(tm_isdst = -1). Wall times that
+//    fall in a DST gap or overlap are ambiguous and libc implementations
+//    differ there, so they are checked against the rule TimeZone documents
+//    instead (gap: moved forward by the gap, overlap: the first pass) and
+//    counted separately.
+// Exit status 1 if anything differs.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "time_zone.h"
+
+static const char* DEFAULT_ZONES[] = {
+  "CET-1CEST,M3.5.0/2,M10.5.0/3",      // Europe/Stockholm, the firmware default
+  "EST5EDT,M3.2.0,M11.1.0",            // America/New_York
+  "AEST-10AEDT,M10.1.0,M4.1.0/3",      // Australia/Sydney, DST over new year
+  "NZST-12NZDT,M9.5.0,M4.1.0/3",
+  "<+0330>-3:30",                      // fixed, half hour
+  "UTC0",
+};
+
+struct SweepResult {
+  long offsetErrors = 0;
+  long localErrors = 0;
+  long gapMinutes = 0;
+  long overlapMinutes = 0;
+  long libcDiffers = 0;  // ambiguous minutes where libc chose otherwise
+};
+
+static SweepResult sweep(const char* posix, int year) {
+  SweepResult r;
+  TimeZone tz;
+  if (!tz.begin(posix)) {
+    printf("%-32s parse error: %s\n", posix, tz.error());
+    r.offsetErrors = 1;
+    return r;
+  }
+  setenv("TZ", posix, 1);
+  tzset();
+
+  int64_t from = TimeZone::daysFromCivil(year, 1, 1) * 86400;
+  int64_t to = TimeZone::daysFromCivil(year + 1, 1, 1) * 86400;
+  tz.refresh((time_t)from);
+
+  for (int64_t t = from; t < to; t += 60) {
+    time_t u = (time_t)t;
+    struct tm lt;
+    localtime_r(&u, &lt);
+    if (tz.offsetAt(u) != lt.tm_gmtoff) {
+      if (r.offsetErrors++ < 5) printf("  offset %lld: %d, libc %ld\n", (long long)t, tz.offsetAt(u), lt.tm_gmtoff);
+    }
+  }
+
+  for (int64_t local = from; local < to; local += 60) {
+    time_t ours = tz.toUtc(local);
+    int y, m, d;
+    TimeZone::civilFromDays(TimeZone::dayOf(local), y, m, d);
+    int64_t sec = local - TimeZone::dayOf(local) * 86400;
+    struct tm in {};
+    in.tm_year = y - 1900;
+    in.tm_mon = m - 1;
+    in.tm_mday = d;
+    in.tm_hour = (int)(sec / 3600);
+    in.tm_min = (int)(sec / 60 % 60);
+    in.tm_isdst = -1;
+    time_t libc = mktime(&in);
+
+    // Candidates at the two offsets that could apply this day.
+    int32_t a = tz.offsetAt((time_t)(local - 86400)), b = tz.offsetAt((time_t)(local + 86400));
+    int32_t lo = a < b ? a : b, hi = a < b ? b : a;
+    bool hiValid = tz.offsetAt((time_t)(local - hi)) == hi;
+    bool loValid = tz.offsetAt((time_t)(local - lo)) == lo;
+
+    bool ok;
+    if (lo != hi && hiValid && loValid) {
+      r.overlapMinutes++;
+      ok = ours == (time_t)(local - hi);
+      if (libc != ours) r.libcDiffers++;
+    } else if (lo != hi && !hiValid && !loValid) {
+      r.gapMinutes++;
+      ok = ours == (time_t)(local - lo) && tz.toLocal(ours) == local + (hi - lo);
+      if (libc != ours) r.libcDiffers++;
+    } else {
+      ok = ours == libc;
+    }
+    if (!ok && r.localErrors++ < 5) {
+      printf("  local %04d-%02d-%02d %02d:%02d: %lld, libc %lld\n", y, m, d, in.tm_hour, in.tm_min,
+             (long long)ours, (long long)libc);
+    }
+  }
+
+  printf("%-32s %d: offset errors %ld, wall time errors %ld, gap %ld min, overlap %ld min (libc differs on %ld)\n",
+         posix, year, r.offsetErrors, r.localErrors, r.gapMinutes, r.overlapMinutes, r.libcDiffers);
+  return r;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: tz_sweep [--year Y] [--tz POSIX]...\n");
+}
+
+int main(int argc, char** argv) {
+  int year = 0;
+  const char* zones[16];
+  int nZones = 0;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--year") && hasValue) year = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--tz") && hasValue && nZones < 16) zones[nZones++] = argv[++i];
+    else { usage(); return 2; }
+  }
+  if (year == 0) {
+    time_t now = time(nullptr);
+    int m, d;
+    TimeZone::civilFromDays(TimeZone::dayOf(now), year, m, d);
+  }
+  if (nZones == 0) {
+    for (const char* z : DEFAULT_ZONES) zones[nZones++] = z;
+  }
+
+  bool failed = false;
+  for (int i = 0; i < nZones; i++) {
+    SweepResult r = sweep(zones[i], year);
+    failed |= r.offsetErrors || r.localErrors;
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+"""
+Converts a PCM WAV file to mono IMA-ADPCM WAV (format 0x11, 256-byte blocks)
+on the PC, keeping its sample rate. Same layout as the firmware writes for
+uploads with ?format=adpcm, for preparing files in data/audio before uploadfs.
+
+Usage:
+  python tools/wav2adpcm.py in.wav out.wav
+"""
+
+import struct
+import sys
+import wave
+
+STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767,
+]
+INDEX = [-1, -1, -1, -1, 2, 4, 6, 8]
+BLOCK_BYTES = 256
+SAMPLES_PER_BLOCK = (BLOCK_BYTES - 4) * 2 + 1
+
+
+def read_mono16(path):
+    with wave.open(path, "rb") as w:
+        ch, width, rate, n = w.getnchannels(), w.getsampwidth(), w.getframerate(), w.getnframes()
+        raw = w.readframes(n)
+    if width == 1:
+        vals = [(b - 128) << 8 for b in raw]
+    elif width == 2:
+        vals = list(struct.unpack("<%dh" % (len(raw) // 2), raw))
+    elif width == 3:
+        vals = [int.from_bytes(raw[i + 1:i + 3], "little", signed=True) for i in range(0, len(raw), 3)]
+    else:
+        sys.exit("unsupported sample width %d" % width)
+    if ch == 2:
+        vals = [(vals[i] + vals[i + 1]) >> 1 for i in range(0, len(vals) - 1, 2)]
+    elif ch != 1:
+        sys.exit("unsupported channel count %d" % ch)
+    return vals, rate
+
+
+def encode(samples):
+    out = bytearray()
+    index = 0
+    for start in range(0, len(samples), SAMPLES_PER_BLOCK):
+        block = samples[start:start + SAMPLES_PER_BLOCK]
+        block += [block[-1]] * (SAMPLES_PER_BLOCK - len(block))
+        pred = block[0]
+        out += struct.pack("<hBB", pred, index, 0)
+        codes = []
+        for s in block[1:]:
+            step = STEPS[index]
+            diff = s - pred
+            code = 0
+            if diff < 0:
+                code, diff = 8, -diff
+            for bit in (4, 2, 1):
+                if diff >= step:
+                    code |= bit
+                    diff -= step
+                step >>= 1
+            step = STEPS[index]
+            d = step >> 3
+            if code & 1: d += step >> 2
+            if code & 2: d += step >> 1
+            if code & 4: d += step
+            pred = max(-32768, min(32767, pred - d if code & 8 else pred + d))
+            index = max(0, min(88, index + INDEX[code & 7]))
+            codes.append(code)
+        out += bytes(codes[i] | (codes[i + 1] << 4) for i in range(0, len(codes), 2))
+    return bytes(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    samples, rate = read_mono16(sys.argv[1])
+    data = encode(samples)
+    fmt = struct.pack("<HHIIHHHH", 0x11, 1, rate, rate * BLOCK_BYTES // SAMPLES_PER_BLOCK,
+                      BLOCK_BYTES, 4, 2, SAMPLES_PER_BLOCK)
+    body = (b"WAVE" + b"fmt " + struct.pack("<I", len(fmt)) + fmt +
+            b"fact" + struct.pack("<II", 4, len(samples)) +
+            b"data" + struct.pack("<I", len(data)) + data)
+    with open(sys.argv[2], "wb") as f:
+        f.write(b"RIFF" + struct.pack("<I", len(body)) + body)
+    print("%s: %d samples at %d Hz, %d bytes" % (sys.argv[2], len(samples), rate, 8 + len(body)))
+
+
+if __name__ == "__main__":
+    main()